@@ -1,27 +1,115 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
-#include "transaction.hpp"
+#include <array>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "money.hpp"
+
+// Stable in-memory handle for an account; valid until the next Bank::load().
+using AccountId = std::uint32_t;
+constexpr AccountId kNoAccount = UINT32_MAX;
+
+// Raw SHA-256 of a password: half the size of the hex form that goes to disk.
+using PasswordDigest = std::array<std::uint8_t, 32>;
+
+// Parses the 64-character lowercase hex form written by Bank::hash_password.
+bool digest_from_hex(std::string_view hex, PasswordDigest& out);
+// Writes 64 hex characters to out (not NUL-terminated).
+void digest_to_hex(const PasswordDigest& digest, char* out);
+std::string digest_to_hex(const PasswordDigest& digest);
+
+// Compact account storage, one per Bank shard. Accounts get dense slot numbers in creation
+// order and are kept as a structure of arrays indexed by slot: usernames live back to back in
+// string arenas, and an open-addressing table maps a username to its slot. Nothing is ever
+// removed, so slots stay valid until clear().
+//
+// Usernames, digests and balances sit in fixed-size pages held by shared_ptr, so freeze() can hand out
+// a point-in-time copy of the table for the price of the page pointers. A page still shared
+// with a Frozen view is copied before its next write (copy-on-write); pages nobody froze are
+// written in place.
+class AccountTable {
+    static constexpr unsigned kPageBits = 10;
+    static constexpr std::uint32_t kPageSize = 1u << kPageBits;
+    static constexpr std::uint32_t kPageMask = kPageSize - 1;
+
+    struct BalancePage {
+        std::array<Money, kPageSize> balances{};
+    };
+    struct DigestPage {
+        std::array<PasswordDigest, kPageSize> digests;
+    };
+    struct NamePage {
+        std::string arena;                         // usernames in slot order, no separators
+        std::array<std::uint32_t, kPageSize> ends; // per slot: end of its username in arena
+        std::string_view get(std::uint32_t i) const {
+            std::uint32_t begin = i == 0 ? 0 : ends[i - 1];
+            return std::string_view(arena.data() + begin, ends[i] - begin);
+        }
+    };
 
-class Account {
 public:
-    Account() = default;
-    Account(std::string uname, std::string pass_hash, double bal = 0.0)
-        : username_(std::move(uname)), password_hash_(std::move(pass_hash)), balance_(bal) {}
+    static constexpr std::uint32_t npos = UINT32_MAX;
 
-    const std::string& username() const { return username_; }
-    const std::string& password_hash() const { return password_hash_; }
-    double balance() const { return balance_; }
+    // Read-only copy of the table as of AccountTable::freeze().
+    class Frozen {
+    public:
+        std::uint32_t size() const { return size_; }
+        std::string_view username(std::uint32_t slot) const { return names_[slot >> kPageBits]->get(slot & kPageMask); }
+        const PasswordDigest& digest(std::uint32_t slot) const { return digests_[slot >> kPageBits]->digests[slot & kPageMask]; }
+        Money balance(std::uint32_t slot) const { return balances_[slot >> kPageBits]->balances[slot & kPageMask]; }
 
-    void set_password_hash(const std::string& h) { password_hash_ = h; }
-    void set_balance(double b) { balance_ = b; }
+    private:
+        friend class AccountTable;
+        std::uint32_t size_ = 0;
+        std::vector<std::shared_ptr<const NamePage>> names_;
+        std::vector<std::shared_ptr<const DigestPage>> digests_;
+        std::vector<std::shared_ptr<const BalancePage>> balances_;
+    };
 
-    void add_transaction(const Transaction& tx) { history_.push_back(tx); }
-    const std::vector<Transaction>& history() const { return history_; }
+    std::uint32_t find(std::string_view username) const;
+    // The caller guarantees username is not present yet.
+    std::uint32_t insert(std::string_view username, const PasswordDigest& digest, Money balance);
+    void reserve(std::size_t n);
+    void clear();
+
+    std::uint32_t size() const { return size_; }
+    std::string_view username(std::uint32_t slot) const { return names_[slot >> kPageBits]->get(slot & kPageMask); }
+    const PasswordDigest& digest(std::uint32_t slot) const { return digests_[slot >> kPageBits]->digests[slot & kPageMask]; }
+    Money balance(std::uint32_t slot) const { return balances_[slot >> kPageBits]->balances[slot & kPageMask]; }
+    void set_digest(std::uint32_t slot, const PasswordDigest& d) { writable(digests_[slot >> kPageBits])->digests[slot & kPageMask] = d; }
+    void set_balance(std::uint32_t slot, Money b) { writable(balances_[slot >> kPageBits])->balances[slot & kPageMask] = b; }
+
+    // Callers keep writers out while freezing (a shared lock is enough); the view stays valid
+    // and unchanged however the table changes afterwards.
+    Frozen freeze() const;
+
+    // Heap bytes held by the table (capacity, not just size).
+    std::size_t memory_bytes() const;
 
 private:
-    std::string username_;
-    std::string password_hash_;
-    double balance_{0.0};
-    std::vector<Transaction> history_;
+    static std::uint64_t hash(std::string_view s);
+    void grow();
+    // The page, copied first if a Frozen view still shares it.
+    template <typename Page>
+    static Page* writable(std::shared_ptr<Page>& page);
+
+    std::uint32_t size_ = 0;
+    std::vector<std::shared_ptr<NamePage>> names_;
+    std::vector<std::shared_ptr<DigestPage>> digests_;
+    std::vector<std::shared_ptr<BalancePage>> balances_;
+    std::vector<std::uint32_t> buckets_; // slot or npos; power-of-two size, load factor <= 0.7
 };
+
+template <typename Page>
+Page* AccountTable::writable(std::shared_ptr<Page>& page) {
+    // Views only take pages under a lock that keeps this writer out, so a count of 1 cannot go
+    // up behind our back; the fence orders our writes after a released view's last reads.
+    if (page.use_count() > 1) page = std::make_shared<Page>(*page);
+    else std::atomic_thread_fence(std::memory_order_acquire);
+    return page.get();
+}
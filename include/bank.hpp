@@ -1,46 +1,375 @@
 #pragma once
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include <optional>
 #include <fstream>
 #include <sstream>
 #include <filesystem>
 #include <iostream>
+#include <thread>
+#include <tuple>
+#include <array>
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <string_view>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <cstdint>
 
 #include "account.hpp"
+#include "money.hpp"
 #include "transaction.hpp"
+#include "timestamp.hpp"
 #include "sha256.hpp"
+#include "journal.hpp"
+#include "persist_queue.hpp"
+#include "txlog.hpp"
+#include "snapshot.hpp"
+#include "history.hpp"
+#include "metrics.hpp"
+#include "rank_tree.hpp"
+#include "trace.hpp"
 
+enum class StorageMode {
+    Snapshot, // rewrite accounts.db after every mutation
+    Journal   // append to accounts.journal, fold into accounts.db at checkpoints
+};
+
+enum class SnapshotFormat {
+    Text,  // data/accounts.db, pipe-delimited
+    Binary // data/accounts.snap, memory-mapped with lazily materialized accounts
+};
+
+struct BankOptions {
+    std::filesystem::path data_dir = "data";
+    StorageMode storage = StorageMode::Journal;
+    SnapshotFormat snapshot_format = SnapshotFormat::Text;
+    std::size_t checkpoint_every = 10000; // journal records between background checkpoints
+    TxLogOptions txlog;                   // group commit for data/transactions/<user>.log
+    bool async_persistence = false;       // journal writes / snapshot rewrites on an I/O thread
+    std::size_t persist_queue_capacity = 8192; // queued items before mutations block
+    bool sync_journal = false;            // fsync the journal on every flush (mutation, async batch, commit())
+    unsigned load_threads = 0;            // threads for parsing a text snapshot and scanning logs (0 = per core)
+};
+
+// What a successful login hands back: a stable account id plus the username.
+// Balance and history are fetched through it on demand, so logging in costs the same
+// no matter how large the account's history is.
+struct Session {
+    AccountId id;
+    std::string username;
+};
+
+// Consistent point-in-time view of every account's balance, taken by Bank::snapshot().
+// Taking one holds every shard lock in shared mode just long enough to copy the table page
+// pointers (and, with a lazily loaded binary snapshot, one flag byte per unmaterialized
+// account); after that, writers change balances freely and the view keeps seeing the old ones
+// through copy-on-write pages. A transfer is either wholly in the view or not at all.
+//
+// The accounts are split into parts() disjoint parts that can be walked concurrently.
+class BalanceSnapshot {
+public:
+    std::uint64_t epoch() const { return epoch_; }                // 1, 2, ... per bank, in order taken
+    // Every log record of a mutation in the view is stamped before this, every later one after.
+    timestamp::Micros taken_at() const { return taken_at_; }
+    std::size_t size() const { return size_; }
+    std::size_t parts() const { return kShardParts + base_parts_; }
+
+    // fn(username, balance) for every account in one part.
+    template <typename F>
+    void for_each_in(std::size_t part, F&& fn) const {
+        if (part < kShardParts) {
+            const AccountTable::Frozen& t = shards_[part];
+            for (std::uint32_t i = 0; i < t.size(); ++i) fn(t.username(i), t.balance(i));
+            return;
+        }
+        std::size_t n = base_live_.size(), p = part - kShardParts;
+        for (std::size_t i = n * p / base_parts_, end = n * (p + 1) / base_parts_; i < end; ++i) {
+            if (!base_live_[i]) fn(base_->username(i), base_->balance(i));
+        }
+    }
+    // fn(username, password_hash, balance) for every account in one part, the hash as the 64 hex
+    // digits a snapshot file stores.
+    template <typename F>
+    void for_each_row_in(std::size_t part, F&& fn) const {
+        if (part < kShardParts) {
+            const AccountTable::Frozen& t = shards_[part];
+            char hex[64];
+            for (std::uint32_t i = 0; i < t.size(); ++i) {
+                digest_to_hex(t.digest(i), hex);
+                fn(t.username(i), std::string_view(hex, sizeof(hex)), t.balance(i));
+            }
+            return;
+        }
+        std::size_t n = base_live_.size(), p = part - kShardParts;
+        for (std::size_t i = n * p / base_parts_, end = n * (p + 1) / base_parts_; i < end; ++i) {
+            if (!base_live_[i]) fn(base_->username(i), base_->password_hash(i), base_->balance(i));
+        }
+    }
+    // Every account, sorted by username.
+    std::vector<std::pair<std::string,Money>> accounts() const;
+
+private:
+    friend class Bank;
+    static constexpr std::size_t kShardParts = 64;
+    std::uint64_t epoch_ = 0;
+    timestamp::Micros taken_at_ = 0;
+    std::size_t size_ = 0;
+    std::array<AccountTable::Frozen, kShardParts> shards_;
+    std::shared_ptr<const snapshot::View> base_;
+    std::vector<unsigned char> base_live_; // Bank::materialized_ at the time: 1 = in shards_ instead
+    std::size_t base_parts_ = 0;
+};
+
+// One leg of Bank::apply_batch: move amount from one account to another.
+struct Posting {
+    std::string from;
+    std::string to;
+    Money amount;
+};
+
+// One account for Bank::import_accounts, already validated and hashed by the caller.
+struct NewAccount {
+    std::string_view username; // must stay valid for the call
+    PasswordDigest digest;
+    Money balance;
+    std::string err;                  // set if the account was not added
+    std::size_t duplicate_of = SIZE_MAX; // with err: index of the earlier entry with this username
+};
+
+// Outcome of one leg. Legs run in order, so a leg may spend money an earlier leg brought in.
+struct PostingResult {
+    std::string err;    // empty: the leg is valid (and applied, if the batch was)
+    Money from_balance; // both balances right after this leg
+    Money to_balance;
+};
+
+// Thread-safe: accounts are spread over shards, each guarded by its own shared_mutex.
+// Lock order is always ascending shard index, with the journal's lock innermost.
 class Bank {
 public:
-    Bank();
+    Bank() : Bank(BankOptions{}) {}
+    explicit Bank(BankOptions opts);
+    ~Bank();
+    Bank(const Bank&) = delete;
+    Bank& operator=(const Bank&) = delete;
+
+    bool create_account(const std::string& username, const std::string& password, Money initial_balance, std::string& err);
+    std::optional<Session> authenticate(const std::string& username, const std::string& password);
 
-    bool create_account(const std::string& username, const std::string& password, double initial_balance, std::string& err);
-    std::optional<Account> authenticate(const std::string& username, const std::string& password);
+    // balance_after, if given, receives the (source) account's balance as this call left it;
+    // a later balance_of() may already see other mutations.
+    bool deposit(const std::string& username, Money amount, std::string& err, Money* balance_after = nullptr);
+    bool withdraw(const std::string& username, Money amount, std::string& err, Money* balance_after = nullptr);
+    bool transfer(const std::string& from_user, const std::string& to_user, Money amount, std::string& err,
+                  Money* balance_after = nullptr);
 
-    bool deposit(const std::string& username, double amount, std::string& err);
-    bool withdraw(const std::string& username, double amount, std::string& err);
-    bool transfer(const std::string& from_user, const std::string& to_user, double amount, std::string& err);
+    // Applies every posting or none: all legs are checked against the running balances first,
+    // with every shard involved locked, and a single failing leg rejects the batch. An applied
+    // batch is one unit on disk: its journal records form one group (one write, replayed
+    // whole or not at all), or one snapshot rewrite in Snapshot mode; all its log records share
+    // a timestamp and are queued together. results gets one entry per posting, the failing ones
+    // with their own err; err repeats the first failing leg's reason, and which leg that was is
+    // read from results.
+    bool apply_batch(const std::vector<Posting>& postings, std::vector<PostingResult>& results, std::string& err);
 
-    std::optional<double> balance_of(const std::string& username) const;
+    // Bulk onboarding (bulk::import_csv). Adds every entry whose username is free in one step,
+    // with every shard locked and the work spread over BankOptions::load_threads threads: a
+    // positive balance is logged as an opening deposit, and the accounts are made durable by a
+    // single snapshot rewrite instead of a journal record each. An entry whose username exists,
+    // or repeats an earlier entry, gets its err set and is skipped. Returns the number added.
+    std::size_t import_accounts(std::vector<NewAccount>& accounts);
+
+    // Ledger repairs (ledger::verify); meant for a bank no one else is mutating.
+    // set_balance_from_log trusts the log: the balance becomes logged_balance (journaled, not logged).
+    // log_adjustment trusts the account: appends an ADJUST record taking the log from
+    // logged_balance to the current balance.
+    bool set_balance_from_log(const std::string& username, Money logged_balance, std::string& err);
+    bool log_adjustment(const std::string& username, Money logged_balance, std::string& err);
+
+    std::optional<Money> balance_of(const std::string& username) const;
+    std::optional<Money> balance_of(const Session& session) const; // direct slot access, no hashing
     bool has_user(const std::string& username) const;
     bool is_admin(const std::string& username) const { return username == "admin"; }
 
-    std::vector<std::pair<std::string,double>> all_accounts() const; // for admin view
+    std::vector<std::pair<std::string,Money>> all_accounts() const; // full copy, sorted by username
+    // Pins a consistent view of all balances for reports (see reports.hpp) without holding up
+    // writers while it is read.
+    BalanceSnapshot snapshot() const;
+
+    // Admin queries served from ordered indexes (by username, by balance) kept per shard and
+    // updated with every mutation; each costs O(log n + k) per shard instead of copying and
+    // sorting the whole table. The indexes are built by the first query, which also
+    // materializes any accounts still only in the mapped snapshot.
+    std::size_t account_count();
+    // Up to limit accounts with username > after, in username order ("" starts at the top).
+    std::vector<std::pair<std::string,Money>> list_accounts(const std::string& after, std::size_t limit);
+    // Same, restricted to usernames starting with prefix.
+    std::vector<std::pair<std::string,Money>> find_by_prefix(const std::string& prefix, std::size_t limit,
+                                                             const std::string& after = "");
+    // The k largest (richest) or smallest balances, in that order.
+    std::vector<std::pair<std::string,Money>> top_balances(std::size_t k, bool richest = true);
+    // Accounts with lo <= balance <= hi.
+    std::size_t count_balance_range(Money lo, Money hi);
+
+    // Transaction history, served from the per-account index (<user>.idx, or the segment indexes
+    // and archive summaries) without rescanning the log.
+    std::size_t history_size(const std::string& username);
+    std::vector<Transaction> history(const std::string& username, std::size_t offset, std::size_t limit);
+    // Records with from_ts <= timestamp <= to_ts (ISO 8601 local time, as stored), oldest first;
+    // empty if either bound does not parse.
+    std::vector<Transaction> history_range(const std::string& username, const std::string& from_ts,
+                                           const std::string& to_ts, std::size_t limit = SIZE_MAX);
+    // The last n records, oldest first.
+    std::vector<Transaction> recent_history(const std::string& username, std::size_t n);
+    // Calls fn(username, stream) for every account with a transaction log, on up to `threads`
+    // threads, after flushing queued records; see TxLogWriter::for_each_account.
+    std::size_t for_each_history(unsigned threads,
+                                 const std::function<void(const std::string&, const history::AccountStream&)>& fn);
+    // Parses every account's transaction log on BankOptions::load_threads threads, after flushing
+    // queued records. Returns the number of logs.
+    std::size_t scan_history(const history::LogVisitor& visit);
+    TxLogWriter& transaction_log() { return tx_log_; }
+    const std::filesystem::path& transactions_dir() const { return tx_dir_; }
 
     void load();
-    void save() const;
+    void save();
+    // Folds the journal into a fresh accounts.db snapshot on a background thread.
+    void checkpoint();
+
+    // Deferred mode for bulk work: journal records stay buffered and Snapshot-mode rewrites are
+    // skipped until commit(), which makes everything applied so far durable in one step.
+    // commit() throws std::runtime_error if the snapshot, the journal or a transaction log cannot
+    // be written.
+    void set_deferred(bool on);
+    bool deferred() const { return deferred_.load(std::memory_order_relaxed); }
+    void commit();
+
+    // Transaction log records are group-committed; these expose the durability point.
+    TxLogWriter::Ticket last_log_ticket() const { return tx_log_.last_ticket(); }
+    void wait_durable(TxLogWriter::Ticket t) { tx_log_.wait_durable(t); }
+    void flush_logs() { tx_log_.flush(); }
+
+    // With BankOptions::async_persistence a mutation returns once it is applied in memory; its
+    // journal record (in Snapshot mode, the next snapshot rewrite) is written by an I/O thread.
+    // These confirm durability: last_persist_ticket() right after a mutation covers it, and the
+    // callback runs on the I/O thread. Without async persistence every ticket is already durable.
+    // Durable means flushed to the OS, which survives a crash of the process; with
+    // BankOptions::sync_journal it also means fsynced, which survives a power loss.
+    // wait_persisted() is false if a journal write failed (see PersistQueue).
+    PersistQueue::Ticket last_persist_ticket() const { return persist_ ? persist_->last_ticket() : 0; }
+    bool wait_persisted(PersistQueue::Ticket t) { return persist_ ? persist_->wait(t) : journal_.flush(); }
+    void on_persisted(PersistQueue::Ticket t, std::function<void()> done);
+    std::future<void> persisted(PersistQueue::Ticket t);
+
+    // Workload recording (trace.hpp): from start_recording() on, every create_account,
+    // authenticate, deposit, withdraw, transfer, apply_batch, balance_of, history query,
+    // set_deferred and commit is appended to the trace at path. stop_recording() (or the
+    // destructor) ends it with state_checksum(). Start while no other thread uses the bank, e.g.
+    // right after load(); the trace begins with a copy of every account.
+    void start_recording(const std::filesystem::path& path);
+    void stop_recording();
+    bool recording() const { return recorder_ != nullptr; }
+    // Number of accounts and the trace::state_add sum over all their balances.
+    std::pair<std::size_t, std::uint64_t> state_checksum() const;
+
+    // Latency histograms and failure counters for every operation and I/O stage.
+    const metrics::Registry& metrics() const { return metrics_; }
+
+    // Ids and names map both ways: history records carry the counterparty as an AccountId.
+    std::optional<AccountId> id_of(const std::string& username);
+    std::optional<std::string> username_of(AccountId id) const;
+
+    // Heap bytes held by the in-memory account tables.
+    std::size_t memory_bytes() const;
+
+    // Usernames end up in file names (transactions/<user>.log) and in '|'-delimited snapshot,
+    // journal and segment lines: 3 to 250 characters, no whitespace, control characters or
+    // | / \ , ". Every way of creating an account goes through this.
+    static constexpr std::size_t kMaxUsername = 250;
+    static bool valid_username(std::string_view username, std::string& err);
 
     static std::string hash_password(const std::string& password) {
         return picosha2::hash256_hex_string(password);
     }
+    static PasswordDigest digest_password(const std::string& password) {
+        PasswordDigest d;
+        picosha2::hash256(password.data(), password.size(), d.data());
+        return d;
+    }
 
 private:
-    void log_transaction(const std::string& username, const Transaction& tx) const;
-    void load_transactions_for(const std::string& username, Account& acc);
+    struct AccountView {
+        PasswordDigest digest;
+        Money balance;
+    };
+
+    static constexpr std::size_t kShardCount = 64;
+    struct Shard {
+        mutable std::shared_mutex mu;
+        AccountTable accounts;
+        RankTree by_name;    // slots ordered by username; maintained once indexed_ is set
+        RankTree by_balance; // slots ordered by (balance, slot)
+    };
+    // An AccountId packs the shard index into its low bits and the slot above them.
+    static AccountId make_id(std::size_t shard, std::uint32_t slot) {
+        return static_cast<AccountId>(slot * kShardCount + shard);
+    }
+    std::size_t shard_index(std::string_view username) const {
+        return std::hash<std::string_view>{}(username) % kShardCount;
+    }
+    Shard& shard_for(std::string_view username) { return shards_[shard_index(username)]; }
+    const Shard& shard_for(std::string_view username) const { return shards_[shard_index(username)]; }
+    std::vector<std::shared_lock<std::shared_mutex>> lock_all_shared() const;
+    std::unique_lock<std::shared_mutex> lock_exclusive(Shard& shard); // timed as Stage::LockWait
+
+    // Accounts come from the shard table or, until first written, straight from the mapped
+    // binary snapshot (base_). Callers hold the account's shard lock.
+    std::optional<AccountView> view_locked(const Shard& shard, std::string_view username) const;
+    // Slot of the account in shard.accounts, copying it in from base_ if needed; npos if unknown.
+    std::uint32_t materialize_locked(Shard& shard, std::string_view username); // exclusive lock
+    // Insert-or-overwrite used while loading; caller holds the shard lock exclusively.
+    void upsert_locked(Shard& shard, std::string_view username, std::string_view hash_hex, Money balance);
+    // Parallel text snapshot load into empty tables; caller holds every shard lock exclusively.
+    void load_text_locked(const std::filesystem::path& path);
+
+    // Index upkeep; callers hold the shard lock exclusively.
+    void index_insert_locked(Shard& shard, std::uint32_t slot);
+    void set_balance_locked(Shard& shard, std::uint32_t slot, Money balance);
+    void ensure_indexes();
+
+    void persist(const Shard& shard, std::uint32_t slot); // journal record; caller holds the shard lock
+    void after_mutation();                 // snapshot rewrite or checkpoint check; no locks held
+    void maybe_checkpoint();
+    void flush_tx_log(); // throws if the transaction log lost a batch
+    void wait_checkpoint();
+    void start_persist_queue();
+    void stop_persist_queue(); // writes out everything still queued
+    std::vector<snapshot::Row> snapshot_rows() const; // caller holds every shard lock
+    void write_snapshot(std::vector<snapshot::Row> rows) const;
+
+    void log_transaction(const std::string& username, const Transaction& tx, std::string_view counterparty = {});
+    AccountId resolve_id(std::string_view username); // for history reads; kNoAccount if unknown
+
+    BankOptions opts_;
+    mutable metrics::Registry metrics_;
+    std::array<Shard, kShardCount> shards_;
+    std::filesystem::path db_path_;
+    std::filesystem::path snap_path_;
+    std::filesystem::path tx_dir_;
+
+    std::shared_ptr<const snapshot::View> base_;
+    std::vector<unsigned char> materialized_; // per base_ record; written under that record's shard lock
 
-    std::unordered_map<std::string, Account> accounts_;
-    std::filesystem::path db_path_ = "data/accounts.db";
-    std::filesystem::path tx_dir_ = "data/transactions";
+    Journal journal_;
+    std::unique_ptr<PersistQueue> persist_; // set while async persistence runs
+    std::mutex checkpoint_mu_; // serializes save/checkpoint and owns checkpoint_thread_
+    std::thread checkpoint_thread_;
+    TxLogWriter tx_log_;
+    std::atomic<bool> deferred_{false};
+    mutable std::atomic<std::uint64_t> snapshot_epoch_{0};
+    std::atomic<bool> indexed_{false}; // set and cleared only with every shard locked exclusively
+    std::unique_ptr<trace::Recorder> recorder_; // set while recording
 };
@@ -0,0 +1,36 @@
+#pragma once
+#include <iosfwd>
+#include <cstddef>
+
+class Bank;
+
+// Non-interactive driver for settlement files. One command per line, fields separated by
+// spaces or tabs; blank lines and lines starting with '#' are skipped:
+//   CREATE   <username> <password> [initial_balance]
+//   DEPOSIT  <username> <amount>
+//   WITHDRAW <username> <amount>
+//   TRANSFER <from> <to> <amount>
+// TRANSFER lines between a BEGIN line and an END line form one all-or-nothing batch
+// (Bank::apply_batch); any other command in between rejects the batch.
+// Commands go straight to the Bank API with persistence deferred; the bank commits once per
+// commit_every commands (0 = once at the end of the stream).
+namespace batch {
+
+struct Options {
+    std::size_t commit_every = 0;
+    bool stop_on_error = false;
+};
+
+struct Stats {
+    std::size_t lines = 0;
+    std::size_t commands = 0;
+    std::size_t failed = 0;
+    std::size_t commits = 0;
+    double seconds = 0;
+};
+
+// Failures are reported to errors as "line N: <reason>" and do not stop the run
+// unless opts.stop_on_error is set.
+Stats run(Bank& bank, std::istream& in, const Options& opts, std::ostream& errors);
+
+} // namespace batch
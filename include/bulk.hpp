@@ -0,0 +1,46 @@
+#pragma once
+#include <filesystem>
+#include <iosfwd>
+#include <cstddef>
+
+class Bank;
+
+// Bulk account import and export as CSV, one account per line:
+//   username,password[,initial_balance]   plaintext passwords, hashed during the import
+//   username,password_sha256,balance      64 lowercase hex digits, the form export_csv writes
+// A first line starting with "username," is a header; a second column named password_sha256
+// selects the hashed form, anything else (or no header) the plaintext one. Fields may be
+// double-quoted ("a,b", with "" for a quote); blank lines are skipped.
+//
+// The import maps the file, parses and hashes it on every core in pieces, and hands the rows
+// to Bank::import_accounts, which adds them in one step and writes one snapshot. Rejected lines
+// are reported as "line N: <reason>" and do not stop the import.
+namespace bulk {
+
+struct ImportOptions {
+    unsigned threads = 0; // 0 = one per core
+};
+
+struct ImportStats {
+    std::size_t lines = 0;
+    std::size_t rows = 0;     // non-blank lines after the header
+    std::size_t imported = 0;
+    std::size_t rejected = 0;
+    double parse_seconds = 0; // parsing, validation and password hashing
+    double apply_seconds = 0; // Bank::import_accounts, snapshot included
+    double seconds = 0;
+};
+
+// Throws std::runtime_error if the file cannot be read.
+ImportStats import_csv(Bank& bank, const std::filesystem::path& path, const ImportOptions& opts, std::ostream& errors);
+
+struct ExportStats {
+    std::size_t rows = 0;
+    double seconds = 0;
+};
+
+// Streams every account as username,password_sha256,balance from a Bank::snapshot(), so writers
+// are not held up and the file is one consistent cut. Rows come in storage order, not sorted.
+ExportStats export_csv(Bank& bank, std::ostream& out, unsigned threads = 0);
+
+} // namespace bulk
@@ -0,0 +1,35 @@
+#pragma once
+#include <string_view>
+#include <cstddef>
+
+// Tokenizing for the line-oriented command formats (batch files, the server protocol).
+namespace fields {
+
+// Splits line into at most N whitespace-separated fields; returns how many were found,
+// or N + 1 if there are more.
+template <std::size_t N>
+std::size_t split(std::string_view line, std::string_view (&out)[N]) {
+    std::size_t n = 0, i = 0;
+    while (true) {
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) ++i;
+        if (i == line.size()) return n;
+        std::size_t j = i;
+        while (j < line.size() && line[j] != ' ' && line[j] != '\t') ++j;
+        if (n == N) return N + 1;
+        out[n++] = line.substr(i, j - i);
+        i = j;
+    }
+}
+
+// Case-insensitive match against an upper-case keyword.
+inline bool iequals(std::string_view a, std::string_view upper) {
+    if (a.size() != upper.size()) return false;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        char c = a[i];
+        if (c >= 'a' && c <= 'z') c = static_cast<char>(c - 'a' + 'A');
+        if (c != upper[i]) return false;
+    }
+    return true;
+}
+
+} // namespace fields
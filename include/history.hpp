@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "transaction.hpp"
+
+// Per-account history index: data/transactions/<user>.idx sits next to <user>.log and holds one
+// fixed-width entry per log line (byte offset + timestamp key), so a page of history is one seek
+// instead of a rescan of the whole log.
+namespace history {
+
+struct IndexEntry {
+    std::uint64_t offset; // byte offset of the line in <user>.log
+    std::int64_t ts_key;  // timestamp in epoch microseconds (timestamp::Micros)
+};
+
+// Index key of a logged timestamp: its epoch microseconds, or 0 if it does not parse.
+// Keys are absolute time, so they keep increasing when local time repeats an hour (DST end).
+std::int64_t timestamp_key(std::string_view iso);
+
+// Before epoch keys, entries held local time as YYYYMMDDhhmmss; every such key is below this
+// (and every epoch key of a transaction is above it).
+constexpr std::int64_t kLegacyKeyLimit = 100000000000000;
+
+// Brings idx up to date with log: drops entries past the end of the log (torn write)
+// and indexes any lines appended without an entry (older logs, crash between the two writes).
+// An index with legacy keys is rebuilt from the log.
+void sync_index(const std::filesystem::path& log, const std::filesystem::path& idx);
+
+std::size_t count(const std::filesystem::path& idx);
+
+// Index of the first entry with ts_key >= key (or > key when upper is set).
+std::size_t lower_bound(const std::filesystem::path& idx, std::int64_t key, bool upper = false);
+
+// Reads up to limit records starting at entry first; resolve maps a transfer counterparty's
+// username (as logged) to its account id.
+std::vector<Transaction> read(const std::filesystem::path& log, const std::filesystem::path& idx,
+                              std::size_t first, std::size_t limit,
+                              const std::function<AccountId(std::string_view)>& resolve);
+
+// One record of a log as written: the counterparty is still the username from the log line.
+struct LogRecord {
+    Transaction tx;
+    std::string counterparty; // empty unless a transfer
+};
+// Called once per log with its records in file order; records may be consumed (moved from).
+using LogVisitor = std::function<void(const std::string& username, std::vector<LogRecord>& records)>;
+
+// visit(tx, counterparty) for one record as logged: counterparty is the username from the log
+// line, empty unless a transfer; tx.counterparty is unset.
+using RecordVisitor = std::function<void(const Transaction&, std::string_view)>;
+// Walks one account's records in order; returns the number of lines that did not parse.
+using AccountStream = std::function<std::size_t(const RecordVisitor&)>;
+
+// Streams one log line by line, calling visit for each complete, well-formed record.
+// A torn last line is ignored. Returns the number of complete lines that did not parse.
+std::size_t stream_log(const std::filesystem::path& log, const RecordVisitor& visit);
+
+// Every complete, well-formed record of one log.
+std::vector<LogRecord> read_log(const std::filesystem::path& log);
+
+// Calls fn(username, path) for every <user>.log in dir on up to `threads` threads (0 = one per
+// core), largest log first, concurrently for different users. Returns the number of logs.
+std::size_t for_each_log(const std::filesystem::path& dir, unsigned threads,
+                         const std::function<void(const std::string&, const std::filesystem::path&)>& fn);
+
+// for_each_log plus read_log: visit(username, records) runs on the thread that parsed the log, so
+// it must synchronize any state it shares.
+std::size_t scan_logs(const std::filesystem::path& dir, unsigned threads, const LogVisitor& visit);
+
+} // namespace history
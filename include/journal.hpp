@@ -0,0 +1,126 @@
+#pragma once
+#include <string>
+#include <fstream>
+#include <string_view>
+#include <filesystem>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+#include "money.hpp"
+
+// Append-only write-ahead journal for account state.
+// Each record is one line holding the full state of an account after a mutation:
+//   A|username|passwordHash|balance
+// Records are absolute (not deltas), so replaying a record twice is harmless.
+// Records that must land together (Bank::apply_batch) are written as a group: a "B|<count>"
+// line followed by the records; replay applies a group only if all of it reached the file.
+// All members are safe to call from multiple threads.
+class Journal {
+public:
+    struct Record {
+        std::string username;
+        std::string password_hash;
+        Money balance;
+    };
+
+    explicit Journal(std::filesystem::path path)
+        : path_(std::move(path)), rotated_path_(path_.string() + ".old") {}
+
+    void open();
+    void close();
+
+    void append(std::string_view username, std::string_view password_hash, Money balance);
+    // One write for the whole group.
+    void append_group(const std::vector<Record>& records);
+    std::size_t records() const { return records_.load(std::memory_order_relaxed); }
+
+    // With autoflush off, appends stay in the stream buffer until flush() (bulk loads).
+    void set_autoflush(bool on);
+    // With sync on, every flush (including autoflush) also fsyncs the file, so flushed records
+    // survive a power loss and not just a crash of the process.
+    void set_sync(bool on);
+    // False if this or any earlier write, flush or fsync since open() or reset() failed.
+    bool flush();
+
+    // Moves the live journal aside so a checkpoint can fold it into a snapshot
+    // while new records keep going to a fresh file.
+    void rotate();
+    // Called once the checkpoint covering the rotated journal is durable.
+    void discard_rotated();
+    // Drops the live journal too (used after a full snapshot was written).
+    void reset();
+
+    const std::filesystem::path& path() const { return path_; }
+    const std::filesystem::path& rotated_path() const { return rotated_path_; }
+
+    // Calls apply(username, hash, balance) for each complete record in file order.
+    // A torn last line (crash mid-append) has no trailing newline and is ignored, and so is a
+    // group cut short by one. If complete_bytes is given, it receives the length of the file up
+    // to the end of the last complete record or group; anything after that is a torn tail.
+    template <typename F>
+    static std::size_t replay(const std::filesystem::path& file, F&& apply, std::uintmax_t* complete_bytes = nullptr) {
+        if (complete_bytes) *complete_bytes = 0;
+        std::ifstream in(file, std::ios::binary);
+        if (!in) return 0;
+        std::size_t n = 0;
+        std::string line;
+        std::vector<Record> group;
+        std::size_t group_left = 0;
+        std::uintmax_t pos = 0;
+        while (std::getline(in, line)) {
+            if (in.eof()) break; // torn tail
+            pos += line.size() + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.size() > 2 && line[0] == 'B' && line[1] == '|') {
+                group.clear();
+                group_left = std::strtoull(line.c_str() + 2, nullptr, 10);
+                if (group_left == 0 && complete_bytes) *complete_bytes = pos;
+                continue;
+            }
+            // Past here the line is either skipped or applied; it only ends a complete prefix
+            // outside a group or as a group's last record.
+            bool in_group = group_left > 0;
+            if (!in_group && complete_bytes) *complete_bytes = pos;
+            if (line.size() < 2 || line[0] != 'A' || line[1] != '|') continue;
+            std::string_view rest(line);
+            rest.remove_prefix(2);
+            std::size_t p1 = rest.find('|');
+            std::size_t p2 = p1 == std::string_view::npos ? p1 : rest.find('|', p1 + 1);
+            Money bal;
+            if (p2 == std::string_view::npos || !Money::parse_lenient(rest.substr(p2 + 1), bal)) continue;
+            Record rec{std::string(rest.substr(0, p1)), std::string(rest.substr(p1 + 1, p2 - p1 - 1)), bal};
+            if (group_left > 0) {
+                group.push_back(std::move(rec));
+                if (--group_left > 0) continue;
+                if (complete_bytes) *complete_bytes = pos;
+                for (auto& r : group) apply(std::move(r.username), std::move(r.password_hash), r.balance);
+                n += group.size();
+                group.clear();
+                continue;
+            }
+            apply(std::move(rec.username), std::move(rec.password_hash), rec.balance);
+            ++n;
+        }
+        return n;
+    }
+
+    // Cuts a torn tail off the file so appends never continue a partial line or group.
+    static void truncate_torn_tail(const std::filesystem::path& file);
+
+private:
+    void open_locked();
+    void close_locked();
+    void flush_locked();
+
+    std::filesystem::path path_;
+    std::filesystem::path rotated_path_;
+    std::mutex mu_;
+    std::ofstream out_;
+    std::atomic<std::size_t> records_{0};
+    bool autoflush_{true};
+    bool sync_{false};
+    bool failed_{false};
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <array>
+#include <filesystem>
+#include <iosfwd>
+#include <cstddef>
+
+#include "bank.hpp"
+
+// Ledger audit: checks the per-account transaction logs against themselves, against each other
+// and against the account balances (snapshot + journal). Run it on a bank nothing else mutates.
+//
+// Every <user>.log is streamed line by line on a thread pool:
+//   - chain: each balance_after must be the previous one plus or minus the amount;
+//   - balance: the last balance_after must be the account's balance (0 with no log at all);
+//   - transfers: each TRANSFER_OUT "To B" in A's log needs a TRANSFER_IN "From A" in B's log
+//     with the same amount and timestamp, and the other way round.
+// Transfer legs are spilled to hash-partitioned files and matched one partition per task, so
+// memory stays bounded by a partition, not by the size of the ledger.
+namespace ledger {
+
+// Which side a repair rewrites; the other side is trusted.
+enum class Repair {
+    None,
+    Logs,    // append an ADJUST record where a log's final balance is off (accounts are right)
+    Accounts // set the balance to the log's final balance, for logs whose chain is intact
+};
+
+enum class Issue {
+    ChainBreak,
+    BalanceMismatch,
+    MissingLog,
+    OrphanLog,
+    UnmatchedTransferOut,
+    UnmatchedTransferIn,
+    MalformedLine,
+    Count
+};
+const char* name(Issue issue);
+
+struct Finding {
+    Issue issue;
+    std::string username;
+    std::string detail;
+};
+
+struct Options {
+    unsigned threads = 0;           // 0 = one per core
+    std::size_t partitions = 64;    // spill files for transfer legs
+    std::size_t max_findings = 100; // listed in the report; all of them are counted
+    Repair repair = Repair::None;
+    std::filesystem::path work_dir; // spill files; default: verify.tmp next to the transactions dir
+};
+
+struct Report {
+    std::size_t logs = 0;
+    std::size_t records = 0;
+    std::size_t accounts = 0;
+    std::size_t transfers_matched = 0;
+    std::array<std::size_t, static_cast<std::size_t>(Issue::Count)> counts{};
+    std::vector<Finding> findings; // the first Options::max_findings
+    std::size_t repaired = 0;
+    double seconds = 0;
+
+    std::size_t issues() const;
+};
+
+// Throws std::runtime_error if the spill files cannot be written.
+Report verify(Bank& bank, const Options& opts);
+void write_report(std::ostream& os, const Report& report);
+
+} // namespace ledger
@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// Small LZ77 codec for the transaction log archive (LZ4-like block format, no dependencies).
+// A block is a series of sequences: a token byte (high nibble: literal count, low nibble: match
+// length - 4; 15 means more length bytes follow, each adding up to 255), the literals, then a
+// 2-byte little-endian match offset. The last sequence has literals only. Matches reach back
+// at most 64 KiB, so a block is self-contained.
+namespace lz {
+
+// Appends the compressed form of in to out.
+void compress(std::string_view in, std::string& out);
+
+// Decodes a block produced by compress into out (replacing it); raw_size is the original size.
+// Returns false on malformed input.
+bool decompress(std::string_view in, std::size_t raw_size, std::string& out);
+
+} // namespace lz
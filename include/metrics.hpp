@@ -0,0 +1,171 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <filesystem>
+#include <iosfwd>
+#include <cstdint>
+#include <cstddef>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Always-on instrumentation for Bank: per-operation and per-I/O-stage latency histograms,
+// failure-reason counters, and a Prometheus text dump. Recording, failures included, is a
+// couple of relaxed atomic increments; nothing here takes a lock or allocates.
+namespace metrics {
+
+enum class Op { CreateAccount, Authenticate, Deposit, Withdraw, Transfer, ApplyBatch, AllAccounts, AccountQuery, History, Import, Load, Save, Checkpoint, Compact, Count };
+enum class Stage { Hash, LockWait, Lookup, JournalWrite, TxLogAppend, SnapshotWrite, Count };
+// Failure reasons are a fixed label set: the messages Bank's operations return, with Other
+// for anything else (I/O errors that name a path, for instance), so the series stay bounded.
+enum class Reason {
+    Unspecified, InvalidCredentials, UsernameTaken, UsernameInvalid, PasswordTooShort, NegativeInitialBalance,
+    AmountNotPositive, AmountTooLarge, AccountNotFound, SourceNotFound, DestinationNotFound, SameAccount,
+    InsufficientFunds, Other, Count
+};
+
+const char* name(Op op);
+const char* name(Stage stage);
+const char* name(Reason reason);
+Reason classify(std::string_view message);
+
+// Log-linear latency histogram over nanoseconds, HDR-style: 8 sub-buckets per power of two,
+// so any recorded value is known to within 12.5%.
+class Histogram {
+public:
+    static constexpr unsigned kSubBits = 3;
+    static constexpr unsigned kSub = 1u << kSubBits;
+    static constexpr std::size_t kBuckets = (64 - kSubBits + 1) * kSub;
+
+    static std::size_t bucket_of(std::uint64_t ns) {
+        if (ns < kSub) return static_cast<std::size_t>(ns);
+        unsigned e = 63u - static_cast<unsigned>(count_leading_zeros(ns));
+        return (e - kSubBits + 1) * kSub + ((ns >> (e - kSubBits)) & (kSub - 1));
+    }
+    // Smallest value that lands in the bucket after i (exclusive upper bound of bucket i).
+    static std::uint64_t bucket_upper(std::size_t i) {
+        if (i < kSub) return i + 1;
+        unsigned e = static_cast<unsigned>(i / kSub) + kSubBits - 1;
+        if (e >= 63) return UINT64_MAX;
+        return (kSub + i % kSub + 1) << (e - kSubBits);
+    }
+
+    void record(std::uint64_t ns) {
+        buckets_[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    }
+    std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    std::uint64_t sum_ns() const { return sum_ns_.load(std::memory_order_relaxed); }
+    std::uint64_t bucket(std::size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the p-th percentile (0 < p <= 100); 0 when empty.
+    std::uint64_t percentile_ns(double p) const;
+
+private:
+    static int count_leading_zeros(std::uint64_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long idx;
+        _BitScanReverse64(&idx, v);
+        return 63 - static_cast<int>(idx);
+#else
+        return __builtin_clzll(v);
+#endif
+    }
+
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets_{};
+    std::atomic<std::uint64_t> count_{0};
+    std::atomic<std::uint64_t> sum_ns_{0};
+};
+
+// Records the lifetime of the scope into a histogram.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& h) : h_(h), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        h_.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count()));
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& h_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+class Registry {
+public:
+    Histogram& op(Op o) { return ops_[static_cast<std::size_t>(o)]; }
+    Histogram& stage(Stage s) { return stages_[static_cast<std::size_t>(s)]; }
+    const Histogram& op(Op o) const { return ops_[static_cast<std::size_t>(o)]; }
+    const Histogram& stage(Stage s) const { return stages_[static_cast<std::size_t>(s)]; }
+
+    void failure(Op o, std::string_view reason);
+    std::uint64_t failures(Op o) const { return failed_[static_cast<std::size_t>(o)].load(std::memory_order_relaxed); }
+    std::uint64_t failures(Op o, Reason r) const {
+        return reasons_[static_cast<std::size_t>(o)][static_cast<std::size_t>(r)].load(std::memory_order_relaxed);
+    }
+
+    // Prometheus text exposition format (version 0.0.4).
+    void write_prometheus(std::ostream& os) const;
+    // Human-readable table: calls, failures and latency percentiles per operation and stage.
+    void write_summary(std::ostream& os) const;
+
+private:
+    std::array<Histogram, static_cast<std::size_t>(Op::Count)> ops_;
+    std::array<Histogram, static_cast<std::size_t>(Stage::Count)> stages_;
+    std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(Op::Count)> failed_{};
+    std::array<std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(Reason::Count)>,
+               static_cast<std::size_t>(Op::Count)> reasons_{};
+};
+
+// Times an operation; unless succeed() is called before the scope ends, it counts as a
+// failure with whatever reason *err holds at that point.
+class OpScope {
+public:
+    OpScope(Registry& reg, Op op, const std::string* err = nullptr)
+        : reg_(reg), op_(op), err_(err), timer_(reg.op(op)) {}
+    ~OpScope() { if (!ok_) reg_.failure(op_, err_ ? std::string_view(*err_) : std::string_view()); }
+    OpScope(const OpScope&) = delete;
+    OpScope& operator=(const OpScope&) = delete;
+
+    bool succeed() { ok_ = true; return true; }
+
+private:
+    Registry& reg_;
+    Op op_;
+    const std::string* err_;
+    bool ok_{false};
+    ScopedTimer timer_;
+};
+
+// Rewrites a file with the registry's Prometheus dump every interval (temp file + rename, so
+// a scraper never sees a partial dump), and once more on destruction.
+class FileDumper {
+public:
+    FileDumper(const Registry& reg, std::filesystem::path path, std::chrono::milliseconds interval);
+    ~FileDumper();
+    FileDumper(const FileDumper&) = delete;
+    FileDumper& operator=(const FileDumper&) = delete;
+
+    bool dump() const;
+
+private:
+    void run();
+
+    const Registry& reg_;
+    std::filesystem::path path_;
+    std::chrono::milliseconds interval_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_{false};
+    std::thread thread_;
+};
+
+} // namespace metrics
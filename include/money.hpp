@@ -0,0 +1,117 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <cstdlib>
+#include <cmath>
+
+// Fixed-point amount in integer minor units (cents).
+// Formatting and parsing are hand-rolled and locale-independent: "-1234.05".
+class Money {
+public:
+    constexpr Money() = default;
+    static constexpr Money from_cents(std::int64_t c) { return Money(c); }
+
+    constexpr std::int64_t cents() const { return cents_; }
+
+    static constexpr std::int64_t max_cents() { return std::numeric_limits<std::int64_t>::max(); }
+    static constexpr std::int64_t min_cents() { return std::numeric_limits<std::int64_t>::min(); }
+
+    // Checked arithmetic: returns false (leaving out untouched) on overflow.
+    static bool add(Money a, Money b, Money& out) {
+        if ((b.cents_ > 0 && a.cents_ > max_cents() - b.cents_) ||
+            (b.cents_ < 0 && a.cents_ < min_cents() - b.cents_)) return false;
+        out = Money(a.cents_ + b.cents_);
+        return true;
+    }
+    static bool sub(Money a, Money b, Money& out) {
+        if ((b.cents_ < 0 && a.cents_ > max_cents() + b.cents_) ||
+            (b.cents_ > 0 && a.cents_ < min_cents() + b.cents_)) return false;
+        out = Money(a.cents_ - b.cents_);
+        return true;
+    }
+
+    // Writes the decimal form into buf (at least 24 bytes); returns the length.
+    std::size_t format(char* buf) const {
+        char tmp[24];
+        std::size_t n = 0;
+        bool neg = cents_ < 0;
+        // Work in unsigned so min_cents() does not overflow on negation.
+        std::uint64_t v = neg ? 0 - static_cast<std::uint64_t>(cents_) : static_cast<std::uint64_t>(cents_);
+        tmp[n++] = static_cast<char>('0' + v % 10); v /= 10;
+        tmp[n++] = static_cast<char>('0' + v % 10); v /= 10;
+        tmp[n++] = '.';
+        do { tmp[n++] = static_cast<char>('0' + v % 10); v /= 10; } while (v);
+        std::size_t len = 0;
+        if (neg) buf[len++] = '-';
+        while (n) buf[len++] = tmp[--n];
+        return len;
+    }
+    std::string to_string() const {
+        char buf[24];
+        return std::string(buf, format(buf));
+    }
+    void append_to(std::string& out) const {
+        char buf[24];
+        out.append(buf, format(buf));
+    }
+
+    // Accepts [+-]digits[.digits]. More than two fraction digits are rounded half-up,
+    // so legacy text written from doubles ("33.3333") still loads.
+    static bool parse(std::string_view s, Money& out) {
+        std::size_t i = 0;
+        bool neg = false;
+        if (i < s.size() && (s[i] == '-' || s[i] == '+')) { neg = s[i] == '-'; ++i; }
+        std::uint64_t whole = 0;
+        std::size_t digits = 0;
+        for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; ++i, ++digits) {
+            if (whole > (static_cast<std::uint64_t>(max_cents()) / 100 - 9) / 10) return false;
+            whole = whole * 10 + static_cast<std::uint64_t>(s[i] - '0');
+        }
+        std::uint64_t frac = 0;
+        if (i < s.size() && s[i] == '.') {
+            ++i;
+            std::size_t fdigits = 0;
+            for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; ++i, ++fdigits) {
+                if (fdigits < 2) frac = frac * 10 + static_cast<std::uint64_t>(s[i] - '0');
+                else if (fdigits == 2 && s[i] >= '5') frac += 1;
+            }
+            if (fdigits == 1) frac *= 10;
+            digits += fdigits;
+        }
+        if (digits == 0 || i != s.size()) return false;
+        std::uint64_t v = whole * 100 + frac;
+        if (v > static_cast<std::uint64_t>(max_cents())) return false;
+        out = Money(neg ? -static_cast<std::int64_t>(v) : static_cast<std::int64_t>(v));
+        return true;
+    }
+
+    // parse() plus a fallback for exponent forms ("1e+06") that old double-based files contain.
+    static bool parse_lenient(std::string_view s, Money& out) {
+        if (parse(s, out)) return true;
+        std::string tmp(s);
+        char* end = nullptr;
+        double d = std::strtod(tmp.c_str(), &end);
+        if (end == tmp.c_str() || *end != '\0' || !(std::fabs(d) < 9.0e16)) return false;
+        out = Money(std::llround(d * 100.0));
+        return true;
+    }
+
+    friend constexpr bool operator==(Money a, Money b) { return a.cents_ == b.cents_; }
+    friend constexpr bool operator!=(Money a, Money b) { return a.cents_ != b.cents_; }
+    friend constexpr bool operator<(Money a, Money b) { return a.cents_ < b.cents_; }
+    friend constexpr bool operator<=(Money a, Money b) { return a.cents_ <= b.cents_; }
+    friend constexpr bool operator>(Money a, Money b) { return a.cents_ > b.cents_; }
+    friend constexpr bool operator>=(Money a, Money b) { return a.cents_ >= b.cents_; }
+
+    friend std::ostream& operator<<(std::ostream& os, Money m) {
+        char buf[24];
+        return os.write(buf, static_cast<std::streamsize>(m.format(buf)));
+    }
+
+private:
+    constexpr explicit Money(std::int64_t c) : cents_(c) {}
+    std::int64_t cents_{0};
+};
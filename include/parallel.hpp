@@ -0,0 +1,73 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+#include <cstddef>
+
+// Fork-join helpers for bulk work (startup loading, log scans). Each call starts its own
+// threads and joins them before returning; nothing keeps running in the background.
+namespace parallel {
+
+// Thread count to use for `requested` (0 = one per hardware thread).
+inline unsigned threads_for(unsigned requested) {
+    if (requested > 0) return requested;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+// Calls fn(i) for every i in [0, n) on up to `threads` threads, the caller being one of them.
+// Indices are handed out one at a time, so uneven items balance out. The first exception
+// thrown by fn stops further work and is rethrown here once every thread has finished.
+template <typename F>
+void for_each(std::size_t n, unsigned threads, F&& fn) {
+    std::size_t workers = std::min<std::size_t>(threads_for(threads), n);
+    if (workers <= 1) {
+        for (std::size_t i = 0; i < n; ++i) fn(i);
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr error;
+    std::mutex error_mu;
+    auto work = [&]() {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n;) {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lk(error_mu);
+                if (!error) error = std::current_exception();
+                next.store(n, std::memory_order_relaxed);
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (std::size_t t = 1; t < workers; ++t) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+    if (error) std::rethrow_exception(error);
+}
+
+// Cuts text into at most `parts` pieces of roughly equal size. Every piece but the last ends
+// just after a newline, so no line straddles two pieces.
+inline std::vector<std::string_view> split_lines(std::string_view text, std::size_t parts) {
+    std::vector<std::string_view> out;
+    if (parts == 0) parts = 1;
+    std::size_t begin = 0;
+    for (std::size_t p = 1; p <= parts && begin < text.size(); ++p) {
+        std::size_t end = text.size();
+        if (p < parts) {
+            std::size_t target = std::max(begin, text.size() / parts * p);
+            std::size_t nl = text.find('\n', target);
+            end = nl == std::string_view::npos ? text.size() : nl + 1;
+        }
+        out.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+    return out;
+}
+
+} // namespace parallel
@@ -0,0 +1,120 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+#include "money.hpp"
+#include "journal.hpp"
+
+// Asynchronous persistence pipeline for Bank (BankOptions::async_persistence).
+// Mutations push their journal records into a bounded lock-free MPSC ring; one I/O thread
+// drains it in batches, appends the records in queue order, flushes the journal once per
+// batch, and then completes every ticket in the batch. In Snapshot mode the queue carries
+// snapshot requests instead, coalesced so that a burst of mutations costs one rewrite.
+//
+// "Durable" means what the journal's flush gives: with Journal::set_sync (BankOptions::
+// sync_journal) the batch is fsynced before its tickets complete and survives a power loss;
+// without it the records are handed to the OS and survive only a crash of the process.
+// If a flush, fsync or snapshot fails, the queue stops completing tickets for good: wait()
+// returns false, on_durable() callbacks are dropped, and durable_future()s hold broken_promise.
+//
+// Ordering: records reach the journal in ticket order, and a producer holding an account's
+// shard lock enqueues that account's records in mutation order, so the journal on disk is
+// always a prefix of the in-memory history. Records still queued when the process dies are
+// lost; Bank::load() replays whatever prefix made it out (a torn last line is ignored).
+// The owner turns the journal's autoflush off while the queue runs.
+class PersistQueue {
+public:
+    using Ticket = std::uint64_t;
+
+    // snapshot: called on the I/O thread to rewrite the snapshot, false if that failed; must not
+    // throw and must not wait on the queue.
+    PersistQueue(Journal& journal, std::function<bool()> snapshot, std::size_t capacity);
+    // Writes out everything queued, completes every ticket, and stops the thread.
+    ~PersistQueue();
+    PersistQueue(const PersistQueue&) = delete;
+    PersistQueue& operator=(const PersistQueue&) = delete;
+
+    // Each of these returns the ticket of the queued item. When the ring is full the caller
+    // blocks until the I/O thread frees a slot (backpressure).
+    Ticket append(std::string_view username, std::string_view password_hash, Money balance);
+    // Records that must reach the journal together (Journal::append_group).
+    Ticket append_group(std::vector<Journal::Record> records);
+    // Rotates the journal once every record queued before it has been appended.
+    Ticket rotate_journal();
+    // Coalesced: returns the ticket of an already queued request when one is pending.
+    Ticket request_snapshot();
+
+    // Highest ticket handed out so far; waiting on it covers everything queued before the call.
+    Ticket last_ticket() const { return tail_.load(std::memory_order_acquire); }
+    Ticket durable() const { return durable_.load(std::memory_order_acquire); }
+
+    // False if the queue failed before ticket t was durable.
+    bool wait(Ticket t);
+    bool drain() { return wait(last_ticket()); }
+    bool failed() const { return failed_.load(std::memory_order_acquire); }
+    // done runs once ticket t is durable: on the I/O thread, or right away if it already is.
+    // Keep it short; it delays the next batch.
+    void on_durable(Ticket t, std::function<void()> done);
+    std::future<void> durable_future(Ticket t);
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+private:
+    enum class Kind : std::uint8_t { Record, Group, Rotate, Snapshot };
+    struct Item {
+        Kind kind = Kind::Record;
+        std::string username;
+        char hash[64];
+        Money balance;
+        std::vector<Journal::Record> group;
+    };
+    // Vyukov bounded queue cell: seq == position means free for that position's producer,
+    // seq == position + 1 means filled and ready for the consumer.
+    struct Cell {
+        std::atomic<std::uint64_t> seq;
+        Item item;
+    };
+
+    template <typename Fill>
+    Ticket push(Fill fill);
+    bool ready(std::uint64_t pos) const;
+    void run();
+    void complete(Ticket t);
+    void fail();
+
+    Journal& journal_;
+    std::function<bool()> snapshot_;
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_;
+
+    alignas(64) std::atomic<std::uint64_t> tail_{0}; // next position to claim (producers)
+    alignas(64) std::atomic<std::uint64_t> head_{0}; // next position to drain (written by the I/O thread)
+    std::atomic<std::uint64_t> durable_{0};
+    std::atomic<bool> failed_{false};
+    std::mutex snapshot_mu_;                // one new snapshot request at a time
+    std::atomic<Ticket> snapshot_ticket_{0}; // latest request; still pending while > head_
+
+    // Sleeping is rare on both sides, so a plain mutex/condvar pair covers it; the counters
+    // let the fast paths skip the mutex when nobody is asleep.
+    std::mutex mu_;
+    std::condition_variable work_cv_;  // I/O thread waits for items
+    std::condition_variable space_cv_; // producers wait for a free slot
+    std::condition_variable done_cv_;  // wait() callers
+    std::atomic<bool> idle_{false};
+    std::atomic<int> full_waiters_{0};
+    bool stop_{false};
+    std::multimap<Ticket, std::function<void()>> callbacks_; // guarded by mu_
+
+    std::thread worker_;
+};
@@ -0,0 +1,158 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Order-statistic treap over dense slot numbers (0..n-1), each present at most once.
+// Node storage is indexed by slot, so a tree costs 12 bytes per slot and never allocates
+// per insert; priorities are a hash of the slot. The ordering is not stored: every call takes
+// the comparator, so the tree can order slots by data that lives elsewhere (a username in the
+// arena, a balance). A slot must be erased before the data it is ordered by changes.
+class RankTree {
+public:
+    static constexpr std::uint32_t nil = UINT32_MAX;
+
+    std::size_t size() const { return size_of(root_); }
+    void clear() { nodes_.clear(); root_ = nil; }
+
+    // less(a, b): strict total order over slots.
+    template <typename Less>
+    void insert(std::uint32_t slot, Less less) {
+        if (slot >= nodes_.size()) nodes_.resize(slot + 1, Node{nil, nil, 0});
+        nodes_[slot] = Node{nil, nil, 1};
+        std::uint32_t l, r;
+        split(root_, [&](std::uint32_t v) { return less(v, slot); }, l, r);
+        root_ = merge(merge(l, slot), r);
+    }
+
+    template <typename Less>
+    void erase(std::uint32_t slot, Less less) {
+        std::uint32_t l, mid, r;
+        split(root_, [&](std::uint32_t v) { return less(v, slot); }, l, r);
+        split(r, [&](std::uint32_t v) { return !less(slot, v); }, mid, r); // mid holds just slot
+        root_ = merge(l, r);
+    }
+
+    // Number of slots v with below(v), for a predicate that holds on a prefix of the order.
+    template <typename Below>
+    std::size_t count_below(Below below) const {
+        std::size_t n = 0;
+        for (std::uint32_t t = root_; t != nil;) {
+            if (below(t)) { n += size_of(nodes_[t].left) + 1; t = nodes_[t].right; }
+            else t = nodes_[t].left;
+        }
+        return n;
+    }
+
+    // In-order walk with an explicit stack: O(log n) to position, amortized O(1) per step.
+    class Cursor {
+    public:
+        bool valid() const { return !stack_.empty(); }
+        std::uint32_t slot() const { return stack_.back(); }
+        void next() { step(false); }
+        void prev() { step(true); }
+
+    private:
+        friend class RankTree;
+        void step(bool backward) {
+            std::uint32_t t = stack_.back();
+            std::uint32_t child = backward ? tree_->nodes_[t].left : tree_->nodes_[t].right;
+            if (child != nil) {
+                descend(child, !backward);
+                return;
+            }
+            // Climb until we leave a subtree from the side we are walking towards.
+            stack_.pop_back();
+            while (!stack_.empty()) {
+                std::uint32_t parent = stack_.back();
+                std::uint32_t came_from = backward ? tree_->nodes_[parent].right : tree_->nodes_[parent].left;
+                if (came_from == t) return;
+                t = parent;
+                stack_.pop_back();
+            }
+        }
+        void descend(std::uint32_t t, bool leftmost) {
+            for (; t != nil; t = leftmost ? tree_->nodes_[t].left : tree_->nodes_[t].right) stack_.push_back(t);
+        }
+
+        const RankTree* tree_{nullptr};
+        std::vector<std::uint32_t> stack_; // path from the root to the current node
+    };
+
+    // First slot (in order) for which below() is false.
+    template <typename Below>
+    Cursor lower_bound(Below below) const {
+        Cursor c;
+        c.tree_ = this;
+        std::size_t keep = 0;
+        for (std::uint32_t t = root_; t != nil;) {
+            c.stack_.push_back(t);
+            if (below(t)) t = nodes_[t].right;
+            else { keep = c.stack_.size(); t = nodes_[t].left; }
+        }
+        c.stack_.resize(keep);
+        return c;
+    }
+    // Last slot for which below() is still true.
+    template <typename Below>
+    Cursor last_below(Below below) const {
+        Cursor c;
+        c.tree_ = this;
+        std::size_t keep = 0;
+        for (std::uint32_t t = root_; t != nil;) {
+            c.stack_.push_back(t);
+            if (below(t)) { keep = c.stack_.size(); t = nodes_[t].right; }
+            else t = nodes_[t].left;
+        }
+        c.stack_.resize(keep);
+        return c;
+    }
+    Cursor first() const { return lower_bound([](std::uint32_t) { return false; }); }
+    Cursor last() const { return last_below([](std::uint32_t) { return true; }); }
+
+private:
+    struct Node {
+        std::uint32_t left;
+        std::uint32_t right;
+        std::uint32_t size;
+    };
+
+    static std::uint32_t priority(std::uint32_t slot) {
+        std::uint32_t x = slot * 0x9E3779B1u;
+        x ^= x >> 15;
+        x *= 0x85EBCA77u;
+        x ^= x >> 13;
+        return x;
+    }
+    std::uint32_t size_of(std::uint32_t t) const { return t == nil ? 0 : nodes_[t].size; }
+    void update(std::uint32_t t) { nodes_[t].size = size_of(nodes_[t].left) + size_of(nodes_[t].right) + 1; }
+
+    // l gets the slots with go_left(v), r the rest; go_left must hold on a prefix of the order.
+    template <typename GoLeft>
+    void split(std::uint32_t t, GoLeft go_left, std::uint32_t& l, std::uint32_t& r) {
+        if (t == nil) { l = r = nil; return; }
+        if (go_left(t)) {
+            split(nodes_[t].right, go_left, nodes_[t].right, r);
+            l = t;
+        } else {
+            split(nodes_[t].left, go_left, l, nodes_[t].left);
+            r = t;
+        }
+        update(t);
+    }
+    std::uint32_t merge(std::uint32_t l, std::uint32_t r) {
+        if (l == nil) return r;
+        if (r == nil) return l;
+        if (priority(l) > priority(r)) {
+            nodes_[l].right = merge(nodes_[l].right, r);
+            update(l);
+            return l;
+        }
+        nodes_[r].left = merge(l, nodes_[r].left);
+        update(r);
+        return r;
+    }
+
+    std::vector<Node> nodes_;
+    std::uint32_t root_{nil};
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <cstdint>
+#include <cstddef>
+
+#include "bank.hpp"
+
+// Aggregate reports over a BalanceSnapshot: they read a fixed point in time while the bank
+// keeps taking deposits and transfers, and never hold a shard lock while they run.
+//
+// Balances are summed part by part on a thread pool. The optional flow totals stream every
+// account's transaction log the same way, counting only records stamped before the snapshot,
+// so they describe exactly the state the balances show.
+namespace reports {
+
+// Default distribution buckets: below 0, 0, then decades from 0.01 up to 1,000,000 and above.
+std::vector<Money> decade_edges();
+
+struct Options {
+    unsigned threads = 0;                     // 0 = one per core
+    bool flows = true;                        // also total the transaction logs (reads every log)
+    std::vector<Money> edges = decade_edges(); // ascending lower bounds of the histogram buckets
+};
+
+struct Report {
+    std::uint64_t epoch = 0;
+    timestamp::Micros taken_at = 0;
+
+    std::size_t accounts = 0;
+    std::size_t funded = 0;    // balance > 0
+    std::size_t overdrawn = 0; // balance < 0
+    Money liabilities;         // sum of positive balances: what the bank owes its customers
+    Money overdrafts;          // sum of negative balances (normally none)
+    Money largest;
+
+    // From the transaction logs, up to taken_at (Options::flows).
+    bool has_flows = false;
+    std::size_t records = 0;
+    Money deposits;    // DEPOSIT, including opening deposits
+    Money withdrawals;
+    Money transfers;   // volume moved between accounts (each transfer once)
+    Money adjustments; // net ADJUST records from ledger repairs
+
+    // Balance distribution: counts[0] and totals[0] are balances below edges[0]; bucket i + 1
+    // holds edges[i] <= balance < edges[i + 1] (the last one is open-ended).
+    std::vector<Money> edges;
+    std::vector<std::size_t> counts;
+    std::vector<Money> totals;
+
+    double seconds = 0;
+};
+
+Report run(Bank& bank, const BalanceSnapshot& snap, const Options& opts);
+void write_report(std::ostream& os, const Report& report);
+
+} // namespace reports
@@ -0,0 +1,131 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <filesystem>
+#include <functional>
+#include <shared_mutex>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+#include "transaction.hpp"
+#include "history.hpp"
+
+struct SegmentOptions {
+    std::uint64_t max_segment_bytes = 64ull << 20;  // seal the active segment once it is this big
+    std::chrono::seconds max_segment_age{24 * 3600}; // ...or once its first record is this old
+    std::size_t hot_segments = 4;                    // sealed segments kept as plain text
+    std::size_t archive_batch = 4;                   // sealed segments compacted into one archive
+    std::size_t block_bytes = 64 << 10;              // uncompressed bytes per archive block
+};
+
+// Segmented transaction log: every account's records go to shared segment files instead of one
+// file per account, and old segments are compacted into compressed archives.
+//
+//   segments/seg-<seq>.log    username|timestamp|type|amount|balance_after|details lines; the
+//                             highest one is active (appended to), the rest are sealed
+//   segments/seg-<seq>.sidx   a sealed segment's per-account index (offset + timestamp key per line)
+//   archive/arc-<a>-<b>.arc   segments a..b: per-account runs of log lines (username dropped),
+//                             cut into LZ-compressed blocks, with a block table and one summary
+//                             per account (line count, opening/closing balance, first/last
+//                             timestamp) in the footer
+//
+// An account's history is its archive runs, then its sealed segment lines, then its active
+// segment lines, all in append order. Archives are imported per-user logs (seq 0) or hold
+// segments older than every sealed one, so that order is chronological.
+class SegmentStore {
+public:
+    // Opens or creates the store under dir, finishing an interrupted seal or compaction.
+    // Throws std::runtime_error when it cannot.
+    SegmentStore(std::filesystem::path dir, SegmentOptions opts);
+    ~SegmentStore();
+    SegmentStore(const SegmentStore&) = delete;
+    SegmentStore& operator=(const SegmentStore&) = delete;
+
+    // Writer side, one thread: append() under write_lock(), then commit() to push the batch to
+    // the OS (fsync: and to disk) and maintain() outside the lock.
+    // If a write, flush or fsync fails, both return false and the active segment is rolled back
+    // to the last successful commit(), file and index alike: the batch is lost as a whole, and
+    // no index entry ever points past what the file holds. Throws if even the rollback fails.
+    std::unique_lock<std::shared_mutex> write_lock() { return std::unique_lock<std::shared_mutex>(mu_); }
+    bool append(const std::string& username, const Transaction& tx, std::string_view counterparty, bool fsync);
+    bool commit(bool fsync);
+    // Seals the active segment when it is too large or too old, and compacts the oldest sealed
+    // segments once more than hot_segments + archive_batch are waiting. Archives are built
+    // without holding the lock; readers only wait while the new one is swapped in.
+    // force: seal a non-empty active segment and archive everything beyond hot_segments now.
+    // On failure (e.g. disk full) nothing is lost: the segments stay as they are.
+    bool maintain(bool force, std::string& err);
+
+    // Moves every <user>.log (and .idx) in dir into an archive that sorts before all segments.
+    // Does nothing if the store already holds such an import. Returns the number of logs taken.
+    std::size_t import_logs(const std::filesystem::path& dir);
+
+    // Reader side; safe from any thread.
+    std::size_t count(const std::string& username) const;
+    // Position of the first record with ts_key >= key (> key when upper is set); keys are epoch
+    // microseconds, as in history::IndexEntry.
+    std::size_t lower_bound(const std::string& username, std::int64_t key, bool upper = false) const;
+    // Up to limit records starting at position first; resolve maps counterparty usernames to ids.
+    std::vector<Transaction> read(const std::string& username, std::size_t first, std::size_t limit,
+                                  const std::function<AccountId(std::string_view)>& resolve) const;
+    // Calls fn(username, stream) for every account with records, on up to `threads` threads;
+    // stream(visit) walks that account's records in order. Writers wait until it returns.
+    std::size_t for_each_account(unsigned threads,
+                                 const std::function<void(const std::string&, const history::AccountStream&)>& fn) const;
+
+    // One archive's summary record for an account.
+    struct Summary {
+        std::uint64_t first_seq = 0, last_seq = 0; // segments the archive covers (0-0: imported logs)
+        std::uint32_t count = 0;
+        Money opening, closing;                    // balance before the first and after the last record
+        std::int64_t first_ts = 0, last_ts = 0;    // epoch microseconds
+    };
+    std::vector<Summary> summaries(const std::string& username) const;
+
+    struct Stats {
+        std::size_t sealed_segments = 0;
+        std::size_t archives = 0;
+        std::uint64_t hot_bytes = 0;         // active + sealed segment files
+        std::uint64_t archive_bytes = 0;     // on disk
+        std::uint64_t archive_raw_bytes = 0; // before compression
+    };
+    Stats stats() const;
+
+private:
+    struct Segment;
+    struct Archive;
+    struct BlockCache;
+    using SegmentPtr = std::shared_ptr<Segment>;
+    using ArchivePtr = std::shared_ptr<Archive>;
+
+    void recover();
+    void open_active(std::uint64_t seq);
+    void rollback_locked();
+    void seal_locked();
+    std::filesystem::path segment_path(std::uint64_t seq, const char* ext) const;
+    // Calls visit(line) for records [first, first + limit) of username, lines without the username.
+    void walk(const std::string& username, std::size_t first, std::size_t limit,
+              const std::function<void(std::string_view)>& visit, BlockCache& cache) const;
+    // The uncompressed bytes [off, off + len) of an archive.
+    void extract(const Archive& arc, std::uint64_t off, std::uint64_t len, std::string& out, BlockCache& cache) const;
+    std::size_t stream(const std::string& username, const history::RecordVisitor& visit, BlockCache& cache) const;
+
+    std::filesystem::path seg_dir_;
+    std::filesystem::path arc_dir_;
+    SegmentOptions opts_;
+
+    // Exclusive while appending or swapping tiers; shared while reading.
+    mutable std::shared_mutex mu_;
+    std::vector<ArchivePtr> archives_; // oldest first
+    std::vector<SegmentPtr> sealed_;   // oldest first
+    SegmentPtr active_;
+    std::FILE* active_file_ = nullptr;
+    std::uint64_t committed_ = 0; // active segment bytes as of the last successful commit()
+    std::string line_;
+};
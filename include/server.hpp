@@ -0,0 +1,115 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+#include "metrics.hpp"
+
+class Bank;
+
+// Built on epoll and eventfd, so it exists on Linux only; BANK_HAVE_SERVER tells callers.
+#if defined(__linux__)
+#define BANK_HAVE_SERVER 1
+#endif
+
+// Network front end for Bank (banking_app --serve).
+// One event-loop thread accepts connections and moves bytes; requests run on a worker pool.
+// The protocol is line based: one request per line, fields separated by spaces or tabs, and
+// exactly one response per request, in request order (blank lines get none):
+//   PING                              -> OK PONG
+//   CREATE <username> <password> [amount]
+//   LOGIN <username> <password>       -> the connection's session; LOGOUT ends it
+//   BALANCE                           -> OK <balance>
+//   DEPOSIT <amount>                  -> OK <balance after>
+//   WITHDRAW <amount>                 -> OK <balance after>
+//   TRANSFER <to> <amount>            -> OK <balance after>
+//   HISTORY [n]                       -> OK <k>, then k log lines, oldest first (n: 10, at most 1000)
+//   QUIT                              -> OK, then the server closes the connection
+// Failures answer "ERR <reason>". Clients may pipeline: send many requests without waiting.
+// A connection's requests run one at a time, in order, on whichever worker picks it up; up to
+// max_pipeline of them are buffered before the server stops reading from it.
+struct ServerOptions {
+    std::string listen = "127.0.0.1:7878"; // "unix:<path>" or "[host:]port" (port 0 = any free one)
+    unsigned workers = 0;                  // 0 = one per core
+    std::size_t max_pipeline = 1024;       // buffered requests per connection
+    std::size_t max_line = 4096;           // longer requests close the connection
+};
+
+class Server {
+public:
+    // Binds and listens; throws std::runtime_error on failure.
+    Server(Bank& bank, ServerOptions opts);
+    ~Server();
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Serves on the calling thread until stop(); then finishes queued requests, flushes what it
+    // can and closes every connection.
+    void run();
+    // Async-signal-safe: may be called from a signal handler.
+    void stop();
+
+    // The bound address in ServerOptions::listen syntax, with the actual port.
+    const std::string& address() const { return address_; }
+
+    std::uint64_t connections() const { return connections_.load(std::memory_order_relaxed); }
+    std::uint64_t requests() const { return requests_.load(std::memory_order_relaxed); }
+    // Connections closed unserved because the process was out of file descriptors.
+    std::uint64_t refused() const { return refused_.load(std::memory_order_relaxed); }
+    // Time from a request being read off the socket to its response being ready.
+    const metrics::Histogram& latency() const { return latency_; }
+
+private:
+    struct Conn;
+    using ConnPtr = std::shared_ptr<Conn>;
+
+    void release();                  // closes every descriptor and removes the socket file
+    void on_accept();
+    void shed_connection();          // out of descriptors: drop one pending connection
+    void pause_accept(bool pause);   // stop or resume watching the listener
+    void on_readable(const ConnPtr& c);
+    void on_ready();                 // workers finished some batches
+    void flush(const ConnPtr& c);    // moves responses to the socket, then re-arms epoll
+    void close_conn(const ConnPtr& c);
+    void schedule(const ConnPtr& c); // onto the worker queue
+    void work();                     // worker thread body
+    void serve(const ConnPtr& c);    // one batch of c's requests
+    bool handle(Conn& c, std::string_view line, std::string& out); // false: close after this one
+
+    Bank& bank_;
+    ServerOptions opts_;
+    std::string address_;
+    std::string unix_path_; // removed on destruction
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int event_fd_ = -1; // wakes the loop: finished batches, stop()
+    int spare_fd_ = -1;  // held in reserve so a connection can be shed when descriptors run out
+    bool accept_paused_ = false; // loop thread only
+    std::atomic<bool> stop_{false};
+
+    std::unordered_map<int, ConnPtr> conns_; // loop thread only
+
+    std::mutex work_mu_;
+    std::condition_variable work_cv_;
+    std::deque<ConnPtr> work_; // connections with requests waiting
+    bool workers_stop_ = false;
+    std::vector<std::thread> workers_;
+
+    std::mutex ready_mu_;
+    std::vector<ConnPtr> ready_; // connections with responses to write
+
+    std::atomic<std::uint64_t> connections_{0};
+    std::atomic<std::uint64_t> requests_{0};
+    std::atomic<std::uint64_t> refused_{0};
+    metrics::Histogram latency_;
+};
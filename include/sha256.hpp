@@ -1,14 +1,32 @@
 // picosha2: A tiny SHA-256 implementation (public domain)
-// Source: https://github.com/okdshin/PicoSHA2 (lightly trimmed for header-only use)
+// Source: https://github.com/okdshin/PicoSHA2 (reworked for header-only use)
 // This header provides picosha2::hash256_hex_string and related functions.
+//
+// Hashing runs on a stack-allocated hash256_ctx (init/update/finish); nothing is allocated
+// except the returned std::string in the *_string helpers. hash256_batch hashes several
+// independent messages at once in SIMD lanes (AVX2: 8, SSE2: 4), picking the kernel at runtime.
 #pragma once
 #include <vector>
 #include <string>
-#include <sstream>
-#include <iomanip>
+#include <string_view>
 #include <iterator>
+#include <cstring>
+#include <cstddef>
 #include <stdint.h>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PICOSHA2_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define PICOSHA2_TARGET_SSE2
+#define PICOSHA2_TARGET_AVX2
+#else
+#define PICOSHA2_TARGET_SSE2 __attribute__((target("sse2")))
+#define PICOSHA2_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
 namespace picosha2 {
     typedef uint32_t uint32;
     typedef uint8_t byte_t;
@@ -34,64 +52,322 @@ namespace picosha2 {
         0x748f82eeul,0x78a5636ful,0x84c87814ul,0x8cc70208ul,0x90befffaul,0xa4506cebul,0xbef9a3f7ul,0xc67178f2ul
     };
 
-    template<typename RaIter1, typename RaIter2>
-    void hash256(RaIter1 first, RaIter1 last, RaIter2 result) {
-        uint32 h[8] = {
-            0x6a09e667ul,0xbb67ae85ul,0x3c6ef372ul,0xa54ff53aul,
-            0x510e527ful,0x9b05688cul,0x1f83d9abul,0x5be0cd19ul
-        };
-        std::vector<byte_t> msg(first, last);
-        uint64_t l = static_cast<uint64_t>(msg.size()) * 8;
-        msg.push_back(0x80);
-        while ((msg.size() % 64) != 56) msg.push_back(0x00);
-        for (int i = 7; i >= 0; --i) msg.push_back(static_cast<byte_t>((l >> (i*8)) & 0xff));
-        for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
-            uint32 w[64];
-            for (int i = 0; i < 16; ++i) {
-                w[i] = (static_cast<uint32>(msg[chunk + 4*i]) << 24) |
-                       (static_cast<uint32>(msg[chunk + 4*i + 1]) << 16) |
-                       (static_cast<uint32>(msg[chunk + 4*i + 2]) << 8) |
-                       (static_cast<uint32>(msg[chunk + 4*i + 3]));
+    static const uint32 initial_state[8] = {
+        0x6a09e667ul,0xbb67ae85ul,0x3c6ef372ul,0xa54ff53aul,
+        0x510e527ful,0x9b05688cul,0x1f83d9abul,0x5be0cd19ul
+    };
+
+    inline uint32 load_be32(const byte_t* p) {
+        return (static_cast<uint32>(p[0]) << 24) | (static_cast<uint32>(p[1]) << 16) |
+               (static_cast<uint32>(p[2]) << 8) | static_cast<uint32>(p[3]);
+    }
+
+    inline void compress(uint32 h[8], const byte_t* block) {
+        uint32 w[64];
+        for (int i = 0; i < 16; ++i) w[i] = load_be32(block + 4*i);
+        for (int i = 16; i < 64; ++i) w[i] = mask_32bit(ssig1(w[i-2]) + w[i-7] + ssig0(w[i-15]) + w[i-16]);
+        uint32 a=h[0],b=h[1],c=h[2],d=h[3],e=h[4],f=h[5],g=h[6],hh=h[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32 t1 = mask_32bit(hh + bsig1(e) + ch(e,f,g) + k[i] + w[i]);
+            uint32 t2 = mask_32bit(bsig0(a) + maj(a,b,c));
+            hh = g; g = f; f = e; e = mask_32bit(d + t1); d = c; c = b; b = a; a = mask_32bit(t1 + t2);
+        }
+        h[0] = mask_32bit(h[0] + a);
+        h[1] = mask_32bit(h[1] + b);
+        h[2] = mask_32bit(h[2] + c);
+        h[3] = mask_32bit(h[3] + d);
+        h[4] = mask_32bit(h[4] + e);
+        h[5] = mask_32bit(h[5] + f);
+        h[6] = mask_32bit(h[6] + g);
+        h[7] = mask_32bit(h[7] + hh);
+    }
+
+    // Streaming context; lives on the stack, never allocates.
+    struct hash256_ctx {
+        uint32 h[8];
+        byte_t buf[64];
+        size_t buf_len;
+        uint64_t total_len;
+
+        hash256_ctx() { init(); }
+
+        void init() {
+            std::memcpy(h, initial_state, sizeof(h));
+            buf_len = 0;
+            total_len = 0;
+        }
+
+        void update(const void* data, size_t len) {
+            const byte_t* p = static_cast<const byte_t*>(data);
+            total_len += len;
+            if (buf_len) {
+                size_t take = 64 - buf_len < len ? 64 - buf_len : len;
+                std::memcpy(buf + buf_len, p, take);
+                buf_len += take; p += take; len -= take;
+                if (buf_len < 64) return;
+                compress(h, buf);
+                buf_len = 0;
+            }
+            for (; len >= 64; p += 64, len -= 64) compress(h, p);
+            if (len) { std::memcpy(buf, p, len); buf_len = len; }
+        }
+
+        void finish(byte_t out[32]) {
+            uint64_t bits = total_len * 8;
+            buf[buf_len++] = 0x80;
+            if (buf_len > 56) {
+                std::memset(buf + buf_len, 0, 64 - buf_len);
+                compress(h, buf);
+                buf_len = 0;
             }
-            for (int i = 16; i < 64; ++i) w[i] = mask_32bit(ssig1(w[i-2]) + w[i-7] + ssig0(w[i-15]) + w[i-16]);
-            uint32 a=h[0],b=h[1],c=h[2],d=h[3],e=h[4],f=h[5],g=h[6],hh=h[7];
-            for (int i = 0; i < 64; ++i) {
-                uint32 t1 = mask_32bit(hh + bsig1(e) + ch(e,f,g) + k[i] + w[i]);
-                uint32 t2 = mask_32bit(bsig0(a) + maj(a,b,c));
-                hh = g; g = f; f = e; e = mask_32bit(d + t1); d = c; c = b; b = a; a = mask_32bit(t1 + t2);
+            std::memset(buf + buf_len, 0, 56 - buf_len);
+            for (int i = 0; i < 8; ++i) buf[56 + i] = static_cast<byte_t>(bits >> (56 - 8*i));
+            compress(h, buf);
+            for (int i = 0; i < 8; ++i) {
+                out[4*i]     = static_cast<byte_t>(h[i] >> 24);
+                out[4*i + 1] = static_cast<byte_t>(h[i] >> 16);
+                out[4*i + 2] = static_cast<byte_t>(h[i] >> 8);
+                out[4*i + 3] = static_cast<byte_t>(h[i]);
             }
-            h[0] = mask_32bit(h[0] + a);
-            h[1] = mask_32bit(h[1] + b);
-            h[2] = mask_32bit(h[2] + c);
-            h[3] = mask_32bit(h[3] + d);
-            h[4] = mask_32bit(h[4] + e);
-            h[5] = mask_32bit(h[5] + f);
-            h[6] = mask_32bit(h[6] + g);
-            h[7] = mask_32bit(h[7] + hh);
         }
-        for (int i = 0; i < 8; ++i) {
-            *result++ = static_cast<byte_t>((h[i] >> 24) & 0xff);
-            *result++ = static_cast<byte_t>((h[i] >> 16) & 0xff);
-            *result++ = static_cast<byte_t>((h[i] >> 8) & 0xff);
-            *result++ = static_cast<byte_t>((h[i]) & 0xff);
+    };
+
+    template<typename RaIter1, typename RaIter2>
+    void hash256(RaIter1 first, RaIter1 last, RaIter2 result) {
+        hash256_ctx ctx;
+        byte_t chunk[64];
+        size_t n = 0;
+        for (; first != last; ++first) {
+            chunk[n++] = static_cast<byte_t>(*first);
+            if (n == sizeof(chunk)) { ctx.update(chunk, n); n = 0; }
         }
+        ctx.update(chunk, n);
+        byte_t digest[32];
+        ctx.finish(digest);
+        for (int i = 0; i < 32; ++i) *result++ = digest[i];
+    }
+
+    inline void hash256(const void* data, size_t len, byte_t out[32]) {
+        hash256_ctx ctx;
+        ctx.update(data, len);
+        ctx.finish(out);
     }
 
+    // Table-based lowercase hex; out receives 2*n chars (no terminator).
+    inline void bytes_to_hex(const byte_t* bytes, size_t n, char* out) {
+        static const char digits[] = "0123456789abcdef";
+        for (size_t i = 0; i < n; ++i) {
+            out[2*i]     = digits[bytes[i] >> 4];
+            out[2*i + 1] = digits[bytes[i] & 0x0f];
+        }
+    }
     inline void bytes_to_hex_string(const std::vector<byte_t>& bytes, std::string& hex_str) {
-        std::ostringstream oss;
-        oss<<std::hex<<std::setfill('0');
-        for (size_t i = 0; i < bytes.size(); ++i) oss<<std::setw(2)<<(unsigned int)bytes[i];
-        hex_str = oss.str();
+        hex_str.resize(bytes.size() * 2);
+        bytes_to_hex(bytes.data(), bytes.size(), &hex_str[0]);
     }
     template<typename RaIter>
     void hash256_hex_string(RaIter first, RaIter last, std::string& hex_str) {
-        std::vector<byte_t> hash(32);
-        hash256(first, last, hash.begin());
-        bytes_to_hex_string(hash, hex_str);
+        byte_t digest[32];
+        hash256(first, last, digest);
+        hex_str.resize(64);
+        bytes_to_hex(digest, 32, &hex_str[0]);
     }
     inline std::string hash256_hex_string(const std::string& s) {
-        std::string hex;
-        hash256_hex_string(s.begin(), s.end(), hex);
+        byte_t digest[32];
+        hash256(s.data(), s.size(), digest);
+        std::string hex(64, '\0');
+        bytes_to_hex(digest, 32, &hex[0]);
         return hex;
     }
+
+    // ---- Multi-buffer batch hashing ------------------------------------------------------
+
+    namespace detail {
+        // Block b of msg after SHA-256 padding; returns msg bytes directly when the block
+        // needs no padding, otherwise builds it in tmp.
+        inline const byte_t* padded_block(std::string_view msg, size_t b, byte_t tmp[64]) {
+            size_t off = b * 64;
+            if (off + 64 <= msg.size()) return reinterpret_cast<const byte_t*>(msg.data()) + off;
+            std::memset(tmp, 0, 64);
+            if (off < msg.size()) std::memcpy(tmp, msg.data() + off, msg.size() - off);
+            if (off <= msg.size()) tmp[msg.size() - off] = 0x80;
+            size_t nblocks = (msg.size() + 9 + 63) / 64;
+            if (b == nblocks - 1) {
+                uint64_t bits = static_cast<uint64_t>(msg.size()) * 8;
+                for (int i = 0; i < 8; ++i) tmp[56 + i] = static_cast<byte_t>(bits >> (56 - 8*i));
+            }
+            return tmp;
+        }
+
+        inline size_t block_count(std::string_view msg) { return (msg.size() + 9 + 63) / 64; }
+
+        // Runs kernel over groups of Lanes messages; st is the transposed state [word][lane].
+        template <int Lanes, typename Kernel>
+        void hash_lanes(const std::string_view* msgs, size_t n, byte_t* out, Kernel kernel) {
+            static const byte_t zero_block[64] = {};
+            for (size_t base = 0; base < n; base += Lanes) {
+                size_t active = n - base < static_cast<size_t>(Lanes) ? n - base : static_cast<size_t>(Lanes);
+                uint32 st[8][Lanes];
+                size_t nblocks[Lanes] = {};
+                size_t max_blocks = 0;
+                for (int l = 0; l < Lanes; ++l) {
+                    for (int j = 0; j < 8; ++j) st[j][l] = initial_state[j];
+                    if (static_cast<size_t>(l) < active) {
+                        nblocks[l] = block_count(msgs[base + l]);
+                        if (nblocks[l] > max_blocks) max_blocks = nblocks[l];
+                    }
+                }
+                byte_t tmp[Lanes][64];
+                uint32 saved[8][Lanes] = {}; // state of finished lanes across a padded block
+                for (size_t b = 0; b < max_blocks; ++b) {
+                    const byte_t* blocks[Lanes];
+                    bool any_done = false;
+                    for (int l = 0; l < Lanes; ++l) {
+                        if (b < nblocks[l]) {
+                            blocks[l] = padded_block(msgs[base + l], b, tmp[l]);
+                        } else {
+                            blocks[l] = zero_block; // lane finished: compute and discard
+                            any_done = true;
+                        }
+                    }
+                    if (any_done) std::memcpy(saved, st, sizeof(st));
+                    kernel(st, blocks);
+                    if (any_done) {
+                        for (int l = 0; l < Lanes; ++l) {
+                            if (b >= nblocks[l]) for (int j = 0; j < 8; ++j) st[j][l] = saved[j][l];
+                        }
+                    }
+                }
+                for (size_t l = 0; l < active; ++l) {
+                    byte_t* o = out + 32 * (base + l);
+                    for (int j = 0; j < 8; ++j) {
+                        o[4*j]     = static_cast<byte_t>(st[j][l] >> 24);
+                        o[4*j + 1] = static_cast<byte_t>(st[j][l] >> 16);
+                        o[4*j + 2] = static_cast<byte_t>(st[j][l] >> 8);
+                        o[4*j + 3] = static_cast<byte_t>(st[j][l]);
+                    }
+                }
+            }
+        }
+
+#ifdef PICOSHA2_X86
+        // The two kernels are the scalar compression with every uint32 replaced by a vector of
+        // lanes; macros keep them identical and avoid calling across target attributes.
+#define PICOSHA2_SIMD_KERNEL(NAME, TARGET, V, LANES, LOAD, STORE, SET1, ADD, XOR, OR, AND, ANDNOT, SRL, SLL) \
+        TARGET inline void NAME(uint32 st[8][LANES], const byte_t* const blocks[LANES]) {                     \
+            V w[64];                                                                                          \
+            for (int t = 0; t < 16; ++t) {                                                                    \
+                uint32 lane[LANES];                                                                           \
+                for (int l = 0; l < LANES; ++l) lane[l] = load_be32(blocks[l] + 4*t);                         \
+                w[t] = LOAD(reinterpret_cast<const V*>(lane));                                                \
+            }                                                                                                 \
+            for (int t = 16; t < 64; ++t) {                                                                   \
+                V x15 = w[t-15], x2 = w[t-2];                                                                 \
+                V s0 = XOR(XOR(OR(SRL(x15, 7), SLL(x15, 25)), OR(SRL(x15, 18), SLL(x15, 14))), SRL(x15, 3));  \
+                V s1 = XOR(XOR(OR(SRL(x2, 17), SLL(x2, 15)), OR(SRL(x2, 19), SLL(x2, 13))), SRL(x2, 10));     \
+                w[t] = ADD(ADD(s1, w[t-7]), ADD(s0, w[t-16]));                                                \
+            }                                                                                                 \
+            V a = LOAD(reinterpret_cast<const V*>(st[0])), b = LOAD(reinterpret_cast<const V*>(st[1]));       \
+            V c = LOAD(reinterpret_cast<const V*>(st[2])), d = LOAD(reinterpret_cast<const V*>(st[3]));       \
+            V e = LOAD(reinterpret_cast<const V*>(st[4])), f = LOAD(reinterpret_cast<const V*>(st[5]));       \
+            V g = LOAD(reinterpret_cast<const V*>(st[6])), h = LOAD(reinterpret_cast<const V*>(st[7]));       \
+            for (int i = 0; i < 64; ++i) {                                                                    \
+                V S1 = XOR(XOR(OR(SRL(e, 6), SLL(e, 26)), OR(SRL(e, 11), SLL(e, 21))), OR(SRL(e, 25), SLL(e, 7))); \
+                V chv = XOR(AND(e, f), ANDNOT(e, g));                                                         \
+                V t1 = ADD(ADD(ADD(h, S1), ADD(chv, SET1(static_cast<int>(k[i])))), w[i]);                   \
+                V S0 = XOR(XOR(OR(SRL(a, 2), SLL(a, 30)), OR(SRL(a, 13), SLL(a, 19))), OR(SRL(a, 22), SLL(a, 10))); \
+                V mj = XOR(XOR(AND(a, b), AND(a, c)), AND(b, c));                                             \
+                V t2 = ADD(S0, mj);                                                                           \
+                h = g; g = f; f = e; e = ADD(d, t1); d = c; c = b; b = a; a = ADD(t1, t2);                    \
+            }                                                                                                 \
+            V* s = reinterpret_cast<V*>(st[0]);                                                               \
+            STORE(s + 0, ADD(LOAD(s + 0), a)); STORE(s + 1, ADD(LOAD(s + 1), b));                             \
+            STORE(s + 2, ADD(LOAD(s + 2), c)); STORE(s + 3, ADD(LOAD(s + 3), d));                             \
+            STORE(s + 4, ADD(LOAD(s + 4), e)); STORE(s + 5, ADD(LOAD(s + 5), f));                             \
+            STORE(s + 6, ADD(LOAD(s + 6), g)); STORE(s + 7, ADD(LOAD(s + 7), h));                             \
+        }
+
+        PICOSHA2_SIMD_KERNEL(compress_sse2, PICOSHA2_TARGET_SSE2, __m128i, 4,
+            _mm_loadu_si128, _mm_storeu_si128, _mm_set1_epi32,
+            _mm_add_epi32, _mm_xor_si128, _mm_or_si128, _mm_and_si128, _mm_andnot_si128,
+            _mm_srli_epi32, _mm_slli_epi32)
+        PICOSHA2_SIMD_KERNEL(compress_avx2, PICOSHA2_TARGET_AVX2, __m256i, 8,
+            _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi32,
+            _mm256_add_epi32, _mm256_xor_si256, _mm256_or_si256, _mm256_and_si256, _mm256_andnot_si256,
+            _mm256_srli_epi32, _mm256_slli_epi32)
+#undef PICOSHA2_SIMD_KERNEL
+
+        inline bool cpu_has_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+            int r[4];
+            __cpuid(r, 0);
+            if (r[0] < 7) return false;
+            __cpuid(r, 1);
+            bool osxsave = (r[2] & (1 << 27)) != 0, avx = (r[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+            __cpuidex(r, 7, 0);
+            return (r[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+        inline bool cpu_has_sse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+            return true;
+#elif defined(_MSC_VER) && !defined(__clang__)
+            int r[4];
+            __cpuid(r, 1);
+            return (r[3] & (1 << 26)) != 0;
+#else
+            return __builtin_cpu_supports("sse2");
+#endif
+        }
+#endif // PICOSHA2_X86
+
+        inline void compress_scalar(uint32 st[8][1], const byte_t* const blocks[1]) {
+            uint32 h[8];
+            for (int j = 0; j < 8; ++j) h[j] = st[j][0];
+            compress(h, blocks[0]);
+            for (int j = 0; j < 8; ++j) st[j][0] = h[j];
+        }
+    } // namespace detail
+
+    enum class batch_kernel { scalar, sse2, avx2 };
+
+    // Best kernel this CPU supports; detected once.
+    inline batch_kernel detect_batch_kernel() {
+#ifdef PICOSHA2_X86
+        static const batch_kernel best = detail::cpu_has_avx2() ? batch_kernel::avx2
+                                       : detail::cpu_has_sse2() ? batch_kernel::sse2
+                                                                : batch_kernel::scalar;
+        return best;
+#else
+        return batch_kernel::scalar;
+#endif
+    }
+
+    // Hashes n independent messages; out receives 32 bytes per message.
+    inline void hash256_batch(const std::string_view* msgs, size_t n, byte_t* out,
+                              batch_kernel kernel = detect_batch_kernel()) {
+#ifdef PICOSHA2_X86
+        if (kernel == batch_kernel::avx2) { detail::hash_lanes<8>(msgs, n, out, detail::compress_avx2); return; }
+        if (kernel == batch_kernel::sse2) { detail::hash_lanes<4>(msgs, n, out, detail::compress_sse2); return; }
+#endif
+        (void)kernel;
+        detail::hash_lanes<1>(msgs, n, out, detail::compress_scalar);
+    }
+
+    // Batch variant of hash256_hex_string; hex[i] receives the digest of msgs[i].
+    inline void hash256_hex_batch(const std::string_view* msgs, size_t n, std::string* hex,
+                                  batch_kernel kernel = detect_batch_kernel()) {
+        byte_t digests[8 * 32];
+        for (size_t base = 0; base < n; base += 8) {
+            size_t m = n - base < 8 ? n - base : 8;
+            hash256_batch(msgs + base, m, digests, kernel);
+            for (size_t i = 0; i < m; ++i) {
+                hex[base + i].resize(64);
+                bytes_to_hex(digests + 32 * i, 32, &hex[base + i][0]);
+            }
+        }
+    }
 }
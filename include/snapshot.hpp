@@ -0,0 +1,134 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <tuple>
+#include <optional>
+#include <filesystem>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+#include "money.hpp"
+
+// Binary account snapshot (data/accounts.snap), native byte order:
+//   header   Header
+//   records  Record[count], sorted by username
+//   pool     username and password-hash bytes referenced by the records
+// The file is memory-mapped and read in place; nothing is parsed up front.
+namespace snapshot {
+
+constexpr char kMagic[8] = {'B','A','N','K','S','N','P','1'};
+
+struct Header {
+    char magic[8];
+    std::uint64_t count;
+    std::uint64_t pool_size;
+};
+
+struct Record {
+    std::uint64_t name_off;
+    std::uint64_t hash_off;
+    std::uint32_t name_len;
+    std::uint32_t hash_len;
+    std::int64_t balance_cents;
+};
+
+// username, password hash, balance
+using Row = std::tuple<std::string, std::string, Money>;
+
+// Read-only mapping of a whole file (mmap on POSIX, a heap copy elsewhere).
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::filesystem::path& path, std::string& err);
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const char* data_{nullptr};
+    std::size_t size_{0};
+    bool mapped_{false};
+    std::vector<char> copy_;
+};
+
+class View {
+public:
+    bool open(const std::filesystem::path& path, std::string& err);
+
+    std::size_t size() const { return count_; }
+    std::string_view username(std::size_t i) const { return str(records_[i].name_off, records_[i].name_len); }
+    std::string_view password_hash(std::size_t i) const { return str(records_[i].hash_off, records_[i].hash_len); }
+    Money balance(std::size_t i) const { return Money::from_cents(records_[i].balance_cents); }
+
+    // Binary search over the sorted record array.
+    std::optional<std::size_t> find(std::string_view username) const;
+
+private:
+    std::string_view str(std::uint64_t off, std::uint32_t len) const {
+        if (off > pool_size_ || len > pool_size_ - off) return {};
+        return std::string_view(pool_ + off, len);
+    }
+
+    MappedFile file_;
+    const Record* records_{nullptr};
+    std::size_t count_{0};
+    const char* pool_{nullptr};
+    std::uint64_t pool_size_{0};
+};
+
+bool is_binary(const std::filesystem::path& path);
+
+// Writes rows (sorted here) to path via a temp file and atomic rename.
+bool write_binary(const std::filesystem::path& path, std::vector<Row> rows, std::string& err);
+bool write_text(const std::filesystem::path& path, const std::vector<Row>& rows, std::string& err);
+
+// Splits one text snapshot line (username|hash|balance, no newline); false if malformed.
+inline bool parse_text_line(std::string_view line, std::string_view& username, std::string_view& hash, Money& bal) {
+    std::size_t p1 = line.find('|');
+    std::size_t p2 = p1 == std::string_view::npos ? p1 : line.find('|', p1 + 1);
+    if (p2 == std::string_view::npos || !Money::parse_lenient(line.substr(p2 + 1), bal)) return false;
+    username = line.substr(0, p1);
+    hash = line.substr(p1 + 1, p2 - p1 - 1);
+    return true;
+}
+
+// Calls apply(username, hash, balance) for each well-formed line of a text snapshot.
+// Returns false if the file cannot be opened.
+template <typename F>
+bool read_text(const std::filesystem::path& path, F&& apply) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    std::string_view username, hash;
+    Money bal;
+    while (std::getline(in, line)) {
+        if (line.empty() || !parse_text_line(line, username, hash, bal)) continue; // skip malformed
+        apply(std::string(username), std::string(hash), bal);
+    }
+    return true;
+}
+
+// Calls apply(username, hash, balance) for each well-formed line of text, which holds whole
+// lines of a text snapshot (for example one piece of parallel::split_lines).
+template <typename F>
+void parse_text(std::string_view text, F&& apply) {
+    std::string_view username, hash;
+    Money bal;
+    while (!text.empty()) {
+        std::size_t nl = text.find('\n');
+        std::string_view line = text.substr(0, nl);
+        text.remove_prefix(nl == std::string_view::npos ? text.size() : nl + 1);
+        if (!line.empty() && parse_text_line(line, username, hash, bal)) apply(username, hash, bal);
+    }
+}
+
+// Converters between the pipe-delimited accounts.db format and the binary format.
+bool text_to_binary(const std::filesystem::path& in, const std::filesystem::path& out, std::string& err);
+bool binary_to_text(const std::filesystem::path& in, const std::filesystem::path& out, std::string& err);
+
+} // namespace snapshot
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+// Transaction timestamps: microseconds since the Unix epoch, kept as an integer in memory and
+// turned into local-time ISO 8601 ("2025-01-31T09:15:00.123456") only for logs and display.
+// Older logs carry whole seconds ("2025-01-31T09:15:00"); both forms parse.
+//
+// Formatting and parsing cache per thread the part that needs the C library's time zone code
+// (localtime_r / mktime take a global lock in glibc): the formatted second, and the epoch of
+// the parsed hour. Records written in the same second or read from the same hour skip it.
+namespace timestamp {
+
+using Micros = std::int64_t;
+
+// The current time, strictly increasing across the process: two calls never return the same
+// value, so a timestamp also orders commits that land in the same microsecond. (A commit's
+// records share its value; see Transaction::timestamp.)
+Micros next();
+
+// Appends t as YYYY-MM-DDThh:mm:ss.ffffff (local time).
+void append_iso(std::string& out, Micros t);
+std::string iso(Micros t);
+
+// Parses YYYY-MM-DDThh:mm:ss with an optional .fraction (local time); false if malformed.
+bool parse(std::string_view s, Micros& t);
+
+} // namespace timestamp
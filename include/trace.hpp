@@ -0,0 +1,173 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <chrono>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+#include "account.hpp"
+#include "money.hpp"
+#include "transaction.hpp"
+#include "snapshot.hpp"
+
+// Workload traces: the sequence of Bank API calls a process made, with arguments, timing and
+// outcomes, in a compact binary file that tools/bank_replay.cpp runs again against a fresh data
+// directory.
+//
+// File layout: the magic "BKTRACE1", the accounts that existed when recording started (name,
+// password digest, balance, history length), then one record per call in completion order, and an End record
+// with a checksum of the final balances. Integers are LEB128 varints (signed ones zigzagged),
+// and every username or error string is written once and referred to by number afterwards.
+//
+// Passwords are never written. A trace keeps the SHA-256 of each password (what accounts.db
+// stores anyway) plus its length, and a replay logs in with the hex form of that digest
+// (replay_password); seeded accounts get the matching digest (replay_digest). A failed login
+// keeps only the length: its digest would be a hash of whatever was typed, which is often a
+// mistyped or someone else's password.
+namespace trace {
+
+enum class Call : std::uint8_t {
+    CreateAccount = 1, // user, password, amount (initial balance)
+    Authenticate,      // user, password
+    Deposit,           // user, amount
+    Withdraw,          // user, amount
+    Transfer,          // user -> other, amount
+    ApplyBatch,        // postings; result = fingerprint of the leg balances
+    BalanceOf,         // user; result = balance in cents
+    HistorySize,       // user; result = record count
+    History,           // user, offset, limit; result = fingerprint of the records
+    RecentHistory,     // user, limit; result = fingerprint of the records
+    HistoryRange,      // user, from_ts, to_ts, limit; result = fingerprint of the records
+    SetDeferred,       // ok = on
+    Commit,
+    End,               // offset = accounts, result = state checksum (written by Recorder::close)
+};
+
+const char* name(Call call);
+
+struct Leg {
+    std::string from;
+    std::string to;
+    Money amount;
+};
+
+struct Event {
+    Call call = Call::End;
+    std::int64_t at_us = 0;       // since recording began
+    std::uint64_t latency_ns = 0; // as recorded
+    std::string user;
+    std::string other;
+    PasswordDigest password{};    // SHA-256 of the password; all zero for a failed Authenticate
+    std::uint8_t password_len = 0; // clamped to 255; digest unused below 4 (always rejected)
+    Money amount;
+    std::uint64_t offset = 0;
+    std::uint64_t limit = 0;
+    std::string from_ts, to_ts;   // HistoryRange bounds, as passed
+    std::vector<Leg> legs;
+    bool ok = false;
+    std::string err;
+    std::uint64_t result = 0;
+};
+
+struct Account {
+    std::string username;
+    PasswordDigest digest;
+    Money balance;
+    std::uint64_t history = 0; // records already in the account's log; the trace does not hold them
+};
+
+// What a replay passes as the password for a recorded one, and the stored digest that makes
+// it match for an account seeded from the trace. The all-zero digest of a failed login gives a
+// password that matches no seeded account, so the replayed login fails as well.
+std::string replay_password(const PasswordDigest& digest, std::uint8_t len);
+PasswordDigest replay_digest(const PasswordDigest& digest);
+
+// Order-independent: combine per-account values with state_add, starting from 0.
+std::uint64_t state_add(std::uint64_t sum, std::string_view username, Money balance);
+// Over type, amount and balance of each record (ids and timestamps differ between runs).
+std::uint64_t fingerprint(const std::vector<Transaction>& records);
+std::uint64_t fingerprint(const std::vector<std::pair<Money, Money>>& leg_balances);
+
+// Appends events to a trace file. Thread-safe; events are encoded into a buffer under a mutex
+// and written out in large blocks.
+class Recorder {
+public:
+    // Writes the header and the starting accounts. Throws std::runtime_error on I/O errors.
+    Recorder(const std::filesystem::path& path, const std::vector<Account>& initial);
+    ~Recorder(); // close() with no End record if it was not called
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    void record(Event& e); // sets e.at_us
+    // Writes the End record and closes the file; later events are dropped.
+    void close(std::size_t accounts, std::uint64_t checksum);
+    std::uint64_t events() const;
+
+private:
+    void put_string(std::string_view s);
+    void flush_locked();
+
+    mutable std::mutex mu_;
+    std::FILE* file_ = nullptr;
+    std::string buf_;
+    std::unordered_map<std::string, std::uint64_t> strings_;
+    std::chrono::steady_clock::time_point start_;
+    std::int64_t last_us_ = 0;
+    std::uint64_t events_ = 0;
+};
+
+// Reads a trace back, streaming the events.
+class Reader {
+public:
+    bool open(const std::filesystem::path& path, std::string& err);
+    const std::vector<Account>& initial() const { return initial_; }
+    // False at the end of the file; err is set if the file is cut short or malformed.
+    bool next(Event& e, std::string& err);
+
+private:
+    bool get_string(std::string& out);
+    bool get_varint(std::uint64_t& v);
+    bool get_money(Money& m);
+
+    snapshot::MappedFile file_;
+    std::string_view data_;
+    std::size_t pos_ = 0;
+    std::vector<std::string> strings_;
+    std::vector<Account> initial_;
+    std::int64_t last_us_ = 0;
+};
+
+// Records one Bank call, in the manner of metrics::OpScope: event() is null unless recording,
+// and the call counts as failed with *err as the reason unless succeed() is called.
+class Scope {
+public:
+    Scope(Recorder* rec, Call call, const std::string* err = nullptr)
+        : rec_(rec), err_(err) {
+        if (rec_) { event_.call = call; t0_ = std::chrono::steady_clock::now(); }
+    }
+    ~Scope() {
+        if (!rec_) return;
+        event_.latency_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0_).count());
+        if (!event_.ok && err_) event_.err = *err_;
+        rec_->record(event_);
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    Event* event() { return rec_ ? &event_ : nullptr; }
+    void succeed() { event_.ok = true; }
+
+private:
+    Recorder* rec_;
+    const std::string* err_;
+    Event event_;
+    std::chrono::steady_clock::time_point t0_;
+};
+
+} // namespace trace
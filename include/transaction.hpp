@@ -1,27 +1,97 @@
 #pragma once
 #include <string>
-#include <chrono>
-#include <ctime>
+#include <string_view>
+#include <cstdint>
+
+#include "money.hpp"
+#include "account.hpp"
+#include "timestamp.hpp"
+
+// Adjustment: a ledger repair (ledger::verify); its amount is the signed change in balance.
+enum class TxType : std::uint8_t { Deposit, Withdraw, TransferOut, TransferIn, InitialDeposit, Adjustment };
 
 struct Transaction {
-    std::string timestamp;   // ISO 8601
-    std::string type;        // DEPOSIT, WITHDRAW, TRANSFER_OUT, TRANSFER_IN
-    double amount{0.0};
-    double balance_after{0.0};
-    std::string details;     // e.g., to/from user
+    // Unique per commit, not per record: both legs of a transfer and every record of a batch
+    // share one timestamp::next() value. Records of one account keep their order in the log.
+    timestamp::Micros timestamp = 0;
+    TxType type;
+    Money amount;
+    Money balance_after;
+    AccountId counterparty = kNoAccount; // other side of a transfer
 };
 
-inline std::string current_timestamp_iso() {
-    using namespace std::chrono;
-    auto now = system_clock::now();
-    std::time_t t = system_clock::to_time_t(now);
-    std::tm tm{};
-#ifdef _WIN32
-    localtime_s(&tm, &t);
-#else
-    localtime_r(&t, &tm);
-#endif
-    char buf[32];
-    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
-    return std::string(buf);
+// Type column of the log line. The opening deposit is logged as DEPOSIT and told apart by its details.
+inline const char* to_string(TxType type) {
+    switch (type) {
+        case TxType::Deposit: return "DEPOSIT";
+        case TxType::Withdraw: return "WITHDRAW";
+        case TxType::TransferOut: return "TRANSFER_OUT";
+        case TxType::TransferIn: return "TRANSFER_IN";
+        case TxType::InitialDeposit: return "DEPOSIT";
+        case TxType::Adjustment: return "ADJUST";
+    }
+    return "UNKNOWN";
+}
+
+// Details column: "Cash deposit", "To bob", ...
+inline void append_details(std::string& out, TxType type, std::string_view counterparty) {
+    switch (type) {
+        case TxType::Deposit: out += "Cash deposit"; break;
+        case TxType::Withdraw: out += "Cash withdrawal"; break;
+        case TxType::TransferOut: out += "To "; out += counterparty; break;
+        case TxType::TransferIn: out += "From "; out += counterparty; break;
+        case TxType::InitialDeposit: out += "Initial deposit"; break;
+        case TxType::Adjustment: out += "Ledger adjustment"; break;
+    }
+}
+
+inline std::string describe(TxType type, std::string_view counterparty) {
+    std::string s;
+    append_details(s, type, counterparty);
+    return s;
+}
+
+// Appends one log line, newline included: timestamp|type|amount|balance_after|details
+inline void append_transaction_line(std::string& out, const Transaction& tx, std::string_view counterparty) {
+    timestamp::append_iso(out, tx.timestamp); out += '|'; out += to_string(tx.type); out += '|';
+    tx.amount.append_to(out); out += '|';
+    tx.balance_after.append_to(out); out += '|';
+    append_details(out, tx.type, counterparty); out += '\n';
+}
+
+// Parses one log line: timestamp|type|amount|balance_after|details
+// tx.counterparty is left unset; for transfers the counterparty's username is returned in
+// counterparty (a view into line), to be resolved to an id by the caller.
+inline bool parse_transaction_line(const std::string& line, Transaction& tx, std::string_view& counterparty) {
+    std::size_t p[4];
+    std::size_t pos = 0;
+    for (int i = 0; i < 4; ++i) {
+        p[i] = line.find('|', pos);
+        if (p[i] == std::string::npos) return false;
+        pos = p[i] + 1;
+    }
+    std::string_view v(line);
+    std::string_view type = v.substr(p[0] + 1, p[1] - p[0] - 1);
+    std::string_view details = v.substr(p[3] + 1);
+    counterparty = {};
+    if (type == "DEPOSIT") {
+        tx.type = details == "Initial deposit" ? TxType::InitialDeposit : TxType::Deposit;
+    } else if (type == "WITHDRAW") {
+        tx.type = TxType::Withdraw;
+    } else if (type == "TRANSFER_OUT" && details.substr(0, 3) == "To ") {
+        tx.type = TxType::TransferOut;
+        counterparty = details.substr(3);
+    } else if (type == "TRANSFER_IN" && details.substr(0, 5) == "From ") {
+        tx.type = TxType::TransferIn;
+        counterparty = details.substr(5);
+    } else if (type == "ADJUST") {
+        tx.type = TxType::Adjustment;
+    } else {
+        return false;
+    }
+    if (!Money::parse_lenient(v.substr(p[1] + 1, p[2] - p[1] - 1), tx.amount) ||
+        !Money::parse_lenient(v.substr(p[2] + 1, p[3] - p[2] - 1), tx.balance_after)) return false;
+    if (!timestamp::parse(v.substr(0, p[0]), tx.timestamp)) return false;
+    tx.counterparty = kNoAccount;
+    return true;
 }
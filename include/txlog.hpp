@@ -0,0 +1,143 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+#include "transaction.hpp"
+#include "history.hpp"
+#include "segment_store.hpp"
+#include "metrics.hpp"
+
+enum class FsyncPolicy {
+    None,          // leave flushing to the OS
+    PerBatch,      // one fsync per touched file per batch
+    PerTransaction // fsync after every record
+};
+
+enum class LogLayout {
+    PerUser,  // data/transactions/<user>.log + <user>.idx
+    Segmented // shared segments rolled into compressed archives; see SegmentStore
+};
+
+struct TxLogOptions {
+    std::size_t max_batch = 256;              // flush once this many records are pending
+    std::chrono::milliseconds max_delay{5};   // ...or once the oldest pending record is this old
+    FsyncPolicy fsync = FsyncPolicy::None;
+    std::size_t max_open_files = 64;          // cached per-user log handles
+    LogLayout layout = LogLayout::PerUser;
+    SegmentOptions segments;                  // LogLayout::Segmented only
+};
+
+// Group-commit writer for the transaction logs under data/transactions.
+// append() only queues the record; a background thread writes queued records in batches,
+// keeping per-user files (or the active segment) open between batches.
+// A batch that cannot be written in full (a file that will not open, a short write, a failed
+// flush or fsync) is never acknowledged: the writer records the error and stops counting
+// records durable, so wait_durable() and flush() report the failure from then on.
+class TxLogWriter {
+public:
+    using Ticket = std::uint64_t;
+
+    // metrics, if given, counts failed segment rollovers and compactions under Op::Compact;
+    // the writer otherwise just retries them on the next batch.
+    TxLogWriter(std::filesystem::path dir, TxLogOptions opts, metrics::Registry* metrics = nullptr);
+    ~TxLogWriter();
+    TxLogWriter(const TxLogWriter&) = delete;
+    TxLogWriter& operator=(const TxLogWriter&) = delete;
+
+    struct Record {
+        std::string username;
+        Transaction tx;
+        std::string counterparty;
+    };
+
+    // counterparty: username on the other side of a transfer (ids do not survive a reload).
+    Ticket append(const std::string& username, const Transaction& tx, std::string_view counterparty = {});
+    // Queues all of records at once, so they go out in the same batch; returns the last ticket.
+    Ticket append_all(std::vector<Record>& records);
+    // Blocks until the record identified by the ticket is written (and synced, per policy).
+    // False if a write failed first; error() says why.
+    bool wait_durable(Ticket t);
+    // Writes everything queued so far without waiting for the batch deadline. False if a
+    // write failed, now or earlier.
+    bool flush();
+    Ticket last_ticket() const;
+    // Empty until a batch fails to be written.
+    std::string error() const;
+
+    std::filesystem::path log_path(const std::string& username) const { return dir_ / (username + ".log"); }
+    std::filesystem::path index_path(const std::string& username) const { return dir_ / (username + ".idx"); }
+
+    // Flushes queued records, brings <user>.idx up to date with <user>.log, and returns a lock
+    // that keeps the writer away from the files while the caller reads them (PerUser only).
+    std::unique_lock<std::mutex> read_lock(const std::string& username);
+
+    // History reads for either layout; each one flushes queued records first.
+    std::size_t count(const std::string& username);
+    // Position of the first record with ts_key >= key (> key when upper is set).
+    std::size_t lower_bound(const std::string& username, std::int64_t key, bool upper = false);
+    std::vector<Transaction> read(const std::string& username, std::size_t first, std::size_t limit,
+                                  const std::function<AccountId(std::string_view)>& resolve);
+    // Calls fn(username, stream) for every account with a log, on up to `threads` threads,
+    // concurrently for different accounts. Returns the number of accounts.
+    std::size_t for_each_account(unsigned threads,
+                                 const std::function<void(const std::string&, const history::AccountStream&)>& fn);
+
+    // Segmented layout: seals the active segment and archives all but the hot ones now.
+    // False (with err) on failure, or when the layout is PerUser.
+    bool compact(std::string& err);
+    // Null for the PerUser layout.
+    const SegmentStore* segments() const { return store_.get(); }
+
+private:
+    // A user's log plus its history index, kept open between batches.
+    struct OpenLog {
+        std::FILE* log{nullptr};
+        std::FILE* idx{nullptr};
+        std::uint64_t size{0}; // current end of the log = offset of the next record
+    };
+
+    void run();
+    bool write_batch(std::vector<Record>& batch, std::string& err);
+    OpenLog* file_for(const std::string& username, std::string& err);
+    bool sync_touched(std::string& err);
+    bool maintain(bool force, std::string& err);
+    void drop_file(const std::string& username);
+    void close_files();
+
+    std::filesystem::path dir_;
+    TxLogOptions opts_;
+    metrics::Registry* metrics_;
+
+    mutable std::mutex mu_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::vector<Record> queue_;
+    std::chrono::steady_clock::time_point oldest_;
+    Ticket appended_{0};
+    Ticket durable_{0};
+    Ticket flush_to_{0};
+    bool stop_{false};
+    std::string error_; // first write failure; durable_ stays put once set
+
+    // Held while writing a batch or reading history; guards everything below.
+    std::mutex io_mu_;
+    std::unordered_map<std::string, OpenLog> files_;
+    std::unordered_set<OpenLog*> touched_;
+    std::string line_;
+
+    std::unique_ptr<SegmentStore> store_; // LogLayout::Segmented
+
+    std::thread worker_;
+};
@@ -3,8 +3,11 @@
 #include <filesystem>
 #include <iostream>
 #include <limits>
+#include <cstdio>
+#include <fcntl.h>
 #ifdef _WIN32
 #include <conio.h>
+#include <io.h>
 #endif
 #ifndef _WIN32
 #include <termios.h>
@@ -44,6 +47,36 @@ namespace utils {
         return password;
     }
 
+    // Pushes a stdio stream's buffered bytes to the OS and then to stable storage.
+    inline bool fsync_file(std::FILE* f) {
+        if (std::fflush(f) != 0) return false;
+#ifdef _WIN32
+        return _commit(_fileno(f)) == 0;
+#else
+        return fsync(fileno(f)) == 0;
+#endif
+    }
+
+    // fsync by name, for files written through a stream without a descriptor of its own, and
+    // for directories (so a rename or unlink in them is durable). Directories are a no-op on
+    // Windows, which has no such call.
+    inline bool fsync_path(const std::filesystem::path& p) {
+#ifdef _WIN32
+        if (std::filesystem::is_directory(p)) return true;
+        int fd = _wopen(p.c_str(), _O_WRONLY | _O_BINARY);
+        if (fd < 0) return false;
+        bool ok = _commit(fd) == 0;
+        _close(fd);
+        return ok;
+#else
+        int fd = ::open(p.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        bool ok = fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+#endif
+    }
+
     inline void clear_input() {
         std::cin.clear();
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -0,0 +1,119 @@
+#include "account.hpp"
+
+#include <functional>
+#include <stdexcept>
+
+bool digest_from_hex(std::string_view hex, PasswordDigest& out) {
+    if (hex.size() != 64) return false;
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    };
+    for (std::size_t i = 0; i < 32; ++i) {
+        int hi = nibble(hex[2 * i]), lo = nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[i] = static_cast<std::uint8_t>(hi << 4 | lo);
+    }
+    return true;
+}
+
+void digest_to_hex(const PasswordDigest& digest, char* out) {
+    static const char kHex[] = "0123456789abcdef";
+    for (std::size_t i = 0; i < 32; ++i) {
+        out[2 * i] = kHex[digest[i] >> 4];
+        out[2 * i + 1] = kHex[digest[i] & 0xf];
+    }
+}
+
+std::string digest_to_hex(const PasswordDigest& digest) {
+    std::string hex(64, '\0');
+    digest_to_hex(digest, &hex[0]);
+    return hex;
+}
+
+std::uint64_t AccountTable::hash(std::string_view s) {
+    // Bank picks the shard from the low bits of std::hash, so mix before using them here.
+    std::uint64_t h = std::hash<std::string_view>{}(s);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+std::uint32_t AccountTable::find(std::string_view username) const {
+    if (buckets_.empty()) return npos;
+    std::size_t mask = buckets_.size() - 1;
+    for (std::size_t i = hash(username) & mask;; i = (i + 1) & mask) {
+        std::uint32_t slot = buckets_[i];
+        if (slot == npos) return npos;
+        if (this->username(slot) == username) return slot;
+    }
+}
+
+std::uint32_t AccountTable::insert(std::string_view username, const PasswordDigest& digest, Money balance) {
+    if (size() == npos - 1 || username.size() > UINT32_MAX / kPageSize) throw std::length_error("AccountTable is full");
+    if ((static_cast<std::size_t>(size()) + 1) * 10 > buckets_.size() * 7) grow();
+
+    auto slot = size();
+    std::uint32_t i = slot & kPageMask;
+    if (i == 0) {
+        names_.push_back(std::make_shared<NamePage>());
+        digests_.push_back(std::make_shared<DigestPage>());
+        balances_.push_back(std::make_shared<BalancePage>());
+    }
+    NamePage* names = writable(names_.back());
+    names->arena.append(username.data(), username.size());
+    names->ends[i] = static_cast<std::uint32_t>(names->arena.size());
+    writable(digests_.back())->digests[i] = digest;
+    writable(balances_.back())->balances[i] = balance;
+    ++size_;
+
+    std::size_t mask = buckets_.size() - 1;
+    std::size_t b = hash(username) & mask;
+    while (buckets_[b] != npos) b = (b + 1) & mask;
+    buckets_[b] = slot;
+    return slot;
+}
+
+void AccountTable::grow() {
+    buckets_.assign(buckets_.empty() ? 16 : buckets_.size() * 2, npos);
+    std::size_t mask = buckets_.size() - 1;
+    for (std::uint32_t slot = 0; slot < size(); ++slot) {
+        std::size_t i = hash(username(slot)) & mask;
+        while (buckets_[i] != npos) i = (i + 1) & mask;
+        buckets_[i] = slot;
+    }
+}
+
+void AccountTable::reserve(std::size_t n) {
+    names_.reserve((n + kPageSize - 1) / kPageSize);
+    digests_.reserve((n + kPageSize - 1) / kPageSize);
+    balances_.reserve((n + kPageSize - 1) / kPageSize);
+    while (n * 10 > buckets_.size() * 7) grow();
+}
+
+void AccountTable::clear() {
+    size_ = 0;
+    names_.clear();
+    digests_.clear();
+    balances_.clear();
+    buckets_.clear();
+}
+
+AccountTable::Frozen AccountTable::freeze() const {
+    Frozen f;
+    f.size_ = size_;
+    f.names_.assign(names_.begin(), names_.end());
+    f.digests_.assign(digests_.begin(), digests_.end());
+    f.balances_.assign(balances_.begin(), balances_.end());
+    return f;
+}
+
+std::size_t AccountTable::memory_bytes() const {
+    std::size_t bytes = (names_.capacity() + digests_.capacity() + balances_.capacity()) * sizeof(names_[0]) +
+                        digests_.size() * sizeof(DigestPage) + balances_.size() * sizeof(BalancePage) +
+                        buckets_.capacity() * sizeof(std::uint32_t);
+    for (const auto& page : names_) bytes += sizeof(NamePage) + page->arena.capacity();
+    return bytes;
+}
@@ -1,178 +1,1138 @@
 #include "bank.hpp"
+#include "parallel.hpp"
 #include "utils.hpp"
 
 #include <algorithm>
+#include <unordered_map>
 
-Bank::Bank() {
-    std::filesystem::create_directories(tx_dir_);
+using metrics::Op;
+using metrics::Stage;
+
+Bank::Bank(BankOptions opts)
+    : opts_(std::move(opts)),
+      db_path_(opts_.data_dir / "accounts.db"),
+      snap_path_(opts_.data_dir / "accounts.snap"),
+      tx_dir_(opts_.data_dir / "transactions"),
+      journal_(opts_.data_dir / "accounts.journal"),
+      tx_log_(tx_dir_, opts_.txlog, &metrics_) {
+    journal_.set_sync(opts_.sync_journal);
 }
 
-bool Bank::create_account(const std::string& username, const std::string& password, double initial_balance, std::string& err) {
+Bank::~Bank() {
+    try {
+        stop_recording();
+    } catch (...) {
+        // The trace just lacks its End record.
+    }
+    {
+        std::lock_guard<std::mutex> lk(checkpoint_mu_);
+        wait_checkpoint(); // may be waiting for the queue to reach its journal rotation
+    }
+    stop_persist_queue();
+}
+
+bool Bank::create_account(const std::string& username, const std::string& password, Money initial_balance, std::string& err) {
+    metrics::OpScope op(metrics_, Op::CreateAccount, &err);
+    trace::Scope tr(recorder_.get(), trace::Call::CreateAccount, &err);
+    if (trace::Event* e = tr.event()) {
+        e->user = username;
+        e->password_len = static_cast<std::uint8_t>(std::min<std::size_t>(password.size(), 255));
+        e->amount = initial_balance;
+    }
     // Validation
-    if (username.size() < 3) { err = "Username must be at least 3 characters."; return false; }
+    if (!valid_username(username, err)) return false;
     if (password.size() < 4) { err = "Password must be at least 4 characters."; return false; }
-    if (initial_balance < 0.0) { err = "Initial balance cannot be negative."; return false; }
-    if (accounts_.count(username)) { err = "Username already exists."; return false; }
+    if (initial_balance < Money()) { err = "Initial balance cannot be negative."; return false; }
 
-    std::string hash = hash_password(password);
-    Account acc(username, hash, initial_balance);
+    PasswordDigest digest;
+    {
+        metrics::ScopedTimer t(metrics_.stage(Stage::Hash));
+        digest = digest_password(password);
+    }
+    if (trace::Event* e = tr.event()) e->password = digest;
+    {
+        Shard& shard = shard_for(username);
+        auto lk = lock_exclusive(shard);
+        bool exists;
+        {
+            metrics::ScopedTimer t(metrics_.stage(Stage::Lookup));
+            exists = view_locked(shard, username).has_value();
+        }
+        if (exists) { err = "Username already exists."; return false; }
 
-    // Log initial deposit if any
-    if (initial_balance > 0.0) {
-        Transaction tx{current_timestamp_iso(), "DEPOSIT", initial_balance, initial_balance, "Initial deposit"};
-        acc.add_transaction(tx);
-        log_transaction(username, tx);
+        std::uint32_t slot = shard.accounts.insert(username, digest, initial_balance);
+        index_insert_locked(shard, slot);
+
+        // Log initial deposit if any
+        if (initial_balance > Money()) {
+            Transaction tx{timestamp::next(), TxType::InitialDeposit, initial_balance, initial_balance};
+            log_transaction(username, tx);
+        }
+
+        persist(shard, slot);
     }
+    after_mutation();
+    tr.succeed();
+    return op.succeed();
+}
 
-    accounts_.emplace(username, acc);
-    save();
+bool Bank::valid_username(std::string_view username, std::string& err) {
+    if (username.size() < 3) { err = "Username must be at least 3 characters."; return false; }
+    if (username.size() > kMaxUsername) { err = "Username must be at most " + std::to_string(kMaxUsername) + " characters."; return false; }
+    for (char c : username) {
+        if (static_cast<unsigned char>(c) <= ' ' || c == 0x7f) {
+            err = "Username may not contain spaces or control characters.";
+            return false;
+        }
+        if (c == '|' || c == '/' || c == '\\' || c == ',' || c == '"') {
+            err = std::string("Username may not contain '") + c + "'.";
+            return false;
+        }
+    }
     return true;
 }
 
-std::optional<Account> Bank::authenticate(const std::string& username, const std::string& password) {
-    auto it = accounts_.find(username);
-    if (it == accounts_.end()) return std::nullopt;
-    if (it->second.password_hash() != hash_password(password)) return std::nullopt;
+std::optional<Session> Bank::authenticate(const std::string& username, const std::string& password) {
+    static const std::string kRejected = "Invalid username or password.";
+    metrics::OpScope op(metrics_, Op::Authenticate, &kRejected);
+    trace::Scope tr(recorder_.get(), trace::Call::Authenticate, &kRejected);
+    PasswordDigest digest;
+    {
+        metrics::ScopedTimer t(metrics_.stage(Stage::Hash));
+        digest = digest_password(password);
+    }
+    if (trace::Event* e = tr.event()) {
+        e->user = username;
+        e->password = digest; // dropped by the recorder unless the login succeeds
+        e->password_len = static_cast<std::uint8_t>(std::min<std::size_t>(password.size(), 255));
+    }
+    std::size_t idx = shard_index(username);
+    Shard& shard = shards_[idx];
+    {
+        std::shared_lock<std::shared_mutex> lk(shard.mu);
+        auto acc = view_locked(shard, username);
+        if (!acc || acc->digest != digest) return std::nullopt;
+        std::uint32_t slot = shard.accounts.find(username);
+        if (slot != AccountTable::npos) { tr.succeed(); op.succeed(); return Session{make_id(idx, slot), username}; }
+    }
+    // Still only in the mapped snapshot: give it a slot so the session has a stable id.
+    auto lk = lock_exclusive(shard);
+    std::uint32_t slot = materialize_locked(shard, username);
+    if (slot == AccountTable::npos) return std::nullopt;
+    tr.succeed();
+    op.succeed();
+    return Session{make_id(idx, slot), username};
+}
+
+bool Bank::deposit(const std::string& username, Money amount, std::string& err, Money* balance_after) {
+    metrics::OpScope op(metrics_, Op::Deposit, &err);
+    trace::Scope tr(recorder_.get(), trace::Call::Deposit, &err);
+    if (trace::Event* e = tr.event()) { e->user = username; e->amount = amount; }
+    if (amount <= Money()) { err = "Amount must be positive."; return false; }
+    {
+        Shard& shard = shard_for(username);
+        auto lk = lock_exclusive(shard);
+        std::uint32_t slot;
+        {
+            metrics::ScopedTimer t(metrics_.stage(Stage::Lookup));
+            slot = materialize_locked(shard, username);
+        }
+        if (slot == AccountTable::npos) { err = "Account not found."; return false; }
+        Money balance = shard.accounts.balance(slot);
+
+        Money new_bal;
+        if (!Money::add(balance, amount, new_bal)) { err = "Amount too large."; return false; }
+        set_balance_locked(shard, slot, new_bal);
+        Transaction tx{timestamp::next(), TxType::Deposit, amount, new_bal};
+        log_transaction(username, tx);
+        persist(shard, slot);
+        if (balance_after) *balance_after = new_bal;
+    }
+    after_mutation();
+    tr.succeed();
+    return op.succeed();
+}
+
+bool Bank::withdraw(const std::string& username, Money amount, std::string& err, Money* balance_after) {
+    metrics::OpScope op(metrics_, Op::Withdraw, &err);
+    trace::Scope tr(recorder_.get(), trace::Call::Withdraw, &err);
+    if (trace::Event* e = tr.event()) { e->user = username; e->amount = amount; }
+    if (amount <= Money()) { err = "Amount must be positive."; return false; }
+    {
+        Shard& shard = shard_for(username);
+        auto lk = lock_exclusive(shard);
+        std::uint32_t slot;
+        {
+            metrics::ScopedTimer t(metrics_.stage(Stage::Lookup));
+            slot = materialize_locked(shard, username);
+        }
+        if (slot == AccountTable::npos) { err = "Account not found."; return false; }
+        Money balance = shard.accounts.balance(slot);
+        if (balance < amount) { err = "Insufficient funds."; return false; }
 
-    // Return a copy with history loaded from file
-    Account acc = it->second;
-    load_transactions_for(username, acc);
-    return acc;
+        Money new_bal;
+        Money::sub(balance, amount, new_bal); // cannot underflow: balance >= amount > 0
+        set_balance_locked(shard, slot, new_bal);
+        Transaction tx{timestamp::next(), TxType::Withdraw, amount, new_bal};
+        log_transaction(username, tx);
+        persist(shard, slot);
+        if (balance_after) *balance_after = new_bal;
+    }
+    after_mutation();
+    tr.succeed();
+    return op.succeed();
 }
 
-bool Bank::deposit(const std::string& username, double amount, std::string& err) {
-    if (amount <= 0.0) { err = "Amount must be positive."; return false; }
-    auto it = accounts_.find(username);
-    if (it == accounts_.end()) { err = "Account not found."; return false; }
+bool Bank::transfer(const std::string& from_user, const std::string& to_user, Money amount, std::string& err,
+                    Money* balance_after) {
+    metrics::OpScope op(metrics_, Op::Transfer, &err);
+    trace::Scope tr(recorder_.get(), trace::Call::Transfer, &err);
+    if (trace::Event* e = tr.event()) { e->user = from_user; e->other = to_user; e->amount = amount; }
+    if (from_user == to_user) { err = "Cannot transfer to the same account."; return false; }
+    if (amount <= Money()) { err = "Amount must be positive."; return false; }
+
+    {
+        // Take both shard locks in ascending index order so opposing transfers cannot deadlock.
+        std::size_t from_idx = shard_index(from_user);
+        std::size_t to_idx = shard_index(to_user);
+        auto first = lock_exclusive(shards_[std::min(from_idx, to_idx)]);
+        std::unique_lock<std::shared_mutex> second;
+        if (from_idx != to_idx) second = lock_exclusive(shards_[std::max(from_idx, to_idx)]);
 
-    double new_bal = it->second.balance() + amount;
-    it->second.set_balance(new_bal);
-    Transaction tx{current_timestamp_iso(), "DEPOSIT", amount, new_bal, "Cash deposit"};
-    log_transaction(username, tx);
+        // Resolve both before materializing either, so a failed lookup leaves the maps untouched.
+        Shard& from_shard = shards_[from_idx];
+        Shard& to_shard = shards_[to_idx];
+        bool from_found, to_found;
+        std::uint32_t from_slot = AccountTable::npos, to_slot = AccountTable::npos;
+        {
+            metrics::ScopedTimer t(metrics_.stage(Stage::Lookup));
+            from_found = view_locked(from_shard, from_user).has_value();
+            to_found = from_found && view_locked(to_shard, to_user).has_value();
+            if (to_found) {
+                from_slot = materialize_locked(from_shard, from_user);
+                to_slot = materialize_locked(to_shard, to_user);
+            }
+        }
+        if (!from_found) { err = "Source account not found."; return false; }
+        if (!to_found) { err = "Destination account not found."; return false; }
+        Money from_bal = from_shard.accounts.balance(from_slot);
+        Money to_bal = to_shard.accounts.balance(to_slot);
+        if (from_bal < amount) { err = "Insufficient funds."; return false; }
+
+        // Perform transfer atomically in-memory
+        Money from_new, to_new;
+        if (!Money::add(to_bal, amount, to_new)) { err = "Amount too large."; return false; }
+        Money::sub(from_bal, amount, from_new);
+        set_balance_locked(from_shard, from_slot, from_new);
+        set_balance_locked(to_shard, to_slot, to_new);
+
+        timestamp::Micros ts = timestamp::next();
+        Transaction out_tx{ts, TxType::TransferOut, amount, from_new, make_id(to_idx, to_slot)};
+        Transaction in_tx{ts, TxType::TransferIn, amount, to_new, make_id(from_idx, from_slot)};
+        log_transaction(from_user, out_tx, to_user);
+        log_transaction(to_user, in_tx, from_user);
+
+        persist(from_shard, from_slot);
+        persist(to_shard, to_slot);
+        if (balance_after) *balance_after = from_new;
+    }
+    after_mutation();
+    tr.succeed();
+    return op.succeed();
+}
+
+bool Bank::apply_batch(const std::vector<Posting>& postings, std::vector<PostingResult>& results, std::string& err) {
+    metrics::OpScope op(metrics_, Op::ApplyBatch, &err);
+    trace::Scope tr(recorder_.get(), trace::Call::ApplyBatch, &err);
+    if (trace::Event* e = tr.event()) {
+        for (const Posting& p : postings) e->legs.push_back(trace::Leg{p.from, p.to, p.amount});
+    }
+    results.assign(postings.size(), PostingResult{});
+    if (postings.empty()) { tr.succeed(); return op.succeed(); }
+
+    // Every account the batch touches, keyed by username.
+    struct Touched {
+        std::size_t shard;
+        std::uint32_t slot = AccountTable::npos;
+        bool found = false;
+        Money balance; // running balance while validating
+    };
+    std::unordered_map<std::string_view, Touched> accounts;
+    accounts.reserve(postings.size() * 2);
+    std::array<bool, kShardCount> involved{};
+    for (const Posting& p : postings) {
+        for (const std::string* name : {&p.from, &p.to}) {
+            auto [it, fresh] = accounts.try_emplace(*name);
+            if (fresh) {
+                it->second.shard = shard_index(*name);
+                involved[it->second.shard] = true;
+            }
+        }
+    }
+
+    std::size_t first_failed = SIZE_MAX;
+    {
+        std::vector<std::unique_lock<std::shared_mutex>> locks;
+        for (std::size_t i = 0; i < kShardCount; ++i) {
+            if (involved[i]) locks.push_back(lock_exclusive(shards_[i]));
+        }
+        {
+            metrics::ScopedTimer t(metrics_.stage(Stage::Lookup));
+            for (auto& [name, acc] : accounts) {
+                auto view = view_locked(shards_[acc.shard], name);
+                if (view) { acc.found = true; acc.balance = view->balance; }
+            }
+        }
+
+        // Validate against running balances; a failed leg moves nothing, so later legs are
+        // still checked as if it were not there.
+        for (std::size_t i = 0; i < postings.size(); ++i) {
+            const Posting& p = postings[i];
+            PostingResult& r = results[i];
+            Touched& from = accounts.find(p.from)->second;
+            Touched& to = accounts.find(p.to)->second;
+            Money from_new, to_new;
+            if (p.amount <= Money()) r.err = "Amount must be positive.";
+            else if (p.from == p.to) r.err = "Cannot transfer to the same account.";
+            else if (!from.found) r.err = "Source account not found.";
+            else if (!to.found) r.err = "Destination account not found.";
+            else if (from.balance < p.amount) r.err = "Insufficient funds.";
+            else if (!Money::add(to.balance, p.amount, to_new)) r.err = "Amount too large.";
+            if (!r.err.empty()) {
+                if (first_failed == SIZE_MAX) first_failed = i;
+                continue;
+            }
+            Money::sub(from.balance, p.amount, from_new);
+            from.balance = r.from_balance = from_new;
+            to.balance = r.to_balance = to_new;
+        }
+        if (first_failed != SIZE_MAX) {
+            err = results[first_failed].err;
+            return false;
+        }
+
+        for (auto& [name, acc] : accounts) {
+            Shard& shard = shards_[acc.shard];
+            acc.slot = materialize_locked(shard, name);
+            set_balance_locked(shard, acc.slot, acc.balance);
+        }
+
+        timestamp::Micros ts = timestamp::next();
+        std::vector<TxLogWriter::Record> records;
+        records.reserve(postings.size() * 2);
+        for (std::size_t i = 0; i < postings.size(); ++i) {
+            const Posting& p = postings[i];
+            const Touched& from = accounts.find(p.from)->second;
+            const Touched& to = accounts.find(p.to)->second;
+            records.push_back(TxLogWriter::Record{p.from,
+                Transaction{ts, TxType::TransferOut, p.amount, results[i].from_balance, make_id(to.shard, to.slot)}, p.to});
+            records.push_back(TxLogWriter::Record{p.to,
+                Transaction{ts, TxType::TransferIn, p.amount, results[i].to_balance, make_id(from.shard, from.slot)}, p.from});
+        }
+        {
+            metrics::ScopedTimer t(metrics_.stage(Stage::TxLogAppend));
+            tx_log_.append_all(records);
+        }
+        if (opts_.storage == StorageMode::Journal) {
+            std::vector<Journal::Record> group;
+            group.reserve(accounts.size());
+            for (const auto& [name, acc] : accounts) {
+                const AccountTable& table = shards_[acc.shard].accounts;
+                char hex[64];
+                digest_to_hex(table.digest(acc.slot), hex);
+                group.push_back(Journal::Record{std::string(name), std::string(hex, sizeof(hex)), acc.balance});
+            }
+            metrics::ScopedTimer t(metrics_.stage(Stage::JournalWrite));
+            if (persist_) persist_->append_group(std::move(group));
+            else journal_.append_group(group);
+        }
+    }
+    after_mutation();
+    if (trace::Event* e = tr.event()) {
+        std::vector<std::pair<Money, Money>> legs;
+        for (const PostingResult& r : results) legs.emplace_back(r.from_balance, r.to_balance);
+        e->result = trace::fingerprint(legs);
+    }
+    tr.succeed();
+    return op.succeed();
+}
+
+std::size_t Bank::import_accounts(std::vector<NewAccount>& accounts) {
+    metrics::ScopedTimer t(metrics_.op(Op::Import));
+    unsigned threads = parallel::threads_for(opts_.load_threads);
+
+    // Entries per shard, in input order so the first of two equal usernames is the one added.
+    std::vector<std::uint8_t> shard_of(accounts.size());
+    const std::size_t chunk = 1 << 16;
+    parallel::for_each((accounts.size() + chunk - 1) / chunk, threads, [&](std::size_t c) {
+        for (std::size_t i = c * chunk, end = std::min(accounts.size(), i + chunk); i < end; ++i) {
+            shard_of[i] = static_cast<std::uint8_t>(shard_index(accounts[i].username));
+        }
+    });
+    std::array<std::vector<std::size_t>, kShardCount> by_shard;
+    for (std::size_t i = 0; i < accounts.size(); ++i) {
+        if (accounts[i].err.empty()) by_shard[shard_of[i]].push_back(i);
+    }
+
+    std::atomic<std::size_t> added{0};
+    {
+        std::vector<std::unique_lock<std::shared_mutex>> locks;
+        locks.reserve(kShardCount);
+        for (auto& shard : shards_) locks.push_back(lock_exclusive(shard));
+
+        // One task per shard: the duplicate check, inserts and index upkeep need no further locking.
+        std::array<std::vector<TxLogWriter::Record>, kShardCount> records;
+        parallel::for_each(kShardCount, threads, [&](std::size_t s) {
+            Shard& shard = shards_[s];
+            const std::uint32_t first_new = shard.accounts.size();
+            std::vector<std::size_t> origin; // entry behind each slot from first_new on
+            origin.reserve(by_shard[s].size());
+            shard.accounts.reserve(first_new + by_shard[s].size());
+            for (std::size_t i : by_shard[s]) {
+                NewAccount& a = accounts[i];
+                std::uint32_t slot = shard.accounts.find(a.username);
+                if (slot != AccountTable::npos && slot >= first_new) {
+                    a.err = "Duplicate username.";
+                    a.duplicate_of = origin[slot - first_new];
+                    continue;
+                }
+                if (slot != AccountTable::npos || (base_ && base_->find(a.username))) {
+                    a.err = "Username already exists.";
+                    continue;
+                }
+                slot = shard.accounts.insert(a.username, a.digest, a.balance);
+                index_insert_locked(shard, slot);
+                origin.push_back(i);
+                if (a.balance > Money()) {
+                    records[s].push_back(TxLogWriter::Record{std::string(a.username),
+                        Transaction{timestamp::next(), TxType::InitialDeposit, a.balance, a.balance}, std::string()});
+                }
+            }
+            added += origin.size();
+        });
+        std::vector<TxLogWriter::Record> all;
+        std::size_t total = 0;
+        for (const auto& r : records) total += r.size();
+        all.reserve(total);
+        for (auto& r : records) std::move(r.begin(), r.end(), std::back_inserter(all));
+        metrics::ScopedTimer tl(metrics_.stage(Stage::TxLogAppend));
+        tx_log_.append_all(all);
+    }
+    // The rows reach disk through the snapshot alone; the journal has nothing to say about them.
     save();
-    return true;
+    flush_tx_log();
+    return added;
 }
 
-bool Bank::withdraw(const std::string& username, double amount, std::string& err) {
-    if (amount <= 0.0) { err = "Amount must be positive."; return false; }
-    auto it = accounts_.find(username);
-    if (it == accounts_.end()) { err = "Account not found."; return false; }
-    if (it->second.balance() < amount) { err = "Insufficient funds."; return false; }
+bool Bank::set_balance_from_log(const std::string& username, Money logged_balance, std::string& err) {
+    {
+        Shard& shard = shard_for(username);
+        auto lk = lock_exclusive(shard);
+        std::uint32_t slot = materialize_locked(shard, username);
+        if (slot == AccountTable::npos) { err = "Account not found."; return false; }
+        set_balance_locked(shard, slot, logged_balance);
+        persist(shard, slot);
+    }
+    after_mutation();
+    return true;
+}
 
-    double new_bal = it->second.balance() - amount;
-    it->second.set_balance(new_bal);
-    Transaction tx{current_timestamp_iso(), "WITHDRAW", amount, new_bal, "Cash withdrawal"};
+bool Bank::log_adjustment(const std::string& username, Money logged_balance, std::string& err) {
+    Shard& shard = shard_for(username);
+    auto lk = lock_exclusive(shard);
+    std::uint32_t slot = materialize_locked(shard, username);
+    if (slot == AccountTable::npos) { err = "Account not found."; return false; }
+    Money balance = shard.accounts.balance(slot);
+    Money delta;
+    if (!Money::sub(balance, logged_balance, delta)) { err = "Amount too large."; return false; }
+    Transaction tx{timestamp::next(), TxType::Adjustment, delta, balance};
     log_transaction(username, tx);
-    save();
     return true;
 }
 
-bool Bank::transfer(const std::string& from_user, const std::string& to_user, double amount, std::string& err) {
-    if (from_user == to_user) { err = "Cannot transfer to the same account."; return false; }
-    if (amount <= 0.0) { err = "Amount must be positive."; return false; }
+std::optional<Money> Bank::balance_of(const Session& session) const {
+    trace::Scope tr(recorder_.get(), trace::Call::BalanceOf);
+    const Shard& shard = shards_[session.id % kShardCount];
+    std::uint32_t slot = session.id / kShardCount;
+    std::shared_lock<std::shared_mutex> lk(shard.mu);
+    if (slot >= shard.accounts.size()) return std::nullopt;
+    Money balance = shard.accounts.balance(slot);
+    if (trace::Event* e = tr.event()) { e->user = session.username; e->result = static_cast<std::uint64_t>(balance.cents()); }
+    tr.succeed();
+    return balance;
+}
 
-    auto from_it = accounts_.find(from_user);
-    auto to_it = accounts_.find(to_user);
-    if (from_it == accounts_.end()) { err = "Source account not found."; return false; }
-    if (to_it == accounts_.end()) { err = "Destination account not found."; return false; }
-    if (from_it->second.balance() < amount) { err = "Insufficient funds."; return false; }
+std::optional<AccountId> Bank::id_of(const std::string& username) {
+    AccountId id = resolve_id(username);
+    if (id == kNoAccount) return std::nullopt;
+    return id;
+}
 
-    // Perform transfer atomically in-memory
-    double from_new = from_it->second.balance() - amount;
-    double to_new = to_it->second.balance() + amount;
-    from_it->second.set_balance(from_new);
-    to_it->second.set_balance(to_new);
+std::optional<std::string> Bank::username_of(AccountId id) const {
+    const Shard& shard = shards_[id % kShardCount];
+    std::uint32_t slot = id / kShardCount;
+    std::shared_lock<std::shared_mutex> lk(shard.mu);
+    if (slot >= shard.accounts.size()) return std::nullopt;
+    return std::string(shard.accounts.username(slot));
+}
 
-    Transaction out_tx{current_timestamp_iso(), "TRANSFER_OUT", amount, from_new, std::string("To ") + to_user};
-    Transaction in_tx{current_timestamp_iso(), "TRANSFER_IN", amount, to_new, std::string("From ") + from_user};
-    log_transaction(from_user, out_tx);
-    log_transaction(to_user, in_tx);
+AccountId Bank::resolve_id(std::string_view username) {
+    std::size_t idx = shard_index(username);
+    Shard& shard = shards_[idx];
+    {
+        std::shared_lock<std::shared_mutex> lk(shard.mu);
+        std::uint32_t slot = shard.accounts.find(username);
+        if (slot != AccountTable::npos) return make_id(idx, slot);
+        if (!base_ || !base_->find(username)) return kNoAccount;
+    }
+    auto lk = lock_exclusive(shard);
+    std::uint32_t slot = materialize_locked(shard, username);
+    return slot == AccountTable::npos ? kNoAccount : make_id(idx, slot);
+}
 
-    save();
-    return true;
+std::size_t Bank::memory_bytes() const {
+    auto locks = lock_all_shared();
+    std::size_t total = materialized_.capacity();
+    for (const auto& shard : shards_) total += shard.accounts.memory_bytes();
+    return total;
 }
 
-std::optional<double> Bank::balance_of(const std::string& username) const {
-    auto it = accounts_.find(username);
-    if (it == accounts_.end()) return std::nullopt;
-    return it->second.balance();
+std::optional<Money> Bank::balance_of(const std::string& username) const {
+    trace::Scope tr(recorder_.get(), trace::Call::BalanceOf);
+    if (trace::Event* e = tr.event()) e->user = username;
+    const Shard& shard = shard_for(username);
+    std::shared_lock<std::shared_mutex> lk(shard.mu);
+    auto acc = view_locked(shard, username);
+    if (!acc) return std::nullopt;
+    if (trace::Event* e = tr.event()) e->result = static_cast<std::uint64_t>(acc->balance.cents());
+    tr.succeed();
+    return acc->balance;
 }
 
 bool Bank::has_user(const std::string& username) const {
-    return accounts_.count(username) != 0;
+    const Shard& shard = shard_for(username);
+    std::shared_lock<std::shared_mutex> lk(shard.mu);
+    return view_locked(shard, username).has_value();
 }
 
-std::vector<std::pair<std::string,double>> Bank::all_accounts() const {
-    std::vector<std::pair<std::string,double>> v;
-    v.reserve(accounts_.size());
-    for (const auto& kv : accounts_) {
-        v.emplace_back(kv.first, kv.second.balance());
+std::vector<std::pair<std::string,Money>> Bank::all_accounts() const {
+    metrics::ScopedTimer t(metrics_.op(Op::AllAccounts));
+    return snapshot().accounts();
+}
+
+BalanceSnapshot Bank::snapshot() const {
+    static_assert(BalanceSnapshot::kShardParts == kShardCount, "one snapshot part per shard");
+    BalanceSnapshot snap;
+    {
+        auto locks = lock_all_shared();
+        for (std::size_t i = 0; i < kShardCount; ++i) {
+            snap.shards_[i] = shards_[i].accounts.freeze();
+            snap.size_ += snap.shards_[i].size();
+        }
+        if (base_) {
+            snap.base_ = base_;
+            snap.base_live_ = materialized_;
+        }
+        snap.epoch_ = ++snapshot_epoch_;
+        // Mutations stamp their records under their shard locks, so every record in the view
+        // is stamped before taken_at and every later one after it.
+        snap.taken_at_ = timestamp::next();
+    }
+    if (snap.base_) {
+        snap.size_ += static_cast<std::size_t>(std::count(snap.base_live_.begin(), snap.base_live_.end(), 0));
+        snap.base_parts_ = BalanceSnapshot::kShardParts;
+    }
+    return snap;
+}
+
+std::vector<std::pair<std::string,Money>> BalanceSnapshot::accounts() const {
+    std::vector<std::pair<std::string,Money>> v;
+    v.reserve(size_);
+    for (std::size_t p = 0; p < parts(); ++p) {
+        for_each_in(p, [&](std::string_view username, Money balance) { v.emplace_back(username, balance); });
     }
     std::sort(v.begin(), v.end(), [](const auto& a, const auto& b){ return a.first < b.first; });
     return v;
 }
 
-void Bank::load() {
-    accounts_.clear();
-    std::filesystem::create_directories(db_path_.parent_path());
-    std::ifstream in(db_path_);
-    if (!in) {
-        // create default admin if file missing
-        accounts_.emplace("admin", Account("admin", hash_password("admin"), 0.0));
-        save();
+namespace {
+
+struct NameLess {
+    const AccountTable& t;
+    bool operator()(std::uint32_t a, std::uint32_t b) const { return t.username(a) < t.username(b); }
+};
+
+struct BalanceLess {
+    const AccountTable& t;
+    bool operator()(std::uint32_t a, std::uint32_t b) const {
+        Money x = t.balance(a), y = t.balance(b);
+        return x < y || (x == y && a < b);
+    }
+};
+
+// One shard's position in a k-way merge.
+struct MergeHead {
+    RankTree::Cursor cursor;
+    const AccountTable* table;
+};
+
+// Pops (table, slot) pairs across shards in global order; emit returns false to stop.
+// before(a, b) orders two heads by their current slot; backward walks the cursors in reverse.
+template <typename Before, typename Emit>
+void merge_heads(std::vector<MergeHead> heads, bool backward, Before before, Emit emit) {
+    auto after = [&](const MergeHead& a, const MergeHead& b) { return before(b, a); };
+    heads.erase(std::remove_if(heads.begin(), heads.end(), [](const MergeHead& h) { return !h.cursor.valid(); }),
+                heads.end());
+    std::make_heap(heads.begin(), heads.end(), after);
+    while (!heads.empty()) {
+        std::pop_heap(heads.begin(), heads.end(), after);
+        MergeHead& h = heads.back();
+        if (!emit(*h.table, h.cursor.slot())) return;
+        if (backward) h.cursor.prev(); else h.cursor.next();
+        if (h.cursor.valid()) std::push_heap(heads.begin(), heads.end(), after);
+        else heads.pop_back();
+    }
+}
+
+} // namespace
+
+void Bank::index_insert_locked(Shard& shard, std::uint32_t slot) {
+    if (!indexed_.load(std::memory_order_relaxed)) return;
+    shard.by_name.insert(slot, NameLess{shard.accounts});
+    shard.by_balance.insert(slot, BalanceLess{shard.accounts});
+}
+
+void Bank::set_balance_locked(Shard& shard, std::uint32_t slot, Money balance) {
+    if (!indexed_.load(std::memory_order_relaxed)) {
+        shard.accounts.set_balance(slot, balance);
         return;
     }
-    std::string line;
-    while (std::getline(in, line)) {
-        if (line.empty()) continue;
-        std::istringstream iss(line);
-        std::string username, hash, bal_str;
-        if (std::getline(iss, username, '|') && std::getline(iss, hash, '|') && std::getline(iss, bal_str)) {
-            try {
-                double bal = std::stod(bal_str);
-                accounts_.emplace(username, Account(username, hash, bal));
-            } catch (...) {
-                // skip malformed
-            }
+    shard.by_balance.erase(slot, BalanceLess{shard.accounts});
+    shard.accounts.set_balance(slot, balance);
+    shard.by_balance.insert(slot, BalanceLess{shard.accounts});
+}
+
+void Bank::ensure_indexes() {
+    if (indexed_.load(std::memory_order_acquire)) return;
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    locks.reserve(kShardCount);
+    for (auto& shard : shards_) locks.emplace_back(shard.mu);
+    if (indexed_.load(std::memory_order_relaxed)) return;
+    if (base_) {
+        for (std::size_t i = 0; i < base_->size(); ++i) {
+            if (!materialized_[i]) materialize_locked(shard_for(base_->username(i)), base_->username(i));
+        }
+    }
+    for (auto& shard : shards_) {
+        shard.by_name.clear();
+        shard.by_balance.clear();
+        for (std::uint32_t slot = 0; slot < shard.accounts.size(); ++slot) {
+            shard.by_name.insert(slot, NameLess{shard.accounts});
+            shard.by_balance.insert(slot, BalanceLess{shard.accounts});
+        }
+    }
+    indexed_.store(true, std::memory_order_release);
+}
+
+std::size_t Bank::account_count() {
+    ensure_indexes();
+    auto locks = lock_all_shared();
+    std::size_t n = 0;
+    for (const auto& shard : shards_) n += shard.accounts.size();
+    return n;
+}
+
+std::vector<std::pair<std::string,Money>> Bank::list_accounts(const std::string& after, std::size_t limit) {
+    return find_by_prefix("", limit, after);
+}
+
+std::vector<std::pair<std::string,Money>> Bank::find_by_prefix(const std::string& prefix, std::size_t limit,
+                                                               const std::string& after) {
+    metrics::ScopedTimer t(metrics_.op(Op::AccountQuery));
+    ensure_indexes();
+    std::vector<std::pair<std::string,Money>> out;
+    if (limit == 0) return out;
+    auto locks = lock_all_shared();
+    const std::string& start = after < prefix ? prefix : after;
+    bool inclusive = after < prefix; // the prefix itself may be a username; "after" never is returned
+    std::vector<MergeHead> heads;
+    heads.reserve(kShardCount);
+    for (const auto& shard : shards_) {
+        const AccountTable& table = shard.accounts;
+        heads.push_back(MergeHead{shard.by_name.lower_bound([&](std::uint32_t v) {
+            return inclusive ? table.username(v) < start : table.username(v) <= start;
+        }), &table});
+    }
+    merge_heads(std::move(heads), false,
+        [](const MergeHead& a, const MergeHead& b) {
+            return a.table->username(a.cursor.slot()) < b.table->username(b.cursor.slot());
+        },
+        [&](const AccountTable& table, std::uint32_t slot) {
+            std::string_view name = table.username(slot);
+            if (name.substr(0, prefix.size()) != prefix) return false;
+            out.emplace_back(std::string(name), table.balance(slot));
+            return out.size() < limit;
+        });
+    return out;
+}
+
+std::vector<std::pair<std::string,Money>> Bank::top_balances(std::size_t k, bool richest) {
+    metrics::ScopedTimer t(metrics_.op(Op::AccountQuery));
+    ensure_indexes();
+    std::vector<std::pair<std::string,Money>> out;
+    if (k == 0) return out;
+    auto locks = lock_all_shared();
+    std::vector<MergeHead> heads;
+    heads.reserve(kShardCount);
+    for (const auto& shard : shards_) {
+        heads.push_back(MergeHead{richest ? shard.by_balance.last() : shard.by_balance.first(), &shard.accounts});
+    }
+    merge_heads(std::move(heads), richest,
+        [richest](const MergeHead& a, const MergeHead& b) {
+            Money x = a.table->balance(a.cursor.slot()), y = b.table->balance(b.cursor.slot());
+            if (x != y) return richest ? y < x : x < y;
+            return a.table->username(a.cursor.slot()) < b.table->username(b.cursor.slot());
+        },
+        [&](const AccountTable& table, std::uint32_t slot) {
+            out.emplace_back(std::string(table.username(slot)), table.balance(slot));
+            return out.size() < k;
+        });
+    return out;
+}
+
+std::size_t Bank::count_balance_range(Money lo, Money hi) {
+    metrics::ScopedTimer t(metrics_.op(Op::AccountQuery));
+    ensure_indexes();
+    if (hi < lo) return 0;
+    auto locks = lock_all_shared();
+    std::size_t n = 0;
+    for (const auto& shard : shards_) {
+        const AccountTable& table = shard.accounts;
+        n += shard.by_balance.count_below([&](std::uint32_t v) { return table.balance(v) <= hi; });
+        n -= shard.by_balance.count_below([&](std::uint32_t v) { return table.balance(v) < lo; });
+    }
+    return n;
+}
+
+void Bank::load() {
+    metrics::ScopedTimer t(metrics_.op(Op::Load));
+    {
+        std::lock_guard<std::mutex> ck(checkpoint_mu_);
+        wait_checkpoint();
+    }
+    stop_persist_queue();
+    journal_.close();
+    bool dirty;
+    bool migrated = false;
+    {
+        std::vector<std::unique_lock<std::shared_mutex>> locks;
+        for (auto& shard : shards_) {
+            locks.emplace_back(shard.mu);
+            shard.accounts.clear();
+            shard.by_name.clear();
+            shard.by_balance.clear();
+        }
+        base_.reset();
+        materialized_.clear();
+        indexed_ = false;
+        std::filesystem::create_directories(db_path_.parent_path());
+
+        // Binary snapshots are mapped, not parsed: accounts are materialized on first write.
+        auto map_binary = [this]() {
+            auto view = std::make_shared<snapshot::View>();
+            std::string err;
+            if (!view->open(snap_path_, err)) throw std::runtime_error(err);
+            materialized_.assign(view->size(), 0);
+            base_ = std::move(view);
+        };
+        bool want_binary = opts_.snapshot_format == SnapshotFormat::Binary;
+        bool found = true;
+        if (want_binary && std::filesystem::exists(snap_path_)) map_binary();
+        else if (std::filesystem::exists(db_path_)) { load_text_locked(db_path_); migrated = want_binary; }
+        else if (std::filesystem::exists(snap_path_)) { map_binary(); migrated = true; }
+        else found = false;
+
+        // Replay the journal tail: records from an interrupted checkpoint first, then the live file.
+        auto apply = [this](const std::string& username, const std::string& hash, Money bal) {
+            upsert_locked(shard_for(username), username, hash, bal);
+        };
+        std::size_t replayed = Journal::replay(journal_.rotated_path(), apply);
+        replayed += Journal::replay(journal_.path(), apply);
+
+        dirty = replayed > 0 || !found || migrated;
+        // Ensure admin exists
+        if (!view_locked(shard_for("admin"), "admin")) {
+            shard_for("admin").accounts.insert("admin", digest_password("admin"), Money());
+            dirty = true;
+        }
+    }
+    // Start from a clean snapshot so the journal only ever holds this session's records.
+    if (dirty) save();
+    else journal_.open();
+    if (migrated) {
+        // The other format's file is now stale; drop it so it can never be loaded by mistake.
+        std::error_code ec;
+        std::filesystem::remove(opts_.snapshot_format == SnapshotFormat::Binary ? db_path_ : snap_path_, ec);
+    }
+    if (opts_.async_persistence) start_persist_queue();
+}
+
+void Bank::save() {
+    metrics::ScopedTimer t(metrics_.op(Op::Save));
+    std::lock_guard<std::mutex> ck(checkpoint_mu_);
+    wait_checkpoint();
+    auto locks = lock_all_shared();
+    // Queued records are already reflected in the rows; write them out before the reset drops them.
+    // If the queue failed, the snapshot below is what makes them durable.
+    if (persist_ && opts_.storage == StorageMode::Journal) persist_->drain();
+    write_snapshot(snapshot_rows());
+    if (opts_.storage == StorageMode::Journal) {
+        journal_.reset();
+        journal_.discard_rotated();
+    }
+}
+
+void Bank::checkpoint() {
+    if (opts_.storage != StorageMode::Journal) { save(); return; }
+    metrics::ScopedTimer t(metrics_.op(Op::Checkpoint)); // foreground part: rotation and the row copy
+    std::lock_guard<std::mutex> ck(checkpoint_mu_);
+    wait_checkpoint();
+    std::vector<snapshot::Row> rows;
+    PersistQueue* queue = persist_.get();
+    PersistQueue::Ticket rotated = 0;
+    {
+        // With every shard held, no mutation is between its state change and its journal append,
+        // so the copy reflects exactly the records that end up in the rotated journal. With the
+        // queue running, the rotation is queued behind the records it must include.
+        auto locks = lock_all_shared();
+        if (queue) rotated = queue->rotate_journal();
+        else journal_.rotate();
+        rows = snapshot_rows();
+    }
+    checkpoint_thread_ = std::thread([this, queue, rotated, rows = std::move(rows)]() mutable {
+        try {
+            if (queue) queue->wait(rotated);
+            write_snapshot(std::move(rows));
+            journal_.discard_rotated();
+        } catch (...) {
+            // Keep the rotated journal; the next checkpoint or load() folds it in.
         }
+    });
+}
+
+void Bank::start_recording(const std::filesystem::path& path) {
+    std::vector<trace::Account> initial;
+    BalanceSnapshot snap = snapshot();
+    for (std::size_t p = 0; p < snap.parts(); ++p) {
+        snap.for_each_row_in(p, [&](std::string_view username, std::string_view hash, Money balance) {
+            trace::Account a{std::string(username), {}, balance};
+            if (!digest_from_hex(hash, a.digest)) a.digest.fill(0);
+            initial.push_back(std::move(a));
+        });
     }
-    // Ensure admin exists
-    if (!has_user("admin")) {
-        accounts_.emplace("admin", Account("admin", hash_password("admin"), 0.0));
+    for (trace::Account& a : initial) a.history = tx_log_.count(a.username);
+    recorder_ = std::make_unique<trace::Recorder>(path, initial);
+}
+
+void Bank::stop_recording() {
+    if (!recorder_) return;
+    auto [accounts, checksum] = state_checksum();
+    recorder_->close(accounts, checksum);
+    recorder_.reset();
+}
+
+std::pair<std::size_t, std::uint64_t> Bank::state_checksum() const {
+    BalanceSnapshot snap = snapshot();
+    std::uint64_t sum = 0;
+    for (std::size_t p = 0; p < snap.parts(); ++p) {
+        snap.for_each_in(p, [&](std::string_view username, Money balance) { sum = trace::state_add(sum, username, balance); });
+    }
+    return {snap.size(), sum};
+}
+
+void Bank::set_deferred(bool on) {
+    trace::Scope tr(recorder_.get(), trace::Call::SetDeferred);
+    if (on) tr.succeed();
+    deferred_ = on;
+    if (!persist_) journal_.set_autoflush(!on); // the queue flushes once per batch anyway
+}
+
+void Bank::commit() {
+    trace::Scope tr(recorder_.get(), trace::Call::Commit);
+    tr.succeed();
+    if (opts_.storage == StorageMode::Snapshot) {
         save();
+    } else {
+        bool ok = persist_ ? persist_->drain() : journal_.flush();
+        if (!ok) throw std::runtime_error("Journal write failed.");
+        maybe_checkpoint();
+    }
+    flush_tx_log();
+}
+
+void Bank::flush_tx_log() {
+    if (!tx_log_.flush()) throw std::runtime_error("Transaction log write failed: " + tx_log_.error());
+}
+
+std::unique_lock<std::shared_mutex> Bank::lock_exclusive(Shard& shard) {
+    metrics::ScopedTimer t(metrics_.stage(Stage::LockWait));
+    return std::unique_lock<std::shared_mutex>(shard.mu);
+}
+
+std::vector<std::shared_lock<std::shared_mutex>> Bank::lock_all_shared() const {
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(kShardCount);
+    for (const auto& shard : shards_) locks.emplace_back(shard.mu);
+    return locks;
+}
+
+void Bank::persist(const Shard& shard, std::uint32_t slot) {
+    if (opts_.storage == StorageMode::Journal) {
+        metrics::ScopedTimer t(metrics_.stage(Stage::JournalWrite));
+        char hex[64];
+        digest_to_hex(shard.accounts.digest(slot), hex);
+        std::string_view hash(hex, sizeof(hex));
+        if (persist_) persist_->append(shard.accounts.username(slot), hash, shard.accounts.balance(slot));
+        else journal_.append(shard.accounts.username(slot), hash, shard.accounts.balance(slot));
+    }
+}
+
+void Bank::after_mutation() {
+    if (opts_.storage == StorageMode::Snapshot) {
+        if (deferred()) return;
+        if (persist_) persist_->request_snapshot();
+        else save();
+    } else {
+        maybe_checkpoint(); // keeps the journal bounded even during a long deferred run
+    }
+}
+
+void Bank::maybe_checkpoint() {
+    if (journal_.records() < opts_.checkpoint_every) return;
+    // Another thread may already be folding the journal; it will reset the count.
+    std::unique_lock<std::mutex> ck(checkpoint_mu_, std::try_to_lock);
+    if (!ck.owns_lock()) return;
+    ck.unlock();
+    checkpoint();
+}
+
+void Bank::wait_checkpoint() {
+    if (checkpoint_thread_.joinable()) checkpoint_thread_.join();
+}
+
+void Bank::start_persist_queue() {
+    journal_.set_autoflush(false);
+    persist_ = std::make_unique<PersistQueue>(journal_, [this]() {
+        try {
+            save();
+            return true;
+        } catch (const std::exception& e) {
+            // Counted like any failed save; the queue stops confirming tickets.
+            metrics_.failure(Op::Save, e.what());
+            return false;
+        }
+    }, opts_.persist_queue_capacity);
+}
+
+void Bank::stop_persist_queue() {
+    if (!persist_) return;
+    persist_.reset();
+    journal_.set_autoflush(!deferred());
+}
+
+void Bank::on_persisted(PersistQueue::Ticket t, std::function<void()> done) {
+    if (persist_) persist_->on_durable(t, std::move(done));
+    else done();
+}
+
+std::future<void> Bank::persisted(PersistQueue::Ticket t) {
+    if (persist_) return persist_->durable_future(t);
+    std::promise<void> ready;
+    ready.set_value();
+    return ready.get_future();
+}
+
+// Hashes that are not the 64-digit lowercase hex written by hash_password could never have
+// matched a login; they load as an all-zero digest.
+static PasswordDigest digest_or_zero(std::string_view hex) {
+    PasswordDigest d{};
+    if (!digest_from_hex(hex, d)) d.fill(0);
+    return d;
+}
+
+std::optional<Bank::AccountView> Bank::view_locked(const Shard& shard, std::string_view username) const {
+    std::uint32_t slot = shard.accounts.find(username);
+    if (slot != AccountTable::npos) return AccountView{shard.accounts.digest(slot), shard.accounts.balance(slot)};
+    if (base_) {
+        if (auto i = base_->find(username)) return AccountView{digest_or_zero(base_->password_hash(*i)), base_->balance(*i)};
+    }
+    return std::nullopt;
+}
+
+std::uint32_t Bank::materialize_locked(Shard& shard, std::string_view username) {
+    std::uint32_t slot = shard.accounts.find(username);
+    if (slot != AccountTable::npos || !base_) return slot;
+    auto i = base_->find(username);
+    if (!i) return AccountTable::npos;
+    materialized_[*i] = 1;
+    slot = shard.accounts.insert(username, digest_or_zero(base_->password_hash(*i)), base_->balance(*i));
+    index_insert_locked(shard, slot);
+    return slot;
+}
+
+void Bank::upsert_locked(Shard& shard, std::string_view username, std::string_view hash_hex, Money balance) {
+    PasswordDigest digest = digest_or_zero(hash_hex);
+    std::uint32_t slot = materialize_locked(shard, username);
+    if (slot == AccountTable::npos) {
+        shard.accounts.insert(username, digest, balance);
+    } else {
+        shard.accounts.set_digest(slot, digest);
+        shard.accounts.set_balance(slot, balance);
     }
 }
 
-void Bank::save() const {
-    std::filesystem::create_directories(db_path_.parent_path());
-    std::ofstream out(db_path_, std::ios::trunc);
-    for (const auto& kv : accounts_) {
-        out << kv.first << '|' << kv.second.password_hash() << '|' << kv.second.balance() << '\n';
+void Bank::load_text_locked(const std::filesystem::path& path) {
+    snapshot::MappedFile file;
+    std::string err;
+    if (!file.open(path, err)) throw std::runtime_error(err);
+    std::string_view text(file.data(), file.size());
+    unsigned threads = parallel::threads_for(opts_.load_threads);
+    // Pieces of at least 1 MiB, a few per thread so one slow piece does not hold up the rest.
+    auto pieces = parallel::split_lines(text, std::min<std::size_t>(threads * 4, text.size() / (1 << 20) + 1));
+
+    // Parse: each piece sorts its lines into one run per shard, decoding digests on the way.
+    struct Parsed {
+        std::string_view username; // points into the mapping
+        PasswordDigest digest;
+        Money balance;
+    };
+    std::vector<std::array<std::vector<Parsed>, kShardCount>> runs(pieces.size());
+    parallel::for_each(pieces.size(), threads, [&](std::size_t p) {
+        snapshot::parse_text(pieces[p], [&](std::string_view username, std::string_view hash, Money bal) {
+            runs[p][shard_index(username)].push_back(Parsed{username, digest_or_zero(hash), bal});
+        });
+    });
+
+    // Merge: one task per shard, so tables are filled without further locking. Runs are taken
+    // in file order, so the first line for a username wins, as in a sequential read.
+    parallel::for_each(kShardCount, threads, [&](std::size_t s) {
+        AccountTable& table = shards_[s].accounts;
+        std::size_t total = 0;
+        for (const auto& run : runs) total += run[s].size();
+        table.reserve(total);
+        for (const auto& run : runs) {
+            for (const Parsed& p : run[s]) {
+                if (table.find(p.username) == AccountTable::npos) table.insert(p.username, p.digest, p.balance);
+            }
+        }
+    });
+}
+
+std::vector<snapshot::Row> Bank::snapshot_rows() const {
+    std::vector<snapshot::Row> rows;
+    for (const auto& shard : shards_) {
+        const AccountTable& t = shard.accounts;
+        for (std::uint32_t i = 0; i < t.size(); ++i) {
+            rows.emplace_back(std::string(t.username(i)), digest_to_hex(t.digest(i)), t.balance(i));
+        }
     }
+    if (base_) {
+        for (std::size_t i = 0; i < base_->size(); ++i) {
+            if (!materialized_[i]) rows.emplace_back(std::string(base_->username(i)), std::string(base_->password_hash(i)), base_->balance(i));
+        }
+    }
+    return rows;
+}
+
+void Bank::write_snapshot(std::vector<snapshot::Row> rows) const {
+    metrics::ScopedTimer t(metrics_.stage(Stage::SnapshotWrite));
+    std::string err;
+    bool ok = opts_.snapshot_format == SnapshotFormat::Binary
+        ? snapshot::write_binary(snap_path_, std::move(rows), err)
+        : snapshot::write_text(db_path_, rows, err);
+    if (!ok) throw std::runtime_error(err);
 }
 
-void Bank::log_transaction(const std::string& username, const Transaction& tx) const {
-    std::filesystem::create_directories(tx_dir_);
-    std::ofstream out(tx_dir_ / (username + ".log"), std::ios::app);
-    out << tx.timestamp << '|' << tx.type << '|' << tx.amount << '|' << tx.balance_after << '|' << tx.details << '\n';
+void Bank::log_transaction(const std::string& username, const Transaction& tx, std::string_view counterparty) {
+    metrics::ScopedTimer t(metrics_.stage(Stage::TxLogAppend));
+    tx_log_.append(username, tx, counterparty);
 }
 
-void Bank::load_transactions_for(const std::string& username, Account& acc) {
-    acc = accounts_.at(username); // ensure balance/hash from map
-    std::ifstream in(tx_dir_ / (username + ".log"));
-    if (!in) return;
-    std::string line;
-    while (std::getline(in, line)) {
-        if (line.empty()) continue;
-        std::istringstream iss(line);
-        Transaction tx; std::string amount_str, bal_str;
-        if (std::getline(iss, tx.timestamp, '|') && std::getline(iss, tx.type, '|') &&
-            std::getline(iss, amount_str, '|') && std::getline(iss, bal_str, '|') && std::getline(iss, tx.details)) {
-            try {
-                tx.amount = std::stod(amount_str);
-                tx.balance_after = std::stod(bal_str);
-                acc.add_transaction(tx);
-            } catch (...) { /* skip */ }
+std::size_t Bank::history_size(const std::string& username) {
+    trace::Scope tr(recorder_.get(), trace::Call::HistorySize);
+    std::size_t n = tx_log_.count(username);
+    if (trace::Event* e = tr.event()) { e->user = username; e->result = n; }
+    tr.succeed();
+    return n;
+}
+
+std::vector<Transaction> Bank::history(const std::string& username, std::size_t offset, std::size_t limit) {
+    metrics::ScopedTimer t(metrics_.op(Op::History));
+    trace::Scope tr(recorder_.get(), trace::Call::History);
+    auto records = tx_log_.read(username, offset, limit, [this](std::string_view u) { return resolve_id(u); });
+    if (trace::Event* e = tr.event()) {
+        e->user = username;
+        e->offset = offset;
+        e->limit = limit;
+        e->result = trace::fingerprint(records);
+    }
+    tr.succeed();
+    return records;
+}
+
+std::vector<Transaction> Bank::history_range(const std::string& username, const std::string& from_ts,
+                                             const std::string& to_ts, std::size_t limit) {
+    metrics::ScopedTimer t(metrics_.op(Op::History));
+    trace::Scope tr(recorder_.get(), trace::Call::HistoryRange);
+    std::vector<Transaction> records;
+    // The index is keyed on epoch microseconds; convert the local-time bounds once, here.
+    timestamp::Micros from, to;
+    if (timestamp::parse(from_ts, from) && timestamp::parse(to_ts, to)) {
+        std::size_t first = tx_log_.lower_bound(username, from);
+        std::size_t last = tx_log_.lower_bound(username, to, true);
+        if (last > first) {
+            records = tx_log_.read(username, first, std::min(limit, last - first),
+                                   [this](std::string_view u) { return resolve_id(u); });
         }
     }
+    if (trace::Event* e = tr.event()) {
+        e->user = username;
+        e->from_ts = from_ts;
+        e->to_ts = to_ts;
+        e->limit = limit;
+        e->result = trace::fingerprint(records);
+    }
+    tr.succeed();
+    return records;
+}
+
+std::size_t Bank::for_each_history(unsigned threads,
+                                   const std::function<void(const std::string&, const history::AccountStream&)>& fn) {
+    return tx_log_.for_each_account(threads, fn);
+}
+
+std::size_t Bank::scan_history(const history::LogVisitor& visit) {
+    metrics::ScopedTimer t(metrics_.op(Op::History));
+    return tx_log_.for_each_account(opts_.load_threads, [&](const std::string& username, const history::AccountStream& stream) {
+        std::vector<history::LogRecord> records;
+        stream([&](const Transaction& tx, std::string_view counterparty) {
+            records.push_back(history::LogRecord{tx, std::string(counterparty)});
+        });
+        visit(username, records);
+    });
+}
+
+std::vector<Transaction> Bank::recent_history(const std::string& username, std::size_t n) {
+    metrics::ScopedTimer t(metrics_.op(Op::History));
+    trace::Scope tr(recorder_.get(), trace::Call::RecentHistory);
+    std::size_t total = tx_log_.count(username);
+    std::size_t first = total > n ? total - n : 0;
+    auto records = tx_log_.read(username, first, n, [this](std::string_view u) { return resolve_id(u); });
+    if (trace::Event* e = tr.event()) {
+        e->user = username;
+        e->limit = n;
+        e->result = trace::fingerprint(records);
+    }
+    tr.succeed();
+    return records;
 }
@@ -0,0 +1,131 @@
+#include "batch.hpp"
+#include "bank.hpp"
+#include "fields.hpp"
+
+#include <chrono>
+#include <istream>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace batch {
+
+static bool parse_transfer(const std::string_view (&f)[4], std::size_t n, Posting& p, std::string& err) {
+    if (n != 4) { err = "Expected: TRANSFER <from> <to> <amount>"; return false; }
+    if (!Money::parse(f[3], p.amount)) { err = "Invalid amount."; return false; }
+    p.from.assign(f[1].data(), f[1].size());
+    p.to.assign(f[2].data(), f[2].size());
+    return true;
+}
+
+static bool apply(Bank& bank, const std::string_view (&f)[4], std::size_t n, std::string& err) {
+    Money amount;
+    if (fields::iequals(f[0], "CREATE")) {
+        if (n < 3 || n > 4) { err = "Expected: CREATE <username> <password> [initial_balance]"; return false; }
+        if (n == 4 && !Money::parse(f[3], amount)) { err = "Invalid amount."; return false; }
+        return bank.create_account(std::string(f[1]), std::string(f[2]), amount, err);
+    }
+    if (fields::iequals(f[0], "DEPOSIT") || fields::iequals(f[0], "WITHDRAW")) {
+        bool deposit = fields::iequals(f[0], "DEPOSIT");
+        if (n != 3) { err = deposit ? "Expected: DEPOSIT <username> <amount>" : "Expected: WITHDRAW <username> <amount>"; return false; }
+        if (!Money::parse(f[2], amount)) { err = "Invalid amount."; return false; }
+        return deposit ? bank.deposit(std::string(f[1]), amount, err)
+                       : bank.withdraw(std::string(f[1]), amount, err);
+    }
+    if (fields::iequals(f[0], "TRANSFER")) {
+        Posting p;
+        return parse_transfer(f, n, p, err) && bank.transfer(p.from, p.to, p.amount, err);
+    }
+    err = "Unknown command '" + std::string(f[0]) + "'.";
+    return false;
+}
+
+Stats run(Bank& bank, std::istream& in, const Options& opts, std::ostream& errors) {
+    Stats stats;
+    auto start = std::chrono::steady_clock::now();
+    bool was_deferred = bank.deferred();
+    bank.set_deferred(true);
+
+    std::string line, err;
+    std::size_t since_commit = 0;
+    auto count_applied = [&](std::size_t commands) {
+        since_commit += commands;
+        if (opts.commit_every > 0 && since_commit >= opts.commit_every) {
+            bank.commit();
+            ++stats.commits;
+            since_commit = 0;
+        }
+    };
+
+    // BEGIN ... END: the TRANSFER lines in between go to Bank::apply_batch as one unit.
+    bool in_group = false, group_ok = true;
+    std::vector<Posting> group;
+    std::vector<std::size_t> group_lines;
+    std::vector<PostingResult> results;
+    auto finish_group = [&](const char* why) {
+        in_group = false;
+        bool applied = group_ok && !why && bank.apply_batch(group, results, err);
+        if (applied) {
+            count_applied(group.size());
+        } else {
+            for (std::size_t i = 0; !why && i < results.size(); ++i) {
+                if (!results[i].err.empty()) errors << "line " << group_lines[i] << ": " << results[i].err << "\n";
+            }
+            errors << "line " << stats.lines << ": " << (why ? why : "batch rejected") << ", "
+                   << group.size() << " posting(s) not applied\n";
+            stats.failed += group.size();
+        }
+        group.clear();
+        group_lines.clear();
+        results.clear();
+        return applied;
+    };
+
+    while (std::getline(in, line)) {
+        ++stats.lines;
+        std::string_view view(line);
+        if (!view.empty() && view.back() == '\r') view.remove_suffix(1);
+        std::size_t first = view.find_first_not_of(" \t");
+        if (first == std::string_view::npos || view[first] == '#') continue;
+
+        std::string_view f[4];
+        std::size_t n = fields::split(view.substr(first), f);
+        err.clear();
+        if (fields::iequals(f[0], "BEGIN") && !in_group) {
+            in_group = true;
+            group_ok = true;
+            continue;
+        }
+        if (fields::iequals(f[0], "END") && in_group) {
+            if (!finish_group(nullptr) && opts.stop_on_error) break;
+            continue;
+        }
+
+        ++stats.commands;
+        if (in_group) {
+            // A bad line spoils the whole group; it is reported now and the group at END.
+            Posting p;
+            if (!fields::iequals(f[0], "TRANSFER")) err = "Only TRANSFER is allowed between BEGIN and END.";
+            else if (parse_transfer(f, n, p, err)) { group.push_back(std::move(p)); group_lines.push_back(stats.lines); continue; }
+            errors << "line " << stats.lines << ": " << err << "\n";
+            ++stats.failed;
+            group_ok = false;
+            continue;
+        }
+        if (!apply(bank, f, n, err)) {
+            ++stats.failed;
+            errors << "line " << stats.lines << ": " << err << "\n";
+            if (opts.stop_on_error) break;
+            continue;
+        }
+        count_applied(1);
+    }
+    if (in_group) finish_group("BEGIN without END");
+
+    if (since_commit > 0 || stats.commits == 0) { bank.commit(); ++stats.commits; }
+    bank.set_deferred(was_deferred);
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+} // namespace batch
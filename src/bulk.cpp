@@ -0,0 +1,257 @@
+#include "bulk.hpp"
+#include "bank.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <ostream>
+#include <stdexcept>
+
+namespace bulk {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+struct Row {
+    std::size_t line; // within its piece until the pieces are merged
+    std::string_view username;
+    std::string_view password; // plaintext form; empty once hashed
+    PasswordDigest digest;
+    Money balance;
+};
+
+struct Piece {
+    std::vector<Row> rows;
+    std::vector<std::pair<std::size_t, std::string>> errors; // (line within the piece, reason)
+    std::deque<std::string> unescaped; // fields that contained "", so cannot point into the file
+    std::size_t lines = 0;
+};
+
+// Splits one CSV line; quoted fields may hold commas and "" for a quote.
+bool split_fields(std::string_view line, std::deque<std::string>& store, std::vector<std::string_view>& fields,
+                  std::string& err) {
+    fields.clear();
+    std::size_t i = 0;
+    while (true) {
+        if (i < line.size() && line[i] == '"') {
+            std::size_t j = i + 1;
+            bool escaped = false;
+            while (true) {
+                std::size_t q = line.find('"', j);
+                if (q == std::string_view::npos) { err = "Unterminated quoted field."; return false; }
+                if (q + 1 < line.size() && line[q + 1] == '"') { escaped = true; j = q + 2; continue; }
+                j = q;
+                break;
+            }
+            std::string_view raw = line.substr(i + 1, j - i - 1);
+            if (escaped) {
+                std::string& s = store.emplace_back();
+                for (std::size_t k = 0; k < raw.size(); ++k) {
+                    s.push_back(raw[k]);
+                    if (raw[k] == '"') ++k;
+                }
+                fields.push_back(s);
+            } else {
+                fields.push_back(raw);
+            }
+            i = j + 1;
+            if (i < line.size() && line[i] != ',') { err = "Unexpected text after a quoted field."; return false; }
+        } else {
+            std::size_t c = line.find(',', i);
+            if (c == std::string_view::npos) c = line.size();
+            fields.push_back(line.substr(i, c - i));
+            i = c;
+        }
+        if (i >= line.size()) return true;
+        ++i; // the comma
+    }
+}
+
+std::string_view next_line(std::string_view text, std::size_t& pos) {
+    std::size_t nl = text.find('\n', pos);
+    std::size_t end = nl == std::string_view::npos ? text.size() : nl;
+    std::string_view line = text.substr(pos, end - pos);
+    pos = nl == std::string_view::npos ? text.size() : nl + 1;
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return line;
+}
+
+void parse_piece(std::string_view text, bool hashed, Piece& piece) {
+    std::vector<std::string_view> fields;
+    std::string err;
+    for (std::size_t pos = 0; pos < text.size();) {
+        std::string_view line = next_line(text, pos);
+        std::size_t n = ++piece.lines;
+        if (line.find_first_not_of(" \t") == std::string_view::npos) continue;
+        auto reject = [&](std::string reason) { piece.errors.emplace_back(n, std::move(reason)); };
+
+        if (!split_fields(line, piece.unescaped, fields, err)) { reject(err); continue; }
+        if (fields.size() < 2 || fields.size() > 3) {
+            reject("Expected 2 or 3 fields, found " + std::to_string(fields.size()) + ".");
+            continue;
+        }
+        Row row{n, fields[0], {}, {}, Money()};
+        if (!Bank::valid_username(row.username, err)) { reject(err); continue; }
+        if (hashed) {
+            if (!digest_from_hex(fields[1], row.digest)) { reject("password_sha256 must be 64 lowercase hex digits."); continue; }
+        } else {
+            if (fields[1].size() < 4) { reject("Password must be at least 4 characters."); continue; }
+            row.password = fields[1];
+        }
+        if (fields.size() == 3 && !fields[2].empty()) {
+            if (!Money::parse(fields[2], row.balance)) { reject("Invalid balance '" + std::string(fields[2]) + "'."); continue; }
+            if (row.balance < Money()) { reject("Initial balance cannot be negative."); continue; }
+        }
+        piece.rows.push_back(row);
+    }
+
+    // Eight (AVX2) or four (SSE2) passwords per SHA-256 pass.
+    std::string_view msgs[8];
+    std::uint8_t digests[8 * 32];
+    for (std::size_t base = 0; base < piece.rows.size() && !hashed; base += 8) {
+        std::size_t m = std::min<std::size_t>(8, piece.rows.size() - base);
+        for (std::size_t i = 0; i < m; ++i) msgs[i] = piece.rows[base + i].password;
+        picosha2::hash256_batch(msgs, m, digests);
+        for (std::size_t i = 0; i < m; ++i) {
+            std::memcpy(piece.rows[base + i].digest.data(), digests + 32 * i, 32);
+            piece.rows[base + i].password = {};
+        }
+    }
+}
+
+// Quotes a field for CSV output when it needs it (usernames from before validation existed).
+void append_field(std::string& out, std::string_view s) {
+    if (s.find_first_of(",\"\r\n") == std::string_view::npos && !s.empty()) { out.append(s); return; }
+    out += '"';
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+} // namespace
+
+ImportStats import_csv(Bank& bank, const std::filesystem::path& path, const ImportOptions& opts, std::ostream& errors) {
+    auto t0 = Clock::now();
+    ImportStats st;
+    snapshot::MappedFile file;
+    std::string err;
+    if (!file.open(path, err)) throw std::runtime_error(err);
+    std::string_view text(file.data(), file.size());
+
+    // The header, if any, decides the password column for the whole file.
+    bool hashed = false;
+    std::size_t first_line = 1;
+    {
+        std::size_t pos = 0;
+        std::string_view line = next_line(text, pos);
+        std::deque<std::string> store;
+        std::vector<std::string_view> fields;
+        if (split_fields(line, store, fields, err) && !fields.empty() && fields[0] == "username") {
+            hashed = fields.size() > 1 && fields[1] == "password_sha256";
+            text.remove_prefix(pos);
+            first_line = 2;
+        }
+    }
+
+    unsigned threads = parallel::threads_for(opts.threads);
+    // Pieces of at least 1 MiB, a few per thread so one slow piece does not hold up the rest.
+    auto texts = parallel::split_lines(text, std::min<std::size_t>(threads * 4, text.size() / (1 << 20) + 1));
+    std::vector<Piece> pieces(texts.size());
+    parallel::for_each(texts.size(), threads, [&](std::size_t p) { parse_piece(texts[p], hashed, pieces[p]); });
+
+    // Merge in file order, turning piece-local line numbers into file line numbers.
+    std::vector<std::size_t> line_base(pieces.size()), row_base(pieces.size());
+    std::size_t lines = first_line - 1, rows = 0;
+    std::vector<std::pair<std::size_t, std::string>> rejected;
+    for (std::size_t p = 0; p < pieces.size(); ++p) {
+        line_base[p] = lines;
+        row_base[p] = rows;
+        lines += pieces[p].lines;
+        rows += pieces[p].rows.size();
+        for (auto& e : pieces[p].errors) rejected.emplace_back(line_base[p] + e.first, std::move(e.second));
+    }
+    st.rows = rows + rejected.size();
+    std::vector<NewAccount> accounts(rows);
+    std::vector<std::size_t> line_of(rows);
+    parallel::for_each(pieces.size(), threads, [&](std::size_t p) {
+        for (std::size_t i = 0; i < pieces[p].rows.size(); ++i) {
+            const Row& r = pieces[p].rows[i];
+            NewAccount& a = accounts[row_base[p] + i];
+            a.username = r.username;
+            a.digest = r.digest;
+            a.balance = r.balance;
+            line_of[row_base[p] + i] = line_base[p] + r.line;
+        }
+    });
+    st.parse_seconds = seconds_since(t0);
+
+    auto t1 = Clock::now();
+    st.imported = bank.import_accounts(accounts);
+    st.apply_seconds = seconds_since(t1);
+
+    for (std::size_t i = 0; i < accounts.size(); ++i) {
+        const NewAccount& a = accounts[i];
+        if (a.err.empty()) continue;
+        if (a.duplicate_of != SIZE_MAX) {
+            rejected.emplace_back(line_of[i], "Duplicate username (first on line " + std::to_string(line_of[a.duplicate_of]) + ").");
+        } else {
+            rejected.emplace_back(line_of[i], a.err);
+        }
+    }
+    std::sort(rejected.begin(), rejected.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (const auto& [line, reason] : rejected) errors << "line " << line << ": " << reason << "\n";
+
+    st.lines = lines;
+    st.rejected = rejected.size();
+    st.seconds = seconds_since(t0);
+    return st;
+}
+
+ExportStats export_csv(Bank& bank, std::ostream& out, unsigned threads) {
+    auto t0 = Clock::now();
+    ExportStats st;
+    BalanceSnapshot snap = bank.snapshot();
+    out << "username,password_sha256,balance\n";
+
+    // Parts are formatted a window at a time and written in order, so memory stays at one
+    // window of text however many accounts there are.
+    unsigned n = parallel::threads_for(threads);
+    std::vector<std::string> bufs(n);
+    std::vector<std::size_t> counts(n);
+    for (std::size_t first = 0; first < snap.parts(); first += n) {
+        std::size_t m = std::min<std::size_t>(n, snap.parts() - first);
+        parallel::for_each(m, n, [&](std::size_t k) {
+            std::string& buf = bufs[k];
+            buf.clear();
+            counts[k] = 0;
+            snap.for_each_row_in(first + k, [&](std::string_view username, std::string_view hash, Money balance) {
+                append_field(buf, username);
+                buf += ',';
+                buf.append(hash);
+                buf += ',';
+                balance.append_to(buf);
+                buf += '\n';
+                ++counts[k];
+            });
+        });
+        for (std::size_t k = 0; k < m; ++k) {
+            out.write(bufs[k].data(), static_cast<std::streamsize>(bufs[k].size()));
+            st.rows += counts[k];
+        }
+    }
+    out.flush();
+    if (!out) throw std::runtime_error("Failed to write the export.");
+    st.seconds = seconds_since(t0);
+    return st;
+}
+
+} // namespace bulk
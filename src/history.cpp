@@ -0,0 +1,153 @@
+#include "history.hpp"
+#include "parallel.hpp"
+#include "timestamp.hpp"
+
+#include <fstream>
+#include <algorithm>
+
+namespace history {
+
+std::int64_t timestamp_key(std::string_view iso) {
+    timestamp::Micros t;
+    return timestamp::parse(iso, t) ? t : 0;
+}
+
+static bool read_entry(std::ifstream& in, std::size_t i, IndexEntry& e) {
+    in.seekg(static_cast<std::streamoff>(i * sizeof(IndexEntry)));
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&e), sizeof(e)));
+}
+
+void sync_index(const std::filesystem::path& log, const std::filesystem::path& idx) {
+    std::error_code ec;
+    std::uint64_t log_size = std::filesystem::exists(log, ec) ? std::filesystem::file_size(log, ec) : 0;
+    std::uint64_t idx_size = std::filesystem::exists(idx, ec) ? std::filesystem::file_size(idx, ec) : 0;
+    std::size_t n = static_cast<std::size_t>(idx_size / sizeof(IndexEntry));
+
+    // Drop a torn entry and any entries that point past the end of the log.
+    std::uint64_t covered = 0;
+    {
+        std::ifstream in(idx, std::ios::binary);
+        IndexEntry e{};
+        if (n > 0 && read_entry(in, 0, e) && e.ts_key > 0 && e.ts_key < kLegacyKeyLimit) n = 0;
+        while (n > 0 && (!read_entry(in, n - 1, e) || e.offset >= log_size)) --n;
+        if (n > 0) {
+            std::ifstream lin(log, std::ios::binary);
+            lin.seekg(static_cast<std::streamoff>(e.offset));
+            std::string line;
+            if (std::getline(lin, line) && !lin.eof()) covered = e.offset + line.size() + 1;
+            else covered = e.offset; // last indexed line is incomplete; re-scan it
+            if (covered == e.offset) --n;
+        }
+    }
+    if (n * sizeof(IndexEntry) != idx_size) std::filesystem::resize_file(idx, n * sizeof(IndexEntry), ec);
+    if (covered >= log_size) return;
+
+    // Index complete lines the index does not know about yet.
+    std::ifstream lin(log, std::ios::binary);
+    lin.seekg(static_cast<std::streamoff>(covered));
+    std::ofstream out(idx, std::ios::binary | std::ios::app);
+    std::string line;
+    std::uint64_t off = covered;
+    while (std::getline(lin, line)) {
+        if (lin.eof()) break; // no trailing newline: still being written
+        IndexEntry e{off, timestamp_key(std::string_view(line).substr(0, line.find('|')))};
+        out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+        off += line.size() + 1;
+    }
+}
+
+std::size_t count(const std::filesystem::path& idx) {
+    std::error_code ec;
+    std::uint64_t size = std::filesystem::file_size(idx, ec);
+    return ec ? 0 : static_cast<std::size_t>(size / sizeof(IndexEntry));
+}
+
+std::size_t lower_bound(const std::filesystem::path& idx, std::int64_t key, bool upper) {
+    std::ifstream in(idx, std::ios::binary);
+    std::size_t lo = 0, hi = count(idx);
+    IndexEntry e{};
+    while (lo < hi) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        if (!read_entry(in, mid, e)) break;
+        if (e.ts_key < key || (upper && e.ts_key == key)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+std::vector<Transaction> read(const std::filesystem::path& log, const std::filesystem::path& idx,
+                              std::size_t first, std::size_t limit,
+                              const std::function<AccountId(std::string_view)>& resolve) {
+    std::vector<Transaction> out;
+    std::size_t n = count(idx);
+    if (first >= n || limit == 0) return out;
+    limit = std::min(limit, n - first);
+
+    std::ifstream iin(idx, std::ios::binary);
+    IndexEntry e{};
+    if (!read_entry(iin, first, e)) return out;
+
+    // Records of a page are contiguous in the log: one seek, then sequential reads.
+    std::ifstream lin(log, std::ios::binary);
+    lin.seekg(static_cast<std::streamoff>(e.offset));
+    out.reserve(limit);
+    std::string line;
+    std::string_view counterparty;
+    while (out.size() < limit && std::getline(lin, line)) {
+        if (lin.eof()) break; // incomplete trailing line
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        Transaction tx;
+        if (!parse_transaction_line(line, tx, counterparty)) continue;
+        if (!counterparty.empty()) tx.counterparty = resolve(counterparty);
+        out.push_back(std::move(tx));
+    }
+    return out;
+}
+
+std::size_t stream_log(const std::filesystem::path& log, const RecordVisitor& visit) {
+    std::ifstream in(log, std::ios::binary);
+    if (!in) return 0;
+    std::size_t malformed = 0;
+    std::string line;
+    std::string_view counterparty;
+    Transaction tx;
+    while (std::getline(in, line)) {
+        if (in.eof()) break; // no trailing newline: torn or still being written
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!parse_transaction_line(line, tx, counterparty)) { ++malformed; continue; }
+        visit(tx, counterparty);
+    }
+    return malformed;
+}
+
+std::vector<LogRecord> read_log(const std::filesystem::path& log) {
+    std::vector<LogRecord> out;
+    stream_log(log, [&](const Transaction& tx, std::string_view counterparty) {
+        out.push_back(LogRecord{tx, std::string(counterparty)});
+    });
+    return out;
+}
+
+std::size_t for_each_log(const std::filesystem::path& dir, unsigned threads,
+                         const std::function<void(const std::string&, const std::filesystem::path&)>& fn) {
+    std::vector<std::pair<std::uintmax_t, std::filesystem::path>> logs;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() != ".log") continue;
+        std::error_code size_ec;
+        logs.emplace_back(it->file_size(size_ec), it->path());
+    }
+    // Largest first, so a few big logs do not end up alone at the tail of the run.
+    std::sort(logs.begin(), logs.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    parallel::for_each(logs.size(), threads, [&](std::size_t i) { fn(logs[i].second.stem().string(), logs[i].second); });
+    return logs.size();
+}
+
+std::size_t scan_logs(const std::filesystem::path& dir, unsigned threads, const LogVisitor& visit) {
+    return for_each_log(dir, threads, [&](const std::string& username, const std::filesystem::path& log) {
+        std::vector<LogRecord> records = read_log(log);
+        visit(username, records);
+    });
+}
+
+} // namespace history
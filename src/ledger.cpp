@@ -0,0 +1,357 @@
+#include "ledger.hpp"
+#include "history.hpp"
+#include "parallel.hpp"
+
+#include <fstream>
+#include <ostream>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <optional>
+#include <tuple>
+
+namespace ledger {
+
+const char* name(Issue issue) {
+    switch (issue) {
+        case Issue::ChainBreak: return "chain_break";
+        case Issue::BalanceMismatch: return "balance_mismatch";
+        case Issue::MissingLog: return "missing_log";
+        case Issue::OrphanLog: return "orphan_log";
+        case Issue::UnmatchedTransferOut: return "unmatched_transfer_out";
+        case Issue::UnmatchedTransferIn: return "unmatched_transfer_in";
+        case Issue::MalformedLine: return "malformed_line";
+        case Issue::Count: break;
+    }
+    return "unknown";
+}
+
+std::size_t Report::issues() const {
+    std::size_t n = 0;
+    for (std::size_t c : counts) n += c;
+    return n;
+}
+
+namespace {
+
+// Shared state of one run. Findings are rare, so one mutex covers them.
+class Collector {
+public:
+    Collector(Report& report, std::size_t max_findings) : report_(report), max_(max_findings) {}
+
+    void add(Issue issue, const std::string& username, std::string detail) {
+        std::lock_guard<std::mutex> lk(mu_);
+        ++report_.counts[static_cast<std::size_t>(issue)];
+        if (report_.findings.size() < max_) report_.findings.push_back(Finding{issue, username, std::move(detail)});
+    }
+    void repaired() {
+        std::lock_guard<std::mutex> lk(mu_);
+        ++report_.repaired;
+    }
+
+private:
+    std::mutex mu_;
+    Report& report_;
+    std::size_t max_;
+};
+
+// Transfer legs, one line each: "payer|payee|cents|micros|O" (or "|I"). Lines go to the
+// partition picked by hashing payer|payee|cents, so both legs of a transfer land in the same
+// file and can be matched without looking at any other, even when their times differ.
+class LegSpill {
+public:
+    LegSpill(const std::filesystem::path& dir, std::size_t partitions) : dir_(dir), parts_(partitions) {
+        std::filesystem::remove_all(dir_);
+        std::filesystem::create_directories(dir_);
+        for (std::size_t i = 0; i < parts_.size(); ++i) {
+            parts_[i].out.open(path(i), std::ios::binary);
+            if (!parts_[i].out) throw std::runtime_error("Cannot write " + path(i).string());
+        }
+    }
+    ~LegSpill() {
+        std::error_code ec;
+        std::filesystem::remove_all(dir_, ec);
+    }
+
+    std::size_t partitions() const { return parts_.size(); }
+    std::filesystem::path path(std::size_t i) const { return dir_ / ("legs." + std::to_string(i)); }
+
+    // Per-log buffers, handed over a partition at a time once they fill up.
+    class Writer {
+    public:
+        explicit Writer(LegSpill& spill) : spill_(spill), buf_(spill.partitions()) {}
+        ~Writer() { flush(); }
+
+        void add(std::string_view payer, std::string_view payee, Money amount, timestamp::Micros when, bool out) {
+            line_.assign(payer.data(), payer.size());
+            line_ += '|';
+            line_.append(payee.data(), payee.size());
+            line_ += '|';
+            line_ += std::to_string(amount.cents());
+            std::size_t p = std::hash<std::string>{}(line_) % buf_.size();
+            line_ += '|';
+            line_ += std::to_string(when);
+            line_ += out ? "|O\n" : "|I\n";
+            buf_[p] += line_;
+            if (buf_[p].size() >= kFlushBytes) spill_.write(p, buf_[p]);
+        }
+        void flush() {
+            for (std::size_t p = 0; p < buf_.size(); ++p) spill_.write(p, buf_[p]);
+        }
+
+    private:
+        static constexpr std::size_t kFlushBytes = 64 * 1024;
+        LegSpill& spill_;
+        std::vector<std::string> buf_;
+        std::string line_;
+    };
+
+    void write(std::size_t p, std::string& data) {
+        if (data.empty()) return;
+        Part& part = parts_[p];
+        std::lock_guard<std::mutex> lk(part.mu);
+        part.out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!part.out) throw std::runtime_error("Cannot write " + path(p).string());
+        data.clear();
+    }
+    void close() {
+        for (std::size_t i = 0; i < parts_.size(); ++i) {
+            parts_[i].out.close();
+            if (!parts_[i].out) throw std::runtime_error("Cannot write " + path(i).string());
+        }
+    }
+
+private:
+    struct Part {
+        std::mutex mu;
+        std::ofstream out;
+    };
+    std::filesystem::path dir_;
+    std::vector<Part> parts_;
+};
+
+std::string money_str(Money m) { return m.to_string(); }
+
+// Phase 1 for one log: walk the balance chain, spill the transfer legs, then compare the final
+// balance with the account.
+void check_log(Bank& bank, const Options& opts, Collector& found, LegSpill& spill,
+               const std::string& username, const history::AccountStream& stream, std::size_t& records) {
+    LegSpill::Writer legs(spill);
+    Money running;
+    bool chain_ok = true;
+    std::size_t line = 0;
+    std::size_t malformed = stream([&](const Transaction& tx, std::string_view counterparty) {
+        ++line;
+        Money expected;
+        bool ok;
+        switch (tx.type) {
+            case TxType::Deposit:
+            case TxType::InitialDeposit:
+            case TxType::TransferIn:
+            case TxType::Adjustment:
+                ok = Money::add(running, tx.amount, expected);
+                break;
+            case TxType::Withdraw:
+            case TxType::TransferOut:
+                ok = Money::sub(running, tx.amount, expected);
+                break;
+            default:
+                ok = false;
+        }
+        if (!ok || expected != tx.balance_after) {
+            chain_ok = false;
+            found.add(Issue::ChainBreak, username,
+                      "line " + std::to_string(line) + " (" + timestamp::iso(tx.timestamp) + "): expected " + money_str(expected) +
+                      ", logged " + money_str(tx.balance_after));
+        }
+        running = tx.balance_after; // resync, so one bad line is reported once
+
+        if (tx.type == TxType::TransferOut) {
+            legs.add(username, counterparty, tx.amount, tx.timestamp, true);
+        } else if (tx.type == TxType::TransferIn) {
+            legs.add(counterparty, username, tx.amount, tx.timestamp, false);
+        }
+    });
+    records = line;
+    if (malformed > 0) {
+        chain_ok = false;
+        found.add(Issue::MalformedLine, username, std::to_string(malformed) + " line(s) do not parse");
+    }
+
+    std::optional<Money> balance = bank.balance_of(username);
+    if (!balance) {
+        found.add(Issue::OrphanLog, username, "log without an account");
+        return;
+    }
+    if (*balance == running) return;
+    found.add(Issue::BalanceMismatch, username,
+              "account " + money_str(*balance) + ", log " + money_str(running));
+
+    std::string err;
+    if (opts.repair == Repair::Logs) {
+        if (bank.log_adjustment(username, running, err)) found.repaired();
+    } else if (opts.repair == Repair::Accounts && chain_ok) {
+        if (bank.set_balance_from_log(username, running, err)) found.repaired();
+    }
+}
+
+// Logs written before microsecond timestamps stamped the two legs of a transfer with separate
+// whole-second clock reads, so a correct legacy pair can be a second apart.
+constexpr timestamp::Micros kSecond = 1000000;
+
+bool legacy_pair(timestamp::Micros out, timestamp::Micros in) {
+    return out % kSecond == 0 && in % kSecond == 0 && (out > in ? out - in : in - out) <= kSecond;
+}
+
+struct Leg {
+    std::string key; // payer|payee|cents
+    timestamp::Micros when;
+    bool out;
+};
+
+void report_unmatched(Collector& found, const Leg& leg) {
+    std::size_t a = leg.key.find('|'), b = leg.key.find('|', a + 1);
+    std::string payer = leg.key.substr(0, a), payee = leg.key.substr(a + 1, b - a - 1);
+    Money amount = Money::from_cents(std::stoll(leg.key.substr(b + 1)));
+    std::string when = timestamp::iso(leg.when);
+    if (leg.out) {
+        found.add(Issue::UnmatchedTransferOut, payer, money_str(amount) + " to " + payee + " at " + when + " has no TRANSFER_IN");
+    } else {
+        found.add(Issue::UnmatchedTransferIn, payee, money_str(amount) + " from " + payer + " at " + when + " has no TRANSFER_OUT");
+    }
+}
+
+// Phase 3 for one partition: sort the legs so both sides of a transfer sit next to each other,
+// then pair OUT and IN legs with the same payer, payee, amount and time. Legacy legs left over
+// are paired within a second of each other, in time order.
+std::size_t match_partition(const std::filesystem::path& path, Collector& found) {
+    std::vector<Leg> legs;
+    {
+        std::ifstream in(path, std::ios::binary);
+        for (std::string line; std::getline(in, line);) {
+            if (line.size() <= 2) continue;
+            std::size_t c = line.rfind('|', line.size() - 3);
+            legs.push_back(Leg{line.substr(0, c), std::stoll(line.substr(c + 1, line.size() - 3 - c)), line.back() == 'O'});
+        }
+    }
+    std::sort(legs.begin(), legs.end(), [](const Leg& x, const Leg& y) {
+        return std::tie(x.key, x.when, x.out) < std::tie(y.key, y.when, y.out);
+    });
+    std::size_t matched = 0;
+    std::vector<const Leg*> outs, ins; // left over after exact matching, in time order
+    for (std::size_t i = 0; i < legs.size();) {
+        outs.clear();
+        ins.clear();
+        std::size_t end = i;
+        while (end < legs.size() && legs[end].key == legs[i].key) ++end;
+        for (std::size_t j = i; j < end;) {
+            std::size_t k = j, n_out = 0, n_in = 0;
+            for (; k < end && legs[k].when == legs[j].when; ++k) (legs[k].out ? n_out : n_in) += 1;
+            matched += std::min(n_out, n_in);
+            // Within a run the IN legs sort before the OUT legs.
+            for (std::size_t s = n_out; s < n_in; ++s) ins.push_back(&legs[j + s]);
+            for (std::size_t s = n_in; s < n_out; ++s) outs.push_back(&legs[k - 1 - (s - n_in)]);
+            j = k;
+        }
+        std::size_t o = 0, n = 0;
+        while (o < outs.size() && n < ins.size()) {
+            if (legacy_pair(outs[o]->when, ins[n]->when)) {
+                ++matched;
+                outs[o++] = nullptr;
+                ins[n++] = nullptr;
+            } else if (outs[o]->when < ins[n]->when) {
+                ++o;
+            } else {
+                ++n;
+            }
+        }
+        for (const Leg* leg : outs) if (leg) report_unmatched(found, *leg);
+        for (const Leg* leg : ins) if (leg) report_unmatched(found, *leg);
+        i = end;
+    }
+    return matched;
+}
+
+} // namespace
+
+Report verify(Bank& bank, const Options& opts) {
+    auto t0 = std::chrono::steady_clock::now();
+    Report report;
+    Collector found(report, opts.max_findings);
+    bank.flush_logs();
+
+    bool was_deferred = bank.deferred();
+    if (opts.repair != Repair::None) bank.set_deferred(true); // one commit for all repairs
+
+    std::filesystem::path work = opts.work_dir.empty() ? bank.transactions_dir().parent_path() / "verify.tmp"
+                                                       : opts.work_dir;
+    LegSpill spill(work, std::max<std::size_t>(1, opts.partitions));
+
+    // Phase 1: every account's log.
+    std::atomic<std::size_t> records{0};
+    std::mutex seen_mu;
+    std::vector<std::string> seen;
+    report.logs = bank.for_each_history(opts.threads,
+                                        [&](const std::string& username, const history::AccountStream& stream) {
+        std::size_t n = 0;
+        check_log(bank, opts, found, spill, username, stream, n);
+        records.fetch_add(n, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(seen_mu);
+        seen.push_back(username);
+    });
+    report.records = records.load();
+    spill.close();
+
+    // Phase 2: accounts holding money without any log to account for it.
+    std::sort(seen.begin(), seen.end());
+    auto accounts = bank.all_accounts();
+    report.accounts = accounts.size();
+    for (const auto& [username, balance] : accounts) {
+        if (balance == Money() || std::binary_search(seen.begin(), seen.end(), username)) continue;
+        found.add(Issue::MissingLog, username, "account " + money_str(balance) + ", no log");
+        std::string err;
+        if (opts.repair == Repair::Logs && bank.log_adjustment(username, Money(), err)) found.repaired();
+    }
+    accounts.clear();
+    accounts.shrink_to_fit();
+
+    // Phase 3: pair the transfer legs, one partition per task.
+    std::atomic<std::size_t> matched{0};
+    parallel::for_each(spill.partitions(), opts.threads, [&](std::size_t p) {
+        matched.fetch_add(match_partition(spill.path(p), found), std::memory_order_relaxed);
+    });
+    report.transfers_matched = matched.load();
+
+    if (opts.repair != Repair::None) {
+        bank.commit();
+        bank.set_deferred(was_deferred);
+    }
+    std::sort(report.findings.begin(), report.findings.end(), [](const Finding& a, const Finding& b) {
+        return std::tie(a.username, a.issue) < std::tie(b.username, b.issue);
+    });
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return report;
+}
+
+void write_report(std::ostream& os, const Report& report) {
+    os << "Ledger verification: " << report.logs << " logs, " << report.records << " records, "
+       << report.accounts << " accounts, " << report.transfers_matched << " transfers matched in "
+       << report.seconds << " s\n";
+    for (std::size_t i = 0; i < report.counts.size(); ++i) {
+        if (report.counts[i] > 0) os << "  " << name(static_cast<Issue>(i)) << ": " << report.counts[i] << "\n";
+    }
+    for (const Finding& f : report.findings) {
+        os << "  [" << name(f.issue) << "] " << f.username << ": " << f.detail << "\n";
+    }
+    if (report.findings.size() < report.issues()) {
+        os << "  ... " << report.issues() - report.findings.size() << " more\n";
+    }
+    if (report.repaired > 0) os << "Repaired: " << report.repaired << "\n";
+    os << (report.issues() == 0 ? "Ledger is consistent.\n" : "Discrepancies found.\n");
+}
+
+} // namespace ledger
@@ -0,0 +1,105 @@
+#include "lz.hpp"
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+namespace lz {
+
+namespace {
+
+constexpr std::size_t kMinMatch = 4;
+constexpr std::size_t kMaxOffset = 65535;
+constexpr unsigned kHashBits = 14;
+
+std::uint32_t load32(const char* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+std::uint32_t hash4(const char* p) {
+    return (load32(p) * 2654435761u) >> (32 - kHashBits);
+}
+
+void put_length(std::string& out, std::size_t n) {
+    for (; n >= 255; n -= 255) out += static_cast<char>(255);
+    out += static_cast<char>(n);
+}
+
+void put_sequence(std::string& out, const char* lit, std::size_t lit_len, std::size_t offset, std::size_t match_len) {
+    std::size_t ml = match_len ? match_len - kMinMatch : 0;
+    unsigned token = (lit_len < 15 ? static_cast<unsigned>(lit_len) : 15u) << 4;
+    token |= ml < 15 ? static_cast<unsigned>(ml) : 15u;
+    out += static_cast<char>(token);
+    if (lit_len >= 15) put_length(out, lit_len - 15);
+    out.append(lit, lit_len);
+    if (match_len == 0) return;
+    out += static_cast<char>(offset & 0xff);
+    out += static_cast<char>(offset >> 8);
+    if (ml >= 15) put_length(out, ml - 15);
+}
+
+bool get_length(std::string_view in, std::size_t& pos, std::size_t& n) {
+    for (;;) {
+        if (pos >= in.size()) return false;
+        auto b = static_cast<unsigned char>(in[pos++]);
+        n += b;
+        if (b != 255) return true;
+    }
+}
+
+} // namespace
+
+void compress(std::string_view in, std::string& out) {
+    const char* base = in.data();
+    const std::size_t n = in.size();
+    std::vector<std::uint32_t> table(std::size_t(1) << kHashBits, 0); // position + 1; 0 = empty
+    std::size_t anchor = 0, i = 0;
+    // Leave the last bytes as literals so the 4-byte loads never run past the end.
+    const std::size_t limit = n > kMinMatch + 8 ? n - kMinMatch - 8 : 0;
+    while (i < limit) {
+        std::uint32_t h = hash4(base + i);
+        std::size_t candidate = table[h];
+        table[h] = static_cast<std::uint32_t>(i + 1);
+        if (candidate == 0 || i - (candidate - 1) > kMaxOffset || load32(base + candidate - 1) != load32(base + i)) {
+            ++i;
+            continue;
+        }
+        std::size_t ref = candidate - 1;
+        std::size_t len = kMinMatch;
+        while (i + len < n && base[ref + len] == base[i + len]) ++len;
+        put_sequence(out, base + anchor, i - anchor, i - ref, len);
+        i += len;
+        anchor = i;
+    }
+    put_sequence(out, base + anchor, n - anchor, 0, 0);
+}
+
+bool decompress(std::string_view in, std::size_t raw_size, std::string& out) {
+    out.clear();
+    out.reserve(raw_size);
+    std::size_t pos = 0;
+    while (pos < in.size()) {
+        auto token = static_cast<unsigned char>(in[pos++]);
+        std::size_t lit = token >> 4;
+        if (lit == 15 && !get_length(in, pos, lit)) return false;
+        if (lit > in.size() - pos || out.size() + lit > raw_size) return false;
+        out.append(in.data() + pos, lit);
+        pos += lit;
+        if (pos == in.size()) break; // last sequence: literals only
+        if (in.size() - pos < 2) return false;
+        std::size_t offset = static_cast<unsigned char>(in[pos]) | (static_cast<std::size_t>(static_cast<unsigned char>(in[pos + 1])) << 8);
+        pos += 2;
+        std::size_t len = token & 15;
+        if (len == 15 && !get_length(in, pos, len)) return false;
+        len += kMinMatch;
+        if (offset == 0 || offset > out.size() || out.size() + len > raw_size) return false;
+        // Byte by byte: the match may overlap the bytes it produces (runs).
+        std::size_t from = out.size() - offset;
+        for (std::size_t k = 0; k < len; ++k) out += out[from + k];
+    }
+    return out.size() == raw_size;
+}
+
+} // namespace lz
@@ -3,8 +3,18 @@
 #include <fstream>
 #include <sstream>
 #include <filesystem>
+#include <cstdlib>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <csignal>
 
 #include "bank.hpp"
+#include "batch.hpp"
+#include "bulk.hpp"
+#include "ledger.hpp"
+#include "reports.hpp"
+#include "server.hpp"
 #include "utils.hpp"
 
 static void print_user_menu(bool is_admin) {
@@ -16,40 +26,298 @@ static void print_user_menu(bool is_admin) {
     std::cout << "5. View Transaction History\n";
     if (is_admin) {
         std::cout << "6. [Admin] View All Accounts\n";
-        std::cout << "7. Logout\n";
+        std::cout << "7. [Admin] Show Metrics\n";
+        std::cout << "8. [Admin] Balance Report\n";
+        std::cout << "9. Logout\n";
     } else {
         std::cout << "6. Logout\n";
     }
     std::cout << "Select option: ";
 }
 
-static void view_history(const std::string& username) {
-    std::filesystem::path file = std::filesystem::path("data/transactions") / (username + ".log");
-    std::ifstream in(file);
-    if (!in) {
+// Reads one line and parses it as a decimal amount ("12.50").
+static bool read_amount(Money& out) {
+    std::string line;
+    if (!std::getline(std::cin, line)) { utils::clear_input(); return false; }
+    std::size_t b = line.find_first_not_of(" \t\r");
+    std::size_t e = line.find_last_not_of(" \t\r");
+    if (b == std::string::npos) return false;
+    return Money::parse(std::string_view(line).substr(b, e - b + 1), out);
+}
+
+static void view_history(Bank& bank, const std::string& username) {
+    const std::size_t page = 20;
+    std::size_t total = bank.history_size(username);
+    if (total == 0) {
         std::cout << "No history available." << std::endl;
         return;
     }
-    std::cout << "\n-- Transaction History for '" << username << "' --\n";
+    std::cout << "\n-- Transaction History for '" << username << "' (" << total << " records) --\n";
+    // Newest page first; each page is printed oldest to newest.
+    std::size_t end = total;
+    while (end > 0) {
+        std::size_t begin = end > page ? end - page : 0;
+        for (const auto& tx : bank.history(username, begin, end - begin)) {
+            std::string counterparty;
+            if (tx.counterparty != kNoAccount) counterparty = bank.username_of(tx.counterparty).value_or("?");
+            std::cout << timestamp::iso(tx.timestamp) << " | " << to_string(tx.type) << " | Amount: " << tx.amount << " | Balance: " << tx.balance_after
+                      << " | " << describe(tx.type, counterparty) << "\n";
+        }
+        end = begin;
+        if (end == 0) break;
+        std::cout << "Show older transactions? (y/n): ";
+        std::string answer;
+        if (!std::getline(std::cin, answer) || answer.empty() || (answer[0] != 'y' && answer[0] != 'Y')) break;
+    }
+}
+
+static void print_accounts(const std::vector<std::pair<std::string,Money>>& rows) {
+    for (const auto& p : rows) std::cout << p.first << " | Balance: " << p.second << "\n";
+}
+
+static bool ask_more(const char* prompt) {
+    std::cout << prompt << " (y/n): ";
+    std::string ans;
+    std::getline(std::cin, ans);
+    return !ans.empty() && (ans[0] == 'y' || ans[0] == 'Y');
+}
+
+// Admin account browser, answered from the bank's ordered indexes.
+static void view_accounts(Bank& bank) {
+    const std::size_t page = 20;
+    std::cout << "\n-- Accounts (" << bank.account_count() << " total) --\n";
+    std::cout << "1. List by username\n";
+    std::cout << "2. Search by username prefix\n";
+    std::cout << "3. Top 10 richest\n";
+    std::cout << "4. Top 10 poorest\n";
+    std::cout << "5. Count accounts in balance range\n";
+    std::cout << "Select option: ";
     std::string line;
-    int count = 0;
-    while (std::getline(in, line)) {
-        std::istringstream iss(line);
-        std::string ts, type, amount_str, bal_str, details;
-        if (std::getline(iss, ts, '|') && std::getline(iss, type, '|') &&
-            std::getline(iss, amount_str, '|') && std::getline(iss, bal_str, '|') && std::getline(iss, details)) {
-            std::cout << ts << " | " << type << " | Amount: " << amount_str << " | Balance: " << bal_str << " | " << details << "\n";
-            ++count;
+    std::getline(std::cin, line);
+    int choice = std::atoi(line.c_str());
+    if (choice == 1 || choice == 2) {
+        std::string prefix;
+        if (choice == 2) { std::cout << "Prefix: "; std::getline(std::cin, prefix); }
+        std::string after;
+        while (true) {
+            auto rows = bank.find_by_prefix(prefix, page, after);
+            if (rows.empty()) { std::cout << "No more accounts.\n"; break; }
+            print_accounts(rows);
+            if (rows.size() < page || !ask_more("Show more?")) break;
+            after = rows.back().first;
         }
+    } else if (choice == 3 || choice == 4) {
+        print_accounts(bank.top_balances(10, choice == 3));
+    } else if (choice == 5) {
+        Money lo, hi;
+        std::cout << "Minimum balance: "; if (!read_amount(lo)) { std::cout << "Invalid amount.\n"; return; }
+        std::cout << "Maximum balance: "; if (!read_amount(hi)) { std::cout << "Invalid amount.\n"; return; }
+        std::cout << bank.count_balance_range(lo, hi) << " account(s) with " << lo << " <= balance <= " << hi << "\n";
+    } else {
+        std::cout << "Invalid option.\n";
     }
-    if (count == 0) std::cout << "(empty)\n";
 }
 
-int main() {
+static void print_usage() {
+    std::cout << "Usage: banking_app [--snapshot-format text|binary] [--async-persist]\n"
+                 "                   [--metrics-file <path> [--metrics-interval <sec>]]\n"
+                 "       banking_app [--snapshot-format text|binary] [--async-persist] --batch <file|-> [--commit-every N] [--stop-on-error]\n"
+                 "       banking_app [--snapshot-format text|binary] --import <file.csv> [--threads N]\n"
+                 "       banking_app [--snapshot-format text|binary] --export <file|-> [--threads N]\n"
+                 "       banking_app [--snapshot-format text|binary] --verify [--repair logs|accounts] [--threads N]\n"
+                 "       banking_app [--snapshot-format text|binary] --report [--no-flows] [--threads N]\n"
+                 "       banking_app [--snapshot-format text|binary] [--async-persist] --serve <unix:path|[host:]port> [--workers N]\n"
+                 "       banking_app --log-layout segmented --compact-logs\n"
+                 "       banking_app --convert-snapshot <in> <out>   (text <-> binary, by input format)\n"
+                 "Every mode also takes --log-layout per-user|segmented (default per-user), and\n"
+                 "--sync-journal to fsync the journal before a mutation counts as durable.\n"
+                 "The menu, --batch and --serve also take --record <trace> (replay with bank_replay).\n";
+}
+
+#ifdef BANK_HAVE_SERVER
+static Server* g_server = nullptr;
+
+static int run_server(Bank& bank, const ServerOptions& opts) {
+    Server server(bank, opts);
+    g_server = &server;
+    auto on_signal = [](int) { if (g_server) g_server->stop(); };
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::cout << "Listening on " << server.address() << " (Ctrl+C to stop)" << std::endl;
+    server.run();
+    g_server = nullptr;
+    const metrics::Histogram& lat = server.latency();
+    std::cout << "Served " << server.requests() << " requests on " << server.connections() << " connections";
+    if (lat.count() > 0) {
+        std::cout << ", p50 " << lat.percentile_ns(50) / 1000.0 << " us, p99 " << lat.percentile_ns(99) / 1000.0 << " us";
+    }
+    if (server.refused() > 0) std::cout << "; refused " << server.refused() << " (out of file descriptors)";
+    std::cout << "\n";
+    return 0;
+}
+#endif
+
+static int run_batch(Bank& bank, const std::string& source, const batch::Options& opts) {
+    std::ifstream file;
+    if (source == "-") {
+        std::ios::sync_with_stdio(false); // batch mode never returns to the menu
+    } else {
+        file.open(source);
+        if (!file) { std::cerr << "Cannot open " << source << "\n"; return 1; }
+    }
+    std::istream& in = source == "-" ? std::cin : file;
+    batch::Stats st = batch::run(bank, in, opts, std::cerr);
+    double rate = st.seconds > 0 ? static_cast<double>(st.commands) / st.seconds : 0;
+    std::cout << st.commands << " commands (" << st.lines << " lines), "
+              << st.commands - st.failed << " applied, " << st.failed << " failed, "
+              << st.commits << " commit(s) in " << st.seconds << " s, "
+              << static_cast<long long>(rate) << " ops/s\n";
+    return st.failed == 0 ? 0 : 2;
+}
+
+static int run_import(Bank& bank, const std::string& source, unsigned threads) {
+    bulk::ImportOptions opts;
+    opts.threads = threads;
+    bulk::ImportStats st = bulk::import_csv(bank, source, opts, std::cerr);
+    double rate = st.seconds > 0 ? static_cast<double>(st.rows) / st.seconds : 0;
+    std::cout << st.rows << " rows (" << st.lines << " lines), " << st.imported << " imported, "
+              << st.rejected << " rejected in " << st.seconds << " s (parse and hash " << st.parse_seconds
+              << " s, apply " << st.apply_seconds << " s), " << static_cast<long long>(rate) << " rows/s\n";
+    return st.rejected == 0 ? 0 : 2;
+}
+
+static int run_export(Bank& bank, const std::string& target, unsigned threads) {
+    std::ofstream file;
+    if (target != "-") {
+        file.open(target, std::ios::binary | std::ios::trunc);
+        if (!file) { std::cerr << "Cannot open " << target << "\n"; return 1; }
+    }
+    std::ostream& out = target == "-" ? std::cout : file;
+    bulk::ExportStats st = bulk::export_csv(bank, out, threads);
+    // Keep stdout clean when the rows go there.
+    (target == "-" ? std::cerr : std::cout) << "Exported " << st.rows << " accounts in " << st.seconds << " s\n";
+    return 0;
+}
+
+int main(int argc, char** argv) {
     try {
+        BankOptions opts;
+        std::string batch_source;
+        batch::Options batch_opts;
+        std::string metrics_file;
+        long metrics_interval = 10;
+        bool verify = false;
+        bool compact_logs = false;
+        bool report = false;
+        std::string import_source, export_target;
+        std::string record_path;
+        reports::Options report_opts;
+#ifdef BANK_HAVE_SERVER
+        bool serve = false;
+        ServerOptions server_opts;
+#endif
+        ledger::Options verify_opts;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--convert-snapshot" && i + 2 < argc) {
+                std::string err;
+                bool ok = snapshot::is_binary(argv[i + 1]) ? snapshot::binary_to_text(argv[i + 1], argv[i + 2], err)
+                                                           : snapshot::text_to_binary(argv[i + 1], argv[i + 2], err);
+                if (!ok) { std::cerr << "Conversion failed: " << err << "\n"; return 1; }
+                std::cout << "Wrote " << argv[i + 2] << "\n";
+                return 0;
+            } else if (arg == "--snapshot-format" && i + 1 < argc) {
+                std::string fmt = argv[++i];
+                if (fmt == "binary") opts.snapshot_format = SnapshotFormat::Binary;
+                else if (fmt == "text") opts.snapshot_format = SnapshotFormat::Text;
+                else { print_usage(); return 1; }
+            } else if (arg == "--log-layout" && i + 1 < argc) {
+                std::string layout = argv[++i];
+                if (layout == "segmented") opts.txlog.layout = LogLayout::Segmented;
+                else if (layout == "per-user") opts.txlog.layout = LogLayout::PerUser;
+                else { print_usage(); return 1; }
+            } else if (arg == "--compact-logs") {
+                compact_logs = true;
+            } else if (arg == "--async-persist") {
+                opts.async_persistence = true;
+            } else if (arg == "--sync-journal") {
+                opts.sync_journal = true;
+            } else if (arg == "--batch" && i + 1 < argc) {
+                batch_source = argv[++i];
+            } else if (arg == "--import" && i + 1 < argc) {
+                import_source = argv[++i];
+            } else if (arg == "--export" && i + 1 < argc) {
+                export_target = argv[++i];
+            } else if (arg == "--commit-every" && i + 1 < argc) {
+                batch_opts.commit_every = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--metrics-file" && i + 1 < argc) {
+                metrics_file = argv[++i];
+            } else if (arg == "--metrics-interval" && i + 1 < argc) {
+                metrics_interval = std::max(1L, std::strtol(argv[++i], nullptr, 10));
+            } else if (arg == "--record" && i + 1 < argc) {
+                record_path = argv[++i];
+            } else if (arg == "--stop-on-error") {
+                batch_opts.stop_on_error = true;
+#ifdef BANK_HAVE_SERVER
+            } else if (arg == "--serve" && i + 1 < argc) {
+                serve = true;
+                server_opts.listen = argv[++i];
+            } else if (arg == "--workers" && i + 1 < argc) {
+                server_opts.workers = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+#endif
+            } else if (arg == "--verify") {
+                verify = true;
+            } else if (arg == "--report") {
+                report = true;
+            } else if (arg == "--no-flows") {
+                report_opts.flows = false;
+            } else if (arg == "--repair" && i + 1 < argc) {
+                std::string side = argv[++i];
+                if (side == "logs") verify_opts.repair = ledger::Repair::Logs;
+                else if (side == "accounts") verify_opts.repair = ledger::Repair::Accounts;
+                else { print_usage(); return 1; }
+            } else if (arg == "--threads" && i + 1 < argc) {
+                opts.load_threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+            } else {
+                print_usage();
+                return arg == "--help" ? 0 : 1;
+            }
+        }
+
         utils::ensure_data_dirs();
-        Bank bank;
+        Bank bank(opts);
         bank.load();
+        if (!record_path.empty()) bank.start_recording(record_path);
+        std::unique_ptr<metrics::FileDumper> dumper;
+        if (!metrics_file.empty()) {
+            dumper = std::make_unique<metrics::FileDumper>(bank.metrics(), metrics_file, std::chrono::seconds(metrics_interval));
+        }
+        if (!batch_source.empty()) return run_batch(bank, batch_source, batch_opts);
+        if (!import_source.empty()) return run_import(bank, import_source, opts.load_threads);
+        if (!export_target.empty()) return run_export(bank, export_target, opts.load_threads);
+#ifdef BANK_HAVE_SERVER
+        if (serve) return run_server(bank, server_opts);
+#endif
+        if (compact_logs) {
+            std::string err;
+            if (!bank.transaction_log().compact(err)) { std::cerr << "Compaction failed: " << err << "\n"; return 1; }
+            SegmentStore::Stats st = bank.transaction_log().segments()->stats();
+            std::cout << st.sealed_segments << " sealed segment(s), " << st.hot_bytes << " bytes; "
+                      << st.archives << " archive(s), " << st.archive_bytes << " bytes ("
+                      << st.archive_raw_bytes << " uncompressed)\n";
+            return 0;
+        }
+        if (verify) {
+            verify_opts.threads = opts.load_threads;
+            ledger::Report findings = ledger::verify(bank, verify_opts);
+            ledger::write_report(std::cout, findings);
+            return findings.issues() == 0 ? 0 : 2;
+        }
+        if (report) {
+            report_opts.threads = opts.load_threads;
+            reports::write_report(std::cout, reports::run(bank, bank.snapshot(), report_opts));
+            return 0;
+        }
 
         while (true) {
             std::cout << "\n====== Banking System ======\n";
@@ -62,14 +330,13 @@ int main() {
             utils::clear_input();
 
             if (choice == 1) {
-                std::string username; double initial_balance = 0.0; std::string err;
+                std::string username; Money initial_balance; std::string err;
                 std::cout << "Enter username: "; std::getline(std::cin, username);
                 std::string password = utils::get_password_masked("Enter password: ");
                 std::string confirm = utils::get_password_masked("Confirm password: ");
                 if (password != confirm) { std::cout << "Passwords do not match.\n"; continue; }
                 std::cout << "Initial balance (>=0): ";
-                if (!(std::cin >> initial_balance)) { std::cout << "Invalid amount.\n"; utils::clear_input(); continue; }
-                utils::clear_input();
+                if (!read_amount(initial_balance)) { std::cout << "Invalid amount.\n"; continue; }
                 if (!bank.create_account(username, password, initial_balance, err)) {
                     std::cout << "Failed: " << err << "\n";
                 } else {
@@ -78,81 +345,89 @@ int main() {
             } else if (choice == 2) {
                 std::string username; std::cout << "Username: "; std::getline(std::cin, username);
                 std::string password = utils::get_password_masked("Password: ");
-                auto acc_opt = bank.authenticate(username, password);
-                if (!acc_opt) { std::cout << "Invalid credentials.\n"; continue; }
+                auto session_opt = bank.authenticate(username, password);
+                if (!session_opt) { std::cout << "Invalid credentials.\n"; continue; }
+                const Session& session = *session_opt;
                 bool admin = bank.is_admin(username);
                 std::cout << "Welcome, " << username << (admin ? " [admin]" : "") << "!\n";
                 // user session
-                bool session = true;
-                while (session) {
+                bool logged_in = true;
+                while (logged_in) {
                     print_user_menu(admin);
                     int op = 0; if (!(std::cin >> op)) { utils::clear_input(); continue; }
                     utils::clear_input();
                     if (!admin) {
                         switch (op) {
                             case 1: {
-                                auto bal = bank.balance_of(username);
+                                auto bal = bank.balance_of(session);
                                 if (bal) std::cout << "Balance: " << *bal << "\n"; else std::cout << "Error reading balance.\n";
                                 break;
                             }
                             case 2: {
-                                std::cout << "Amount to deposit: "; double amt; if (!(std::cin >> amt)) { utils::clear_input(); std::cout << "Invalid amount.\n"; break; }
-                                utils::clear_input(); std::string err; if (bank.deposit(username, amt, err)) std::cout << "Deposit successful.\n"; else std::cout << "Failed: " << err << "\n";
+                                std::cout << "Amount to deposit: "; Money amt; if (!read_amount(amt)) { std::cout << "Invalid amount.\n"; break; }
+                                std::string err; if (bank.deposit(username, amt, err)) std::cout << "Deposit successful.\n"; else std::cout << "Failed: " << err << "\n";
                                 break;
                             }
                             case 3: {
-                                std::cout << "Amount to withdraw: "; double amt; if (!(std::cin >> amt)) { utils::clear_input(); std::cout << "Invalid amount.\n"; break; }
-                                utils::clear_input(); std::string err; if (bank.withdraw(username, amt, err)) std::cout << "Withdrawal successful.\n"; else std::cout << "Failed: " << err << "\n";
+                                std::cout << "Amount to withdraw: "; Money amt; if (!read_amount(amt)) { std::cout << "Invalid amount.\n"; break; }
+                                std::string err; if (bank.withdraw(username, amt, err)) std::cout << "Withdrawal successful.\n"; else std::cout << "Failed: " << err << "\n";
                                 break;
                             }
                             case 4: {
                                 std::string to; std::cout << "Transfer to (username): "; std::getline(std::cin, to);
-                                std::cout << "Amount: "; double amt; if (!(std::cin >> amt)) { utils::clear_input(); std::cout << "Invalid amount.\n"; break; }
-                                utils::clear_input(); std::string err; if (bank.transfer(username, to, amt, err)) std::cout << "Transfer successful.\n"; else std::cout << "Failed: " << err << "\n";
+                                std::cout << "Amount: "; Money amt; if (!read_amount(amt)) { std::cout << "Invalid amount.\n"; break; }
+                                std::string err; if (bank.transfer(username, to, amt, err)) std::cout << "Transfer successful.\n"; else std::cout << "Failed: " << err << "\n";
                                 break;
                             }
                             case 5: {
-                                view_history(username);
+                                view_history(bank, username);
                                 break;
                             }
-                            case 6: session = false; break;
+                            case 6: logged_in = false; break;
                             default: std::cout << "Invalid option.\n"; break;
                         }
                     } else { // admin menu
                         switch (op) {
                             case 1: {
-                                auto bal = bank.balance_of(username);
+                                auto bal = bank.balance_of(session);
                                 if (bal) std::cout << "Balance: " << *bal << "\n"; else std::cout << "Error reading balance.\n";
                                 break;
                             }
                             case 2: {
-                                std::cout << "Amount to deposit: "; double amt; if (!(std::cin >> amt)) { utils::clear_input(); std::cout << "Invalid amount.\n"; break; }
-                                utils::clear_input(); std::string err; if (bank.deposit(username, amt, err)) std::cout << "Deposit successful.\n"; else std::cout << "Failed: " << err << "\n";
+                                std::cout << "Amount to deposit: "; Money amt; if (!read_amount(amt)) { std::cout << "Invalid amount.\n"; break; }
+                                std::string err; if (bank.deposit(username, amt, err)) std::cout << "Deposit successful.\n"; else std::cout << "Failed: " << err << "\n";
                                 break;
                             }
                             case 3: {
-                                std::cout << "Amount to withdraw: "; double amt; if (!(std::cin >> amt)) { utils::clear_input(); std::cout << "Invalid amount.\n"; break; }
-                                utils::clear_input(); std::string err; if (bank.withdraw(username, amt, err)) std::cout << "Withdrawal successful.\n"; else std::cout << "Failed: " << err << "\n";
+                                std::cout << "Amount to withdraw: "; Money amt; if (!read_amount(amt)) { std::cout << "Invalid amount.\n"; break; }
+                                std::string err; if (bank.withdraw(username, amt, err)) std::cout << "Withdrawal successful.\n"; else std::cout << "Failed: " << err << "\n";
                                 break;
                             }
                             case 4: {
                                 std::string to; std::cout << "Transfer to (username): "; std::getline(std::cin, to);
-                                std::cout << "Amount: "; double amt; if (!(std::cin >> amt)) { utils::clear_input(); std::cout << "Invalid amount.\n"; break; }
-                                utils::clear_input(); std::string err; if (bank.transfer(username, to, amt, err)) std::cout << "Transfer successful.\n"; else std::cout << "Failed: " << err << "\n";
+                                std::cout << "Amount: "; Money amt; if (!read_amount(amt)) { std::cout << "Invalid amount.\n"; break; }
+                                std::string err; if (bank.transfer(username, to, amt, err)) std::cout << "Transfer successful.\n"; else std::cout << "Failed: " << err << "\n";
                                 break;
                             }
                             case 5: {
-                                view_history(username);
+                                view_history(bank, username);
                                 break;
                             }
                             case 6: {
-                                std::cout << "\n-- All Accounts --\n";
-                                for (const auto& p : bank.all_accounts()) {
-                                    std::cout << p.first << " | Balance: " << p.second << "\n";
-                                }
+                                view_accounts(bank);
+                                break;
+                            }
+                            case 7: {
+                                std::cout << "\n-- Metrics --\n";
+                                bank.metrics().write_summary(std::cout);
+                                break;
+                            }
+                            case 8: {
+                                std::cout << "\n-- Balance Report --\n";
+                                reports::write_report(std::cout, reports::run(bank, bank.snapshot(), reports::Options{}));
                                 break;
                             }
-                            case 7: session = false; break;
+                            case 9: logged_in = false; break;
                             default: std::cout << "Invalid option.\n"; break;
                         }
                     }
@@ -0,0 +1,236 @@
+#include "metrics.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+namespace metrics {
+
+const char* name(Op op) {
+    switch (op) {
+        case Op::CreateAccount: return "create_account";
+        case Op::Authenticate: return "authenticate";
+        case Op::Deposit: return "deposit";
+        case Op::Withdraw: return "withdraw";
+        case Op::Transfer: return "transfer";
+        case Op::ApplyBatch: return "apply_batch";
+        case Op::AllAccounts: return "all_accounts";
+        case Op::AccountQuery: return "account_query";
+        case Op::History: return "history";
+        case Op::Import: return "import";
+        case Op::Load: return "load";
+        case Op::Save: return "save";
+        case Op::Checkpoint: return "checkpoint";
+        case Op::Compact: return "compact";
+        case Op::Count: break;
+    }
+    return "unknown";
+}
+
+const char* name(Stage stage) {
+    switch (stage) {
+        case Stage::Hash: return "hash";
+        case Stage::LockWait: return "lock_wait";
+        case Stage::Lookup: return "lookup";
+        case Stage::JournalWrite: return "journal_write";
+        case Stage::TxLogAppend: return "txlog_append";
+        case Stage::SnapshotWrite: return "snapshot_write";
+        case Stage::Count: break;
+    }
+    return "unknown";
+}
+
+const char* name(Reason reason) {
+    switch (reason) {
+        case Reason::Unspecified: return "unspecified";
+        case Reason::InvalidCredentials: return "invalid_credentials";
+        case Reason::UsernameTaken: return "username_taken";
+        case Reason::UsernameInvalid: return "username_invalid";
+        case Reason::PasswordTooShort: return "password_too_short";
+        case Reason::NegativeInitialBalance: return "negative_initial_balance";
+        case Reason::AmountNotPositive: return "amount_not_positive";
+        case Reason::AmountTooLarge: return "amount_too_large";
+        case Reason::AccountNotFound: return "account_not_found";
+        case Reason::SourceNotFound: return "source_not_found";
+        case Reason::DestinationNotFound: return "destination_not_found";
+        case Reason::SameAccount: return "same_account";
+        case Reason::InsufficientFunds: return "insufficient_funds";
+        case Reason::Other: return "other";
+        case Reason::Count: break;
+    }
+    return "unknown";
+}
+
+// A prefix entry covers messages that embed a value ("Username may not contain '$'.").
+static const struct {
+    std::string_view text;
+    bool prefix;
+    Reason reason;
+} kReasons[] = {
+    {"Insufficient funds.", false, Reason::InsufficientFunds},
+    {"Account not found.", false, Reason::AccountNotFound},
+    {"Source account not found.", false, Reason::SourceNotFound},
+    {"Destination account not found.", false, Reason::DestinationNotFound},
+    {"Amount must be positive.", false, Reason::AmountNotPositive},
+    {"Amount too large.", false, Reason::AmountTooLarge},
+    {"Cannot transfer to the same account.", false, Reason::SameAccount},
+    {"Invalid username or password.", false, Reason::InvalidCredentials},
+    {"Username already exists.", false, Reason::UsernameTaken},
+    {"Duplicate username.", false, Reason::UsernameTaken},
+    {"Username must be ", true, Reason::UsernameInvalid},
+    {"Username may not contain ", true, Reason::UsernameInvalid},
+    {"Password must be at least ", true, Reason::PasswordTooShort},
+    {"Initial balance cannot be negative.", false, Reason::NegativeInitialBalance},
+};
+
+Reason classify(std::string_view message) {
+    if (message.empty()) return Reason::Unspecified;
+    for (const auto& r : kReasons) {
+        if (r.prefix ? message.substr(0, r.text.size()) == r.text : message == r.text) return r.reason;
+    }
+    return Reason::Other;
+}
+
+std::uint64_t Histogram::percentile_ns(double p) const {
+    std::uint64_t total = count();
+    if (total == 0) return 0;
+    auto rank = static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(total) + 0.5);
+    if (rank < 1) rank = 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+        seen += bucket(i);
+        if (seen >= rank) return bucket_upper(i);
+    }
+    return bucket_upper(kBuckets - 1);
+}
+
+void Registry::failure(Op o, std::string_view reason) {
+    failed_[static_cast<std::size_t>(o)].fetch_add(1, std::memory_order_relaxed);
+    reasons_[static_cast<std::size_t>(o)][static_cast<std::size_t>(classify(reason))].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+// Prometheus bucket bounds (seconds); internal buckets are folded into these on export.
+static const double kExportBounds[] = {
+    1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3,
+    1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10,
+};
+
+static void write_histogram(std::ostream& os, const char* metric, const char* label, const char* value,
+                            const Histogram& h) {
+    std::size_t i = 0;
+    std::uint64_t cumulative = 0;
+    for (double bound : kExportBounds) {
+        auto bound_ns = static_cast<std::uint64_t>(bound * 1e9);
+        while (i < Histogram::kBuckets && Histogram::bucket_upper(i) <= bound_ns) cumulative += h.bucket(i++);
+        os << metric << "_bucket{" << label << "=\"" << value << "\",le=\"" << bound << "\"} " << cumulative << "\n";
+    }
+    os << metric << "_bucket{" << label << "=\"" << value << "\",le=\"+Inf\"} " << h.count() << "\n";
+    os << metric << "_sum{" << label << "=\"" << value << "\"} " << static_cast<double>(h.sum_ns()) / 1e9 << "\n";
+    os << metric << "_count{" << label << "=\"" << value << "\"} " << h.count() << "\n";
+}
+
+void Registry::write_prometheus(std::ostream& os) const {
+    os << "# HELP bank_op_duration_seconds Latency of Bank operations.\n"
+          "# TYPE bank_op_duration_seconds histogram\n";
+    for (std::size_t i = 0; i < ops_.size(); ++i) {
+        write_histogram(os, "bank_op_duration_seconds", "op", name(static_cast<Op>(i)), ops_[i]);
+    }
+    os << "# HELP bank_op_failures_total Bank operations that returned an error.\n"
+          "# TYPE bank_op_failures_total counter\n";
+    for (std::size_t i = 0; i < ops_.size(); ++i) {
+        os << "bank_op_failures_total{op=\"" << name(static_cast<Op>(i)) << "\"} "
+           << failed_[i].load(std::memory_order_relaxed) << "\n";
+    }
+    os << "# HELP bank_stage_duration_seconds Latency of stages inside Bank operations.\n"
+          "# TYPE bank_stage_duration_seconds histogram\n";
+    for (std::size_t i = 0; i < stages_.size(); ++i) {
+        write_histogram(os, "bank_stage_duration_seconds", "stage", name(static_cast<Stage>(i)), stages_[i]);
+    }
+    os << "# HELP bank_failure_reasons_total Failed operations by reason.\n"
+          "# TYPE bank_failure_reasons_total counter\n";
+    for (std::size_t i = 0; i < reasons_.size(); ++i) {
+        for (std::size_t j = 0; j < reasons_[i].size(); ++j) {
+            std::uint64_t n = reasons_[i][j].load(std::memory_order_relaxed);
+            if (n == 0) continue;
+            os << "bank_failure_reasons_total{op=\"" << name(static_cast<Op>(i)) << "\",reason=\""
+               << name(static_cast<Reason>(j)) << "\"} " << n << "\n";
+        }
+    }
+}
+
+// failed < 0: not applicable (stages do not fail on their own).
+static void summary_row(std::ostream& os, const char* label, const Histogram& h, long long failed) {
+    auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    os << std::left << std::setw(16) << label << std::right << std::setw(10) << h.count() << std::setw(8);
+    if (failed < 0) os << "-"; else os << failed;
+    os << std::setw(11) << us(h.percentile_ns(50)) << std::setw(11) << us(h.percentile_ns(99))
+       << std::setw(11) << us(h.percentile_ns(100)) << "\n";
+}
+
+void Registry::write_summary(std::ostream& os) const {
+    auto flags = os.flags();
+    auto precision = os.precision();
+    os << std::fixed << std::setprecision(1);
+    os << std::left << std::setw(16) << "operation" << std::right << std::setw(10) << "calls" << std::setw(8) << "failed"
+       << std::setw(11) << "p50 us" << std::setw(11) << "p99 us" << std::setw(11) << "max us" << "\n";
+    for (std::size_t i = 0; i < ops_.size(); ++i) {
+        if (ops_[i].count() > 0) summary_row(os, name(static_cast<Op>(i)), ops_[i],
+                                             static_cast<long long>(failed_[i].load(std::memory_order_relaxed)));
+    }
+    os << std::left << std::setw(16) << "stage" << "\n";
+    for (std::size_t i = 0; i < stages_.size(); ++i) {
+        if (stages_[i].count() > 0) summary_row(os, name(static_cast<Stage>(i)), stages_[i], -1);
+    }
+    bool header = false;
+    for (std::size_t i = 0; i < reasons_.size(); ++i) {
+        for (std::size_t j = 0; j < reasons_[i].size(); ++j) {
+            std::uint64_t n = reasons_[i][j].load(std::memory_order_relaxed);
+            if (n == 0) continue;
+            if (!header) { os << "failures\n"; header = true; }
+            os << "  " << name(static_cast<Op>(i)) << ": " << name(static_cast<Reason>(j)) << " x" << n << "\n";
+        }
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+FileDumper::FileDumper(const Registry& reg, std::filesystem::path path, std::chrono::milliseconds interval)
+    : reg_(reg), path_(std::move(path)), interval_(interval), thread_([this] { run(); }) {
+}
+
+FileDumper::~FileDumper() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    dump();
+}
+
+bool FileDumper::dump() const {
+    std::filesystem::path tmp = path_;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        reg_.write_prometheus(out);
+        out.flush();
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path_, ec);
+    return !ec;
+}
+
+void FileDumper::run() {
+    std::unique_lock<std::mutex> lk(mu_);
+    while (!cv_.wait_for(lk, interval_, [this] { return stop_; })) {
+        lk.unlock();
+        dump();
+        lk.lock();
+    }
+}
+
+} // namespace metrics
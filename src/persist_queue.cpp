@@ -0,0 +1,199 @@
+#include "persist_queue.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <cstring>
+
+PersistQueue::PersistQueue(Journal& journal, std::function<bool()> snapshot, std::size_t capacity)
+    : journal_(journal), snapshot_(std::move(snapshot)) {
+    std::size_t n = 2;
+    while (n < capacity) n *= 2;
+    cells_.reset(new Cell[n]);
+    mask_ = n - 1;
+    for (std::size_t i = 0; i < n; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    worker_ = std::thread([this] { run(); });
+}
+
+PersistQueue::~PersistQueue() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    work_cv_.notify_one();
+    worker_.join();
+}
+
+bool PersistQueue::ready(std::uint64_t pos) const {
+    return cells_[pos & mask_].seq.load(std::memory_order_acquire) == pos + 1;
+}
+
+template <typename Fill>
+PersistQueue::Ticket PersistQueue::push(Fill fill) {
+    std::uint64_t pos = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &cells_[pos & mask_];
+        auto dif = static_cast<std::int64_t>(cell->seq.load(std::memory_order_acquire) - pos);
+        if (dif == 0) {
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_acq_rel)) break;
+        } else if (dif < 0) {
+            // Full: this cell still holds the item from the previous lap. Sleep until it is freed.
+            full_waiters_.fetch_add(1);
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                space_cv_.wait(lk, [&] {
+                    return static_cast<std::int64_t>(cell->seq.load(std::memory_order_acquire) - pos) >= 0;
+                });
+            }
+            full_waiters_.fetch_sub(1);
+            pos = tail_.load(std::memory_order_relaxed);
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+    fill(cell->item);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    // Pairs with the fence in run(): either the I/O thread sees the item or we see it idle.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lk(mu_);
+        work_cv_.notify_one();
+    }
+    return pos + 1;
+}
+
+PersistQueue::Ticket PersistQueue::append(std::string_view username, std::string_view password_hash, Money balance) {
+    return push([&](Item& item) {
+        item.kind = Kind::Record;
+        item.username.assign(username.data(), username.size());
+        std::memcpy(item.hash, password_hash.data(), std::min(password_hash.size(), sizeof(item.hash)));
+        item.balance = balance;
+    });
+}
+
+PersistQueue::Ticket PersistQueue::append_group(std::vector<Journal::Record> records) {
+    return push([&](Item& item) {
+        item.kind = Kind::Group;
+        item.group = std::move(records);
+    });
+}
+
+PersistQueue::Ticket PersistQueue::rotate_journal() {
+    return push([](Item& item) { item.kind = Kind::Rotate; });
+}
+
+PersistQueue::Ticket PersistQueue::request_snapshot() {
+    // A request the I/O thread has not picked up yet will read state after our caller's
+    // mutation, so it covers that mutation too.
+    Ticket t = snapshot_ticket_.load(std::memory_order_acquire);
+    if (t > head_.load(std::memory_order_acquire)) return t;
+    std::lock_guard<std::mutex> lk(snapshot_mu_);
+    t = snapshot_ticket_.load(std::memory_order_acquire);
+    if (t > head_.load(std::memory_order_acquire)) return t;
+    t = push([](Item& item) { item.kind = Kind::Snapshot; });
+    snapshot_ticket_.store(t, std::memory_order_release);
+    return t;
+}
+
+bool PersistQueue::wait(Ticket t) {
+    if (durable_.load(std::memory_order_acquire) >= t) return true;
+    std::unique_lock<std::mutex> lk(mu_);
+    done_cv_.wait(lk, [&] { return durable_.load(std::memory_order_acquire) >= t || failed(); });
+    return durable_.load(std::memory_order_acquire) >= t;
+}
+
+void PersistQueue::on_durable(Ticket t, std::function<void()> done) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (durable_.load(std::memory_order_acquire) < t) {
+            if (!failed()) callbacks_.emplace(t, std::move(done));
+            return;
+        }
+    }
+    done();
+}
+
+std::future<void> PersistQueue::durable_future(Ticket t) {
+    auto promise = std::make_shared<std::promise<void>>();
+    std::future<void> f = promise->get_future();
+    on_durable(t, [promise] { promise->set_value(); });
+    return f;
+}
+
+void PersistQueue::complete(Ticket t) {
+    durable_.store(t, std::memory_order_release);
+    std::vector<std::function<void()>> due;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto end = callbacks_.upper_bound(t);
+        for (auto it = callbacks_.begin(); it != end; ++it) due.push_back(std::move(it->second));
+        callbacks_.erase(callbacks_.begin(), end);
+    }
+    done_cv_.notify_all();
+    for (auto& done : due) done();
+}
+
+void PersistQueue::fail() {
+    std::multimap<Ticket, std::function<void()>> dropped; // destroyed outside the lock
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        failed_.store(true, std::memory_order_release);
+        dropped.swap(callbacks_);
+    }
+    done_cv_.notify_all();
+}
+
+void PersistQueue::run() {
+    const std::uint64_t lap = mask_ + 1;
+    for (;;) {
+        std::uint64_t pos = head_.load(std::memory_order_relaxed);
+        if (!ready(pos)) {
+            idle_.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::unique_lock<std::mutex> lk(mu_);
+            work_cv_.wait(lk, [&] { return ready(pos) || stop_; });
+            idle_.store(false, std::memory_order_relaxed);
+            if (!ready(pos)) return; // stopped with nothing left
+        }
+
+        // One batch: everything that is ready now, at most one lap of the ring.
+        bool wrote = false, snapshot = false, rotated = false;
+        std::uint64_t end = pos + lap;
+        for (; pos != end && ready(pos); ++pos) {
+            Cell& cell = cells_[pos & mask_];
+            Item& item = cell.item;
+            switch (item.kind) {
+                case Kind::Record:
+                    journal_.append(item.username, std::string_view(item.hash, sizeof(item.hash)), item.balance);
+                    wrote = true;
+                    break;
+                case Kind::Group:
+                    journal_.append_group(item.group);
+                    std::vector<Journal::Record>().swap(item.group); // batches can be large
+                    wrote = true;
+                    break;
+                case Kind::Rotate:
+                    journal_.rotate(); // flushes what came before it into the rotated file
+                    rotated = true;
+                    break;
+                case Kind::Snapshot:
+                    snapshot = true;
+                    break;
+            }
+            head_.store(pos + 1, std::memory_order_release);
+            cell.seq.store(pos + lap, std::memory_order_release);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (full_waiters_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lk(mu_);
+            space_cv_.notify_all();
+        }
+
+        // Later batches are still written, but nothing is confirmed after a failure.
+        bool ok = !(wrote || rotated) || journal_.flush();
+        if (snapshot && !snapshot_()) ok = false;
+        if (failed()) continue;
+        if (ok) complete(pos);
+        else fail();
+    }
+}
@@ -0,0 +1,152 @@
+#include "reports.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+
+namespace reports {
+
+namespace {
+
+// Per-part totals, merged once every part is done. Sums are plain cents: int64 holds more
+// than any ledger this program can load.
+struct Tally {
+    std::size_t accounts = 0, funded = 0, overdrawn = 0;
+    std::int64_t liabilities = 0, overdrafts = 0, largest = 0;
+    std::vector<std::size_t> counts;
+    std::vector<std::int64_t> totals;
+};
+
+struct Flows {
+    std::size_t records = 0;
+    std::int64_t deposits = 0, withdrawals = 0, transfers = 0, adjustments = 0;
+};
+
+} // namespace
+
+std::vector<Money> decade_edges() {
+    std::vector<Money> edges{Money(), Money::from_cents(1)};
+    for (std::int64_t c = 100; c <= 100000000; c *= 10) edges.push_back(Money::from_cents(c));
+    return edges;
+}
+
+Report run(Bank& bank, const BalanceSnapshot& snap, const Options& opts) {
+    auto t0 = std::chrono::steady_clock::now();
+    Report report;
+    report.epoch = snap.epoch();
+    report.taken_at = snap.taken_at();
+    report.edges = opts.edges;
+    std::sort(report.edges.begin(), report.edges.end());
+    const std::size_t buckets = report.edges.size() + 1;
+
+    std::vector<Tally> parts(snap.parts());
+    parallel::for_each(parts.size(), opts.threads, [&](std::size_t p) {
+        Tally& t = parts[p];
+        t.counts.assign(buckets, 0);
+        t.totals.assign(buckets, 0);
+        snap.for_each_in(p, [&](std::string_view, Money balance) {
+            std::int64_t c = balance.cents();
+            ++t.accounts;
+            if (c > 0) { ++t.funded; t.liabilities += c; }
+            if (c < 0) { ++t.overdrawn; t.overdrafts += c; }
+            t.largest = std::max(t.largest, c);
+            std::size_t b = static_cast<std::size_t>(
+                std::upper_bound(report.edges.begin(), report.edges.end(), balance) - report.edges.begin());
+            ++t.counts[b];
+            t.totals[b] += c;
+        });
+    });
+
+    Tally sum;
+    sum.counts.assign(buckets, 0);
+    sum.totals.assign(buckets, 0);
+    for (const Tally& t : parts) {
+        sum.accounts += t.accounts;
+        sum.funded += t.funded;
+        sum.overdrawn += t.overdrawn;
+        sum.liabilities += t.liabilities;
+        sum.overdrafts += t.overdrafts;
+        sum.largest = std::max(sum.largest, t.largest);
+        for (std::size_t b = 0; b < buckets; ++b) {
+            sum.counts[b] += t.counts[b];
+            sum.totals[b] += t.totals[b];
+        }
+    }
+    report.accounts = sum.accounts;
+    report.funded = sum.funded;
+    report.overdrawn = sum.overdrawn;
+    report.liabilities = Money::from_cents(sum.liabilities);
+    report.overdrafts = Money::from_cents(sum.overdrafts);
+    report.largest = Money::from_cents(sum.largest);
+    report.counts = sum.counts;
+    for (std::int64_t c : sum.totals) report.totals.push_back(Money::from_cents(c));
+
+    if (opts.flows) {
+        std::mutex mu;
+        Flows total;
+        bank.for_each_history(opts.threads, [&](const std::string&, const history::AccountStream& stream) {
+            Flows f;
+            stream([&](const Transaction& tx, std::string_view) {
+                if (tx.timestamp >= snap.taken_at()) return; // after the snapshot
+                ++f.records;
+                switch (tx.type) {
+                    case TxType::Deposit:
+                    case TxType::InitialDeposit: f.deposits += tx.amount.cents(); break;
+                    case TxType::Withdraw: f.withdrawals += tx.amount.cents(); break;
+                    case TxType::TransferOut: f.transfers += tx.amount.cents(); break;
+                    case TxType::TransferIn: break; // counted on the sending side
+                    case TxType::Adjustment: f.adjustments += tx.amount.cents(); break;
+                }
+            });
+            std::lock_guard<std::mutex> lk(mu);
+            total.records += f.records;
+            total.deposits += f.deposits;
+            total.withdrawals += f.withdrawals;
+            total.transfers += f.transfers;
+            total.adjustments += f.adjustments;
+        });
+        report.has_flows = true;
+        report.records = total.records;
+        report.deposits = Money::from_cents(total.deposits);
+        report.withdrawals = Money::from_cents(total.withdrawals);
+        report.transfers = Money::from_cents(total.transfers);
+        report.adjustments = Money::from_cents(total.adjustments);
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return report;
+}
+
+void write_report(std::ostream& os, const Report& report) {
+    os << "Balance report (snapshot " << report.epoch << ", " << timestamp::iso(report.taken_at) << "): "
+       << report.accounts << " accounts in " << report.seconds << " s\n"
+       << "  total liabilities: " << report.liabilities << " across " << report.funded << " funded account(s)\n";
+    if (report.overdrawn > 0) os << "  overdrafts: " << report.overdrafts << " across " << report.overdrawn << " account(s)\n";
+    os << "  largest balance: " << report.largest << "\n";
+    if (report.has_flows) {
+        Money net, in;
+        Money::sub(report.deposits, report.withdrawals, in);
+        Money::add(in, report.adjustments, net);
+        os << "  total deposits: " << report.deposits << ", withdrawals: " << report.withdrawals
+           << ", transfers: " << report.transfers << " (" << report.records << " records)\n";
+        if (report.adjustments != Money()) os << "  adjustments: " << report.adjustments << "\n";
+        Money balances;
+        Money::add(report.liabilities, report.overdrafts, balances);
+        os << "  deposits - withdrawals" << (report.adjustments != Money() ? " + adjustments" : "") << ": " << net
+           << (net == balances ? " (matches the balances)\n" : " (balances differ; see --verify)\n");
+    }
+    os << "  distribution:\n";
+    for (std::size_t b = 0; b < report.counts.size(); ++b) {
+        if (b == 0) {
+            os << "    < " << report.edges.front();
+        } else if (b == report.edges.size()) {
+            os << "    >= " << report.edges.back();
+        } else {
+            os << "    " << report.edges[b - 1] << " - " << report.edges[b];
+        }
+        os << ": " << report.counts[b] << " (" << report.totals[b] << ")\n";
+    }
+}
+
+} // namespace reports
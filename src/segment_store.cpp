@@ -0,0 +1,806 @@
+#include "segment_store.hpp"
+#include "snapshot.hpp"
+#include "parallel.hpp"
+#include "utils.hpp"
+#include "lz.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+// Version 2 keys timestamps on epoch microseconds. A version 1 .sidx (local YYYYMMDDhhmmss keys)
+// fails to read and is rebuilt from its segment; a version 1 archive has its summary keys
+// converted when it is opened.
+constexpr char kSidxMagic[8] = {'B', 'K', 'S', 'I', 'D', 'X', '2', '\0'};
+constexpr char kArcMagic[8] = {'B', 'K', 'A', 'R', 'C', '2', '\0', '\0'};
+constexpr char kArcMagicV1[8] = {'B', 'K', 'A', 'R', 'C', '1', '\0', '\0'};
+constexpr char kArcEnd[8] = {'B', 'K', 'A', 'R', 'C', 'E', 'N', 'D'};
+
+using Index = std::unordered_map<std::string, std::vector<history::IndexEntry>>;
+
+// Archive layout: magic, u64 first_seq, u64 last_seq, compressed blocks, then the footer:
+// u64 block count, BlockRef[count], u64 account count, (AccountRec + name)[count], and finally
+// u64 footer offset + end magic.
+struct ArcHeader {
+    char magic[8];
+    std::uint64_t first_seq;
+    std::uint64_t last_seq;
+};
+
+struct BlockRef {
+    std::uint64_t offset;    // in the file
+    std::uint64_t raw_start; // in the uncompressed stream
+    std::uint32_t comp_size;
+    std::uint32_t raw_size;
+};
+
+struct AccountRec {
+    std::uint64_t raw_offset; // the account's run in the uncompressed stream
+    std::uint64_t raw_bytes;
+    std::int64_t opening_cents;
+    std::int64_t closing_cents;
+    std::int64_t first_ts; // epoch microseconds
+    std::int64_t last_ts;
+    std::uint32_t count;
+    std::uint32_t name_len;
+};
+
+// Balance before tx, from the chain rule the verifier checks.
+Money balance_before(const Transaction& tx) {
+    Money before;
+    switch (tx.type) {
+        case TxType::Withdraw:
+        case TxType::TransferOut:
+            Money::add(tx.balance_after, tx.amount, before);
+            break;
+        default:
+            Money::sub(tx.balance_after, tx.amount, before);
+    }
+    return before;
+}
+
+// A version 1 archive's YYYYMMDDhhmmss summary key as epoch microseconds: the start of that
+// second, or its end for a run's last record. One that does not convert widens the run's
+// range, so lookups decode the run instead of trusting the summary.
+std::int64_t legacy_key_micros(std::int64_t key, bool end) {
+    char iso[32];
+    std::snprintf(iso, sizeof(iso), "%04lld-%02lld-%02lldT%02lld:%02lld:%02lld",
+                  static_cast<long long>(key / 10000000000), static_cast<long long>(key / 100000000 % 100),
+                  static_cast<long long>(key / 1000000 % 100), static_cast<long long>(key / 10000 % 100),
+                  static_cast<long long>(key / 100 % 100), static_cast<long long>(key % 100));
+    timestamp::Micros t;
+    if (key <= 0 || !timestamp::parse(iso, t)) return end ? INT64_MAX : INT64_MIN;
+    return end ? t + 999999 : t;
+}
+
+bool parse_seq(const std::string& name, const char* prefix, std::uint64_t& seq) {
+    std::size_t n = std::strlen(prefix);
+    if (name.compare(0, n, prefix) != 0 || name.size() == n) return false;
+    seq = 0;
+    for (std::size_t i = n; i < name.size(); ++i) {
+        if (name[i] < '0' || name[i] > '9') return false;
+        seq = seq * 10 + static_cast<std::uint64_t>(name[i] - '0');
+    }
+    return true;
+}
+
+template <typename T>
+void put(std::string& out, const T& v) { out.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+template <typename T>
+bool get(const char*& p, const char* end, T& v) {
+    if (static_cast<std::size_t>(end - p) < sizeof(v)) return false;
+    std::memcpy(&v, p, sizeof(v));
+    p += sizeof(v);
+    return true;
+}
+
+void write_file(const std::filesystem::path& path, std::string_view data) {
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    std::FILE* f = std::fopen(tmp.string().c_str(), "wb");
+    if (!f) throw std::runtime_error("Cannot create " + tmp.string());
+    bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size() && utils::fsync_file(f);
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) throw std::runtime_error("Failed to write " + tmp.string());
+    std::filesystem::rename(tmp, path);
+}
+
+// Streams account runs into a new archive file. Records must arrive grouped by account, with
+// accounts in ascending username order.
+class ArchiveWriter {
+public:
+    ArchiveWriter(std::filesystem::path path, std::uint64_t first_seq, std::uint64_t last_seq, std::size_t block_bytes)
+        : path_(std::move(path)), block_bytes_(std::max<std::size_t>(block_bytes, 4096)) {
+        tmp_ = path_;
+        tmp_ += ".tmp";
+        out_ = std::fopen(tmp_.string().c_str(), "wb");
+        if (!out_) throw std::runtime_error("Cannot create " + tmp_.string());
+        ArcHeader h{};
+        std::memcpy(h.magic, kArcMagic, sizeof(kArcMagic));
+        h.first_seq = first_seq;
+        h.last_seq = last_seq;
+        write(&h, sizeof(h));
+    }
+    ~ArchiveWriter() {
+        if (!out_) return;
+        std::fclose(out_);
+        std::error_code ec;
+        std::filesystem::remove(tmp_, ec);
+    }
+
+    // line: timestamp|type|amount|balance_after|details, newline included; tx is the parsed line,
+    // or null when it does not parse (it is archived as is, for the verifier to report).
+    void add(const std::string& username, std::string_view line, const Transaction* tx) {
+        if (accounts_.empty() || accounts_.back().first != username) {
+            AccountRec rec{};
+            rec.raw_offset = raw_start_ + raw_.size();
+            accounts_.emplace_back(username, rec);
+            parsed_ = false;
+        }
+        AccountRec& rec = accounts_.back().second;
+        if (tx) {
+            if (!parsed_) {
+                rec.opening_cents = balance_before(*tx).cents();
+                rec.first_ts = tx->timestamp;
+                parsed_ = true;
+            }
+            rec.closing_cents = tx->balance_after.cents();
+            rec.last_ts = tx->timestamp;
+        }
+        rec.raw_bytes += line.size();
+        ++rec.count;
+        raw_.append(line.data(), line.size());
+        if (raw_.size() >= block_bytes_) cut_block();
+    }
+
+    // Writes the footer and moves the archive into place.
+    void finish() {
+        cut_block();
+        std::string footer;
+        put(footer, static_cast<std::uint64_t>(blocks_.size()));
+        for (const BlockRef& b : blocks_) put(footer, b);
+        put(footer, static_cast<std::uint64_t>(accounts_.size()));
+        for (auto& [name, rec] : accounts_) {
+            rec.name_len = static_cast<std::uint32_t>(name.size());
+            put(footer, rec);
+            footer += name;
+        }
+        put(footer, offset_);
+        footer.append(kArcEnd, sizeof(kArcEnd));
+        write(footer.data(), footer.size());
+        bool ok = utils::fsync_file(out_);
+        ok = std::fclose(out_) == 0 && ok;
+        out_ = nullptr;
+        if (!ok) throw std::runtime_error("Failed to write " + tmp_.string());
+        std::filesystem::rename(tmp_, path_);
+    }
+
+private:
+    void cut_block() {
+        if (raw_.empty()) return;
+        comp_.clear();
+        lz::compress(raw_, comp_);
+        blocks_.push_back(BlockRef{offset_, raw_start_, static_cast<std::uint32_t>(comp_.size()),
+                                   static_cast<std::uint32_t>(raw_.size())});
+        write(comp_.data(), comp_.size());
+        raw_start_ += raw_.size();
+        raw_.clear();
+    }
+    void write(const void* data, std::size_t n) {
+        if (std::fwrite(data, 1, n, out_) != n) throw std::runtime_error("Failed to write " + tmp_.string());
+        offset_ += n;
+    }
+
+    std::filesystem::path path_, tmp_;
+    std::size_t block_bytes_;
+    std::FILE* out_ = nullptr;
+    std::uint64_t offset_ = 0;
+    std::uint64_t raw_start_ = 0;
+    std::string raw_, comp_;
+    std::vector<BlockRef> blocks_;
+    std::vector<std::pair<std::string, AccountRec>> accounts_;
+    bool parsed_ = false; // the current account has a well-formed line
+};
+
+} // namespace
+
+struct SegmentStore::Segment {
+    std::uint64_t seq = 0;
+    std::filesystem::path path;
+    std::uint64_t size = 0;
+    std::time_t first_time = 0;  // of its first record; drives age-based rollover
+    Index index;                 // username -> its lines, in order
+    snapshot::MappedFile map;    // sealed segments only
+
+    // Indexes the complete lines of the file; a torn last line is cut off when truncate is set.
+    void scan(bool truncate) {
+        std::ifstream in(path, std::ios::binary);
+        std::string line;
+        std::uint64_t off = 0;
+        while (std::getline(in, line)) {
+            if (in.eof()) break;
+            std::size_t bar = line.find('|');
+            if (bar != std::string::npos) {
+                std::string_view rest = std::string_view(line).substr(bar + 1);
+                std::string_view ts = rest.substr(0, rest.find('|'));
+                std::int64_t key = history::timestamp_key(ts);
+                if (index.empty() && key != 0) first_time = static_cast<std::time_t>(key / 1000000);
+                index[line.substr(0, bar)].push_back(history::IndexEntry{off, key});
+            }
+            off += line.size() + 1;
+        }
+        size = off;
+        std::error_code ec;
+        if (truncate && std::filesystem::file_size(path, ec) != off && !ec) std::filesystem::resize_file(path, off, ec);
+    }
+
+    // The line at off, from the username on, without its newline.
+    std::string_view line_at(std::uint64_t off, std::ifstream& in, std::string& buf) const {
+        if (map.data()) {
+            std::string_view all(map.data(), map.size());
+            std::size_t nl = all.find('\n', off);
+            return all.substr(off, nl == std::string_view::npos ? std::string_view::npos : nl - off);
+        }
+        if (!in.is_open()) in.open(path, std::ios::binary);
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(off));
+        std::getline(in, buf);
+        return buf;
+    }
+
+    void write_sidx(const std::filesystem::path& sidx) const {
+        std::string out(kSidxMagic, sizeof(kSidxMagic));
+        put(out, static_cast<std::uint64_t>(index.size()));
+        for (const auto& [name, entries] : index) {
+            put(out, static_cast<std::uint32_t>(name.size()));
+            out += name;
+            put(out, static_cast<std::uint64_t>(entries.size()));
+            out.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(history::IndexEntry));
+        }
+        write_file(sidx, out);
+    }
+
+    bool read_sidx(const std::filesystem::path& sidx) {
+        snapshot::MappedFile f;
+        std::string err;
+        if (!f.open(sidx, err) || f.size() < sizeof(kSidxMagic) ||
+            std::memcmp(f.data(), kSidxMagic, sizeof(kSidxMagic)) != 0) return false;
+        const char* p = f.data() + sizeof(kSidxMagic);
+        const char* end = f.data() + f.size();
+        std::uint64_t users = 0;
+        if (!get(p, end, users)) return false;
+        for (std::uint64_t u = 0; u < users; ++u) {
+            std::uint32_t len = 0;
+            std::uint64_t n = 0;
+            if (!get(p, end, len) || static_cast<std::size_t>(end - p) < len) return false;
+            std::string name(p, len);
+            p += len;
+            if (!get(p, end, n) || static_cast<std::uint64_t>(end - p) / sizeof(history::IndexEntry) < n) return false;
+            auto& entries = index[name];
+            entries.resize(static_cast<std::size_t>(n));
+            std::memcpy(entries.data(), p, entries.size() * sizeof(history::IndexEntry));
+            p += entries.size() * sizeof(history::IndexEntry);
+        }
+        return p == end;
+    }
+};
+
+struct SegmentStore::Archive {
+    std::uint64_t first_seq = 0, last_seq = 0;
+    std::filesystem::path path;
+    snapshot::MappedFile map;
+    std::vector<BlockRef> blocks;
+    std::unordered_map<std::string, AccountRec> accounts;
+    std::uint64_t raw_bytes = 0;
+
+    bool open(std::string& err) {
+        if (!map.open(path, err)) return false;
+        const char* base = map.data();
+        std::size_t size = map.size();
+        ArcHeader h{};
+        std::uint64_t footer = 0;
+        err = "Corrupt archive " + path.string();
+        if (size < sizeof(h) + sizeof(footer) + sizeof(kArcEnd)) return false;
+        std::memcpy(&h, base, sizeof(h));
+        std::memcpy(&footer, base + size - sizeof(kArcEnd) - sizeof(footer), sizeof(footer));
+        bool v1 = std::memcmp(h.magic, kArcMagicV1, sizeof(kArcMagicV1)) == 0;
+        if ((!v1 && std::memcmp(h.magic, kArcMagic, sizeof(kArcMagic)) != 0) ||
+            std::memcmp(base + size - sizeof(kArcEnd), kArcEnd, sizeof(kArcEnd)) != 0 ||
+            footer < sizeof(h) || footer > size - sizeof(kArcEnd) - sizeof(footer)) return false;
+        first_seq = h.first_seq;
+        last_seq = h.last_seq;
+
+        const char* p = base + footer;
+        const char* end = base + size - sizeof(kArcEnd) - sizeof(footer);
+        std::uint64_t n = 0;
+        if (!get(p, end, n)) return false;
+        blocks.resize(static_cast<std::size_t>(std::min<std::uint64_t>(n, static_cast<std::uint64_t>(end - p) / sizeof(BlockRef))));
+        if (blocks.size() != n) return false;
+        for (BlockRef& b : blocks) {
+            get(p, end, b);
+            if (b.offset > footer || b.comp_size > footer - b.offset || b.raw_start != raw_bytes) return false;
+            raw_bytes += b.raw_size;
+        }
+        if (!get(p, end, n)) return false;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            AccountRec rec{};
+            if (!get(p, end, rec) || static_cast<std::size_t>(end - p) < rec.name_len ||
+                rec.raw_offset + rec.raw_bytes > raw_bytes) return false;
+            if (v1) {
+                rec.first_ts = legacy_key_micros(rec.first_ts, false);
+                rec.last_ts = legacy_key_micros(rec.last_ts, true);
+            }
+            accounts.emplace(std::string(p, rec.name_len), rec);
+            p += rec.name_len;
+        }
+        err.clear();
+        return p == end;
+    }
+};
+
+// The last block an account stream decompressed, so neighbouring accounts sharing a block
+// (runs are in username order) decode it once.
+struct SegmentStore::BlockCache {
+    const Archive* arc = nullptr;
+    std::size_t block = 0;
+    std::string raw;
+};
+
+SegmentStore::SegmentStore(std::filesystem::path dir, SegmentOptions opts)
+    : seg_dir_(dir / "segments"), arc_dir_(dir / "archive"), opts_(opts) {
+    if (opts_.archive_batch == 0) opts_.archive_batch = 1;
+    std::filesystem::create_directories(seg_dir_);
+    std::filesystem::create_directories(arc_dir_);
+    recover();
+}
+
+SegmentStore::~SegmentStore() {
+    if (active_file_) std::fclose(active_file_);
+}
+
+std::filesystem::path SegmentStore::segment_path(std::uint64_t seq, const char* ext) const {
+    return seg_dir_ / ("seg-" + std::to_string(seq) + ext);
+}
+
+void SegmentStore::recover() {
+    std::vector<std::uint64_t> seqs;
+    std::error_code ec;
+    for (const auto* dir : {&seg_dir_, &arc_dir_}) {
+        for (std::filesystem::directory_iterator it(*dir, ec), end; !ec && it != end; it.increment(ec)) {
+            const std::filesystem::path& p = it->path();
+            std::error_code rm_ec;
+            std::uint64_t seq;
+            if (p.extension() == ".tmp") {
+                std::filesystem::remove(p, rm_ec); // an unfinished seal or compaction
+            } else if (p.extension() == ".arc") {
+                auto arc = std::make_shared<Archive>();
+                arc->path = p;
+                std::string err;
+                if (!arc->open(err)) throw std::runtime_error(err);
+                archives_.push_back(std::move(arc));
+            } else if (p.extension() == ".log" && parse_seq(p.stem().string(), "seg-", seq)) {
+                seqs.push_back(seq);
+            }
+        }
+    }
+    std::sort(archives_.begin(), archives_.end(), [](const ArchivePtr& a, const ArchivePtr& b) {
+        return a->first_seq < b->first_seq;
+    });
+    std::uint64_t archived = archives_.empty() ? 0 : archives_.back()->last_seq;
+
+    std::sort(seqs.begin(), seqs.end());
+    std::uint64_t next = archived + 1;
+    for (std::size_t i = 0; i < seqs.size(); ++i) {
+        std::uint64_t seq = seqs[i];
+        if (seq <= archived) {
+            // Compacted, but the process stopped before the segment was deleted.
+            std::filesystem::remove(segment_path(seq, ".log"), ec);
+            std::filesystem::remove(segment_path(seq, ".sidx"), ec);
+            continue;
+        }
+        auto seg = std::make_shared<Segment>();
+        seg->seq = seq;
+        seg->path = segment_path(seq, ".log");
+        std::filesystem::path sidx = segment_path(seq, ".sidx");
+        bool last = i + 1 == seqs.size();
+        if (last && !std::filesystem::exists(sidx, ec)) {
+            seg->scan(true); // the active segment when the process stopped
+            active_ = seg;
+            break;
+        }
+        if (!seg->read_sidx(sidx)) {
+            seg->index.clear();
+            seg->scan(false);
+            seg->write_sidx(sidx);
+        }
+        std::string err;
+        if (!seg->map.open(seg->path, err)) throw std::runtime_error(err);
+        seg->size = seg->map.size();
+        sealed_.push_back(std::move(seg));
+        next = seq + 1;
+    }
+    open_active(active_ ? active_->seq : next);
+}
+
+void SegmentStore::open_active(std::uint64_t seq) {
+    if (!active_ || active_->seq != seq) {
+        active_ = std::make_shared<Segment>();
+        active_->seq = seq;
+        active_->path = segment_path(seq, ".log");
+    }
+    active_file_ = std::fopen(active_->path.string().c_str(), "ab");
+    if (!active_file_) throw std::runtime_error("Cannot open " + active_->path.string());
+    committed_ = active_->size;
+}
+
+// Drops everything written since the last commit() from the file and the index.
+void SegmentStore::rollback_locked() {
+    std::fclose(active_file_); // may still push buffered bytes out; they are cut off below
+    active_file_ = nullptr;
+    std::filesystem::resize_file(active_->path, committed_);
+    for (auto it = active_->index.begin(); it != active_->index.end();) {
+        auto& entries = it->second;
+        while (!entries.empty() && entries.back().offset >= committed_) entries.pop_back();
+        it = entries.empty() ? active_->index.erase(it) : std::next(it);
+    }
+    active_->size = committed_;
+    if (active_->index.empty()) active_->first_time = 0;
+    open_active(active_->seq);
+}
+
+bool SegmentStore::append(const std::string& username, const Transaction& tx, std::string_view counterparty, bool fsync) {
+    line_ = username;
+    line_ += '|';
+    append_transaction_line(line_, tx, counterparty);
+    if (std::fwrite(line_.data(), 1, line_.size(), active_file_) != line_.size() ||
+        (fsync && !utils::fsync_file(active_file_))) {
+        rollback_locked();
+        return false;
+    }
+    if (active_->index.empty()) active_->first_time = static_cast<std::time_t>(tx.timestamp / 1000000);
+    active_->index[username].push_back(history::IndexEntry{active_->size, tx.timestamp});
+    active_->size += line_.size();
+    return true;
+}
+
+bool SegmentStore::commit(bool fsync) {
+    bool ok = fsync ? utils::fsync_file(active_file_) : std::fflush(active_file_) == 0;
+    if (!ok) {
+        rollback_locked();
+        return false;
+    }
+    committed_ = active_->size;
+    return true;
+}
+
+void SegmentStore::seal_locked() {
+    if (!utils::fsync_file(active_file_)) throw std::runtime_error("Cannot sync " + active_->path.string());
+    std::fclose(active_file_);
+    active_file_ = nullptr;
+    active_->write_sidx(segment_path(active_->seq, ".sidx"));
+    std::string err;
+    if (!active_->map.open(active_->path, err)) throw std::runtime_error(err);
+    std::uint64_t next = active_->seq + 1;
+    sealed_.push_back(std::move(active_));
+    open_active(next);
+}
+
+bool SegmentStore::maintain(bool force, std::string& err) {
+    try {
+        {
+            std::unique_lock<std::shared_mutex> lk(mu_);
+            std::time_t now = std::time(nullptr);
+            bool full = active_->size >= opts_.max_segment_bytes;
+            bool old = active_->first_time != 0 && now - active_->first_time >= opts_.max_segment_age.count();
+            if (active_->size > 0 && (force || full || old)) seal_locked();
+        }
+
+        // Only this thread changes sealed_, so the oldest ones stay put while the archive is built.
+        std::vector<SegmentPtr> victims;
+        {
+            std::shared_lock<std::shared_mutex> lk(mu_);
+            std::size_t waiting = sealed_.size() > opts_.hot_segments ? sealed_.size() - opts_.hot_segments : 0;
+            if (waiting >= opts_.archive_batch || (force && waiting > 0)) {
+                std::size_t n = force ? waiting : opts_.archive_batch;
+                victims.assign(sealed_.begin(), sealed_.begin() + static_cast<std::ptrdiff_t>(n));
+            }
+        }
+        if (victims.empty()) return true;
+
+        // Regroup the lines by account; each account's lines stay in segment order.
+        std::map<std::string, std::vector<std::pair<const Segment*, const std::vector<history::IndexEntry>*>>> runs;
+        for (const SegmentPtr& seg : victims) {
+            for (const auto& [name, entries] : seg->index) runs[name].emplace_back(seg.get(), &entries);
+        }
+        std::uint64_t first = victims.front()->seq, last = victims.back()->seq;
+        auto arc = std::make_shared<Archive>();
+        arc->path = arc_dir_ / ("arc-" + std::to_string(first) + "-" + std::to_string(last) + ".arc");
+        {
+            ArchiveWriter out(arc->path, first, last, opts_.block_bytes);
+            std::ifstream in; // sealed segments are mapped; never opened
+            std::string buf, line;
+            Transaction tx;
+            std::string_view counterparty;
+            for (const auto& [name, parts] : runs) {
+                for (const auto& [seg, entries] : parts) {
+                    for (const history::IndexEntry& e : *entries) {
+                        std::string_view full = seg->line_at(e.offset, in, buf);
+                        line.assign(full.substr(std::min(full.size(), name.size() + 1)));
+                        bool ok = parse_transaction_line(line, tx, counterparty);
+                        line += '\n';
+                        out.add(name, line, ok ? &tx : nullptr);
+                    }
+                }
+            }
+            out.finish();
+        }
+        if (!arc->open(err)) return false;
+
+        {
+            std::unique_lock<std::shared_mutex> lk(mu_);
+            archives_.push_back(arc);
+            sealed_.erase(sealed_.begin(), sealed_.begin() + static_cast<std::ptrdiff_t>(victims.size()));
+        }
+        // Readers still holding a victim keep its mapping; the files can go.
+        std::error_code ec;
+        for (const SegmentPtr& seg : victims) {
+            std::filesystem::remove(seg->path, ec);
+            std::filesystem::remove(segment_path(seg->seq, ".sidx"), ec);
+        }
+        return true;
+    } catch (const std::exception& e) {
+        err = e.what();
+        return false;
+    }
+}
+
+std::size_t SegmentStore::import_logs(const std::filesystem::path& dir) {
+    {
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        if (!archives_.empty() && archives_.front()->first_seq == 0) return 0;
+    }
+    std::vector<std::filesystem::path> logs;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() == ".log") logs.push_back(it->path());
+    }
+    if (logs.empty()) return 0;
+    std::sort(logs.begin(), logs.end());
+
+    auto arc = std::make_shared<Archive>();
+    arc->path = arc_dir_ / "arc-0-0.arc";
+    {
+        ArchiveWriter out(arc->path, 0, 0, opts_.block_bytes);
+        std::string line;
+        for (const auto& log : logs) {
+            std::string name = log.stem().string();
+            history::stream_log(log, [&](const Transaction& tx, std::string_view counterparty) {
+                line.clear();
+                append_transaction_line(line, tx, counterparty);
+                out.add(name, line, &tx);
+            });
+        }
+        out.finish();
+    }
+    std::string err;
+    if (!arc->open(err)) throw std::runtime_error(err);
+    {
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        archives_.insert(archives_.begin(), arc);
+    }
+    for (const auto& log : logs) {
+        std::filesystem::path idx = log;
+        idx.replace_extension(".idx");
+        std::filesystem::remove(log, ec);
+        std::filesystem::remove(idx, ec);
+    }
+    return logs.size();
+}
+
+void SegmentStore::walk(const std::string& username, std::size_t first, std::size_t limit,
+                        const std::function<void(std::string_view)>& visit, BlockCache& cache) const {
+    std::string run, buf;
+    for (const ArchivePtr& arc : archives_) {
+        if (limit == 0) return;
+        auto it = arc->accounts.find(username);
+        if (it == arc->accounts.end()) continue;
+        const AccountRec& rec = it->second;
+        if (first >= rec.count) { first -= rec.count; continue; }
+        extract(*arc, rec.raw_offset, rec.raw_bytes, run, cache);
+        std::string_view rest(run);
+        for (std::size_t i = 0; !rest.empty() && limit > 0; ++i) {
+            std::size_t nl = rest.find('\n');
+            std::string_view line = rest.substr(0, nl);
+            rest.remove_prefix(nl == std::string_view::npos ? rest.size() : nl + 1);
+            if (i < first) continue;
+            visit(line);
+            --limit;
+        }
+        first = 0;
+    }
+    auto walk_segment = [&](const Segment& seg) {
+        auto it = seg.index.find(username);
+        if (it == seg.index.end() || limit == 0) return;
+        const auto& entries = it->second;
+        if (first >= entries.size()) { first -= entries.size(); return; }
+        std::ifstream in;
+        for (std::size_t i = first; i < entries.size() && limit > 0; ++i, --limit) {
+            std::string_view line = seg.line_at(entries[i].offset, in, buf);
+            visit(line.substr(std::min(line.size(), username.size() + 1)));
+        }
+        first = 0;
+    };
+    for (const SegmentPtr& seg : sealed_) walk_segment(*seg);
+    walk_segment(*active_);
+}
+
+void SegmentStore::extract(const Archive& arc, std::uint64_t off, std::uint64_t len, std::string& out,
+                           BlockCache& cache) const {
+    out.clear();
+    auto it = std::upper_bound(arc.blocks.begin(), arc.blocks.end(), off,
+                               [](std::uint64_t o, const BlockRef& b) { return o < b.raw_start; });
+    std::size_t b = static_cast<std::size_t>(it - arc.blocks.begin()) - 1;
+    for (; len > 0 && b < arc.blocks.size(); ++b) {
+        const BlockRef& ref = arc.blocks[b];
+        if (cache.arc != &arc || cache.block != b) {
+            cache.arc = nullptr;
+            if (!lz::decompress(std::string_view(arc.map.data() + ref.offset, ref.comp_size), ref.raw_size, cache.raw)) {
+                throw std::runtime_error("Corrupt block in " + arc.path.string());
+            }
+            cache.arc = &arc;
+            cache.block = b;
+        }
+        std::uint64_t from = off - ref.raw_start;
+        std::uint64_t n = std::min<std::uint64_t>(len, ref.raw_size - from);
+        out.append(cache.raw, static_cast<std::size_t>(from), static_cast<std::size_t>(n));
+        off += n;
+        len -= n;
+    }
+}
+
+std::size_t SegmentStore::count(const std::string& username) const {
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    std::size_t n = 0;
+    for (const ArchivePtr& arc : archives_) {
+        auto it = arc->accounts.find(username);
+        if (it != arc->accounts.end()) n += it->second.count;
+    }
+    for (const SegmentPtr& seg : sealed_) {
+        auto it = seg->index.find(username);
+        if (it != seg->index.end()) n += it->second.size();
+    }
+    auto it = active_->index.find(username);
+    if (it != active_->index.end()) n += it->second.size();
+    return n;
+}
+
+std::size_t SegmentStore::lower_bound(const std::string& username, std::int64_t key, bool upper) const {
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    auto before = [&](std::int64_t ts) { return ts < key || (upper && ts == key); };
+    std::size_t pos = 0;
+    BlockCache cache;
+    std::string run;
+    for (const ArchivePtr& arc : archives_) {
+        auto it = arc->accounts.find(username);
+        if (it == arc->accounts.end()) continue;
+        const AccountRec& rec = it->second;
+        if (before(rec.last_ts)) { pos += rec.count; continue; }
+        if (!before(rec.first_ts)) return pos;
+        // The boundary is inside this run: decode it and look at the timestamps.
+        extract(*arc, rec.raw_offset, rec.raw_bytes, run, cache);
+        for (std::string_view rest(run); !rest.empty();) {
+            std::size_t nl = rest.find('\n');
+            if (!before(history::timestamp_key(rest.substr(0, rest.find('|'))))) return pos;
+            ++pos;
+            rest.remove_prefix(nl == std::string_view::npos ? rest.size() : nl + 1);
+        }
+    }
+    auto in_segment = [&](const Segment& seg) {
+        auto it = seg.index.find(username);
+        if (it == seg.index.end()) return false;
+        const auto& entries = it->second;
+        auto hit = std::partition_point(entries.begin(), entries.end(),
+                                        [&](const history::IndexEntry& e) { return before(e.ts_key); });
+        pos += static_cast<std::size_t>(hit - entries.begin());
+        return hit != entries.end();
+    };
+    for (const SegmentPtr& seg : sealed_) {
+        if (in_segment(*seg)) return pos;
+    }
+    in_segment(*active_);
+    return pos;
+}
+
+std::vector<Transaction> SegmentStore::read(const std::string& username, std::size_t first, std::size_t limit,
+                                            const std::function<AccountId(std::string_view)>& resolve) const {
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    std::vector<Transaction> out;
+    BlockCache cache;
+    std::string line;
+    std::string_view counterparty;
+    walk(username, first, limit, [&](std::string_view text) {
+        line.assign(text);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        Transaction tx;
+        if (!parse_transaction_line(line, tx, counterparty)) return;
+        if (!counterparty.empty()) tx.counterparty = resolve(counterparty);
+        out.push_back(std::move(tx));
+    }, cache);
+    return out;
+}
+
+std::size_t SegmentStore::stream(const std::string& username, const history::RecordVisitor& visit,
+                                 BlockCache& cache) const {
+    std::size_t malformed = 0;
+    std::string line;
+    std::string_view counterparty;
+    Transaction tx;
+    walk(username, 0, SIZE_MAX, [&](std::string_view text) {
+        line.assign(text);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!parse_transaction_line(line, tx, counterparty)) { ++malformed; return; }
+        visit(tx, counterparty);
+    }, cache);
+    return malformed;
+}
+
+std::size_t SegmentStore::for_each_account(unsigned threads,
+                                           const std::function<void(const std::string&, const history::AccountStream&)>& fn) const {
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    std::vector<std::string> names;
+    for (const ArchivePtr& arc : archives_) {
+        for (const auto& kv : arc->accounts) names.push_back(kv.first);
+    }
+    for (const SegmentPtr& seg : sealed_) {
+        for (const auto& kv : seg->index) names.push_back(kv.first);
+    }
+    for (const auto& kv : active_->index) names.push_back(kv.first);
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    // Contiguous username ranges, so each task walks the archive blocks in order.
+    std::size_t chunks = std::min<std::size_t>(names.size(), std::size_t(parallel::threads_for(threads)) * 8);
+    parallel::for_each(chunks, threads, [&](std::size_t c) {
+        BlockCache cache;
+        std::size_t begin = names.size() * c / chunks, end = names.size() * (c + 1) / chunks;
+        for (std::size_t i = begin; i < end; ++i) {
+            fn(names[i], [&](const history::RecordVisitor& visit) { return stream(names[i], visit, cache); });
+        }
+    });
+    return names.size();
+}
+
+std::vector<SegmentStore::Summary> SegmentStore::summaries(const std::string& username) const {
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    std::vector<Summary> out;
+    for (const ArchivePtr& arc : archives_) {
+        auto it = arc->accounts.find(username);
+        if (it == arc->accounts.end()) continue;
+        const AccountRec& rec = it->second;
+        out.push_back(Summary{arc->first_seq, arc->last_seq, rec.count, Money::from_cents(rec.opening_cents),
+                              Money::from_cents(rec.closing_cents), rec.first_ts, rec.last_ts});
+    }
+    return out;
+}
+
+SegmentStore::Stats SegmentStore::stats() const {
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    Stats st;
+    st.sealed_segments = sealed_.size();
+    st.archives = archives_.size();
+    st.hot_bytes = active_->size;
+    for (const SegmentPtr& seg : sealed_) st.hot_bytes += seg->size;
+    for (const ArchivePtr& arc : archives_) {
+        st.archive_bytes += arc->map.size();
+        st.archive_raw_bytes += arc->raw_bytes;
+    }
+    return st;
+}
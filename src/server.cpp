@@ -0,0 +1,528 @@
+#include "server.hpp"
+
+#ifdef BANK_HAVE_SERVER
+#include "bank.hpp"
+#include "fields.hpp"
+#include "parallel.hpp"
+
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+[[noreturn]] void fail(const std::string& what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Opens the listening socket for "unix:<path>" or "[host:]port"; fills address with what
+// was actually bound.
+int open_listener(const std::string& spec, std::string& address, std::string& unix_path) {
+    if (spec.compare(0, 5, "unix:") == 0) {
+        unix_path = spec.substr(5);
+        sockaddr_un sa{};
+        if (unix_path.empty() || unix_path.size() >= sizeof(sa.sun_path)) {
+            throw std::runtime_error("Invalid socket path '" + unix_path + "'");
+        }
+        sa.sun_family = AF_UNIX;
+        std::memcpy(sa.sun_path, unix_path.c_str(), unix_path.size() + 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) fail("socket");
+        ::unlink(unix_path.c_str()); // left behind by a previous run
+        if (bind(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) < 0 || listen(fd, SOMAXCONN) < 0) {
+            int e = errno;
+            ::close(fd);
+            errno = e;
+            fail("Cannot listen on " + spec);
+        }
+        address = spec;
+        return fd;
+    }
+
+    std::string host = "127.0.0.1", port = spec;
+    if (std::size_t colon = spec.rfind(':'); colon != std::string::npos) {
+        host = spec.substr(0, colon);
+        port = spec.substr(colon + 1);
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    addrinfo* res = nullptr;
+    if (int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &res); rc != 0) {
+        throw std::runtime_error("Cannot resolve '" + spec + "': " + gai_strerror(rc));
+    }
+    int fd = -1;
+    for (addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || listen(fd, SOMAXCONN) < 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd < 0) fail("Cannot listen on " + spec);
+
+    sockaddr_storage sa{};
+    socklen_t len = sizeof(sa);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&sa), &len);
+    char name[NI_MAXHOST], serv[NI_MAXSERV];
+    getnameinfo(reinterpret_cast<sockaddr*>(&sa), len, name, sizeof(name), serv, sizeof(serv),
+                NI_NUMERICHOST | NI_NUMERICSERV);
+    address = std::string(name) + ":" + serv;
+    return fd;
+}
+
+void append_line(std::string& out, std::string_view status, std::string_view text = {}) {
+    out.append(status.data(), status.size());
+    if (!text.empty()) {
+        out += ' ';
+        out.append(text.data(), text.size());
+    }
+    out += '\n';
+}
+
+void append_balance(std::string& out, Money balance) {
+    out += "OK ";
+    balance.append_to(out);
+    out += '\n';
+}
+
+} // namespace
+
+struct Server::Conn {
+    struct Request {
+        std::string line;
+        Clock::time_point received;
+    };
+
+    int fd;
+    // Loop thread only.
+    std::string in;           // bytes not yet split into lines
+    std::string out;          // responses not yet written
+    bool peer_closed = false; // read side hit EOF
+    std::uint32_t events = 0; // current epoll interest
+
+    // Shared with the worker serving the connection.
+    std::mutex mu;
+    std::deque<Request> pending; // requests waiting for a worker
+    std::string done;            // responses ready for the loop
+    bool scheduled = false;      // queued for or held by a worker
+    bool quit = false;           // QUIT answered; close once written
+
+    // Worker only; at most one worker holds the connection at a time.
+    std::optional<Session> session;
+
+    explicit Conn(int f) : fd(f) {}
+};
+
+Server::Server(Bank& bank, ServerOptions opts) : bank_(bank), opts_(std::move(opts)) {
+    // The destructor does not run when a constructor throws, so undo a partial setup here.
+    try {
+        listen_fd_ = open_listener(opts_.listen, address_, unix_path_);
+        spare_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (spare_fd_ < 0) fail("/dev/null");
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd_ < 0 || event_fd_ < 0) fail("epoll");
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = listen_fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) < 0) fail("epoll_ctl");
+        ev.data.fd = event_fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &ev) < 0) fail("epoll_ctl");
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+Server::~Server() {
+    release();
+}
+
+void Server::release() {
+    for (auto& [fd, c] : conns_) ::close(fd);
+    conns_.clear();
+    if (listen_fd_ >= 0 && !unix_path_.empty()) ::unlink(unix_path_.c_str()); // only once bound
+    for (int* fd : {&listen_fd_, &epoll_fd_, &event_fd_, &spare_fd_}) {
+        if (*fd >= 0) ::close(*fd);
+        *fd = -1;
+    }
+}
+
+void Server::stop() {
+    stop_.store(true);
+    std::uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = ::write(event_fd_, &one, sizeof(one));
+}
+
+void Server::run() {
+    {
+        std::lock_guard<std::mutex> lk(work_mu_);
+        workers_stop_ = false;
+    }
+    unsigned n = parallel::threads_for(opts_.workers);
+    for (unsigned i = 0; i < n; ++i) workers_.emplace_back([this] { work(); });
+
+    epoll_event events[256];
+    while (!stop_.load()) {
+        int ready = epoll_wait(epoll_fd_, events, 256, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            fail("epoll_wait");
+        }
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd_) { on_accept(); continue; }
+            if (fd == event_fd_) { on_ready(); continue; }
+            auto it = conns_.find(fd);
+            if (it == conns_.end()) continue;
+            ConnPtr c = it->second; // keeps it alive if this event closes it
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) on_readable(c);
+            if (c->fd >= 0 && (events[i].events & EPOLLOUT)) flush(c);
+        }
+    }
+
+    // Let the workers finish what is queued, then write out what is ready.
+    {
+        std::lock_guard<std::mutex> lk(work_mu_);
+        workers_stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : workers_) t.join();
+    workers_.clear();
+    on_ready();
+    std::vector<ConnPtr> open;
+    for (auto& [fd, c] : conns_) open.push_back(c);
+    for (auto& c : open) close_conn(c);
+}
+
+void Server::on_accept() {
+    for (;;) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                shed_connection();
+                if (accept_paused_) return;
+                continue;
+            }
+            std::cerr << "Server: accept failed: " << std::strerror(errno) << "\n";
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on Unix sockets
+        auto c = std::make_shared<Conn>(fd);
+        c->events = EPOLLIN;
+        epoll_event ev{};
+        ev.events = c->events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            std::cerr << "Server: cannot watch a connection: " << std::strerror(errno) << "\n";
+            ::close(fd);
+            continue;
+        }
+        conns_.emplace(fd, std::move(c));
+        connections_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Server::shed_connection() {
+    // The pending connection keeps the level-triggered listener readable, so it has to be taken
+    // off the queue: free the spare descriptor, accept and close the connection, take the spare
+    // back. Without a spare, stop watching the listener until a connection closes.
+    refused_.fetch_add(1, std::memory_order_relaxed);
+    if (spare_fd_ >= 0) {
+        ::close(spare_fd_);
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) ::close(fd);
+        spare_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) return;
+    }
+    pause_accept(true);
+}
+
+void Server::pause_accept(bool pause) {
+    if (accept_paused_ == pause) return;
+    epoll_event ev{};
+    ev.events = pause ? 0u : static_cast<std::uint32_t>(EPOLLIN);
+    ev.data.fd = listen_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, listen_fd_, &ev);
+    accept_paused_ = pause;
+}
+
+void Server::on_readable(const ConnPtr& c) {
+    char buf[64 * 1024];
+    for (;;) {
+        ssize_t n = ::read(c->fd, buf, sizeof(buf));
+        if (n > 0) {
+            c->in.append(buf, static_cast<std::size_t>(n));
+            if (static_cast<std::size_t>(n) < sizeof(buf)) break;
+        } else if (n == 0) {
+            c->peer_closed = true;
+            break;
+        } else {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { close_conn(c); return; }
+            break;
+        }
+    }
+
+    // Hand complete lines to the connection's queue in one go.
+    auto now = Clock::now();
+    bool added = false;
+    std::size_t pos = 0;
+    {
+        std::lock_guard<std::mutex> lk(c->mu);
+        for (std::size_t nl; (nl = c->in.find('\n', pos)) != std::string::npos; pos = nl + 1) {
+            std::size_t len = nl - pos;
+            if (len > 0 && c->in[nl - 1] == '\r') --len;
+            c->pending.push_back(Conn::Request{c->in.substr(pos, len), now});
+            added = true;
+        }
+        if (added && !c->scheduled && !c->quit) c->scheduled = true;
+        else added = false;
+    }
+    c->in.erase(0, pos);
+    if (c->in.size() > opts_.max_line) { close_conn(c); return; }
+    if (added) schedule(c);
+    flush(c);
+}
+
+void Server::schedule(const ConnPtr& c) {
+    {
+        std::lock_guard<std::mutex> lk(work_mu_);
+        work_.push_back(c);
+    }
+    work_cv_.notify_one();
+}
+
+void Server::work() {
+    for (;;) {
+        ConnPtr c;
+        {
+            std::unique_lock<std::mutex> lk(work_mu_);
+            work_cv_.wait(lk, [&] { return !work_.empty() || workers_stop_; });
+            if (work_.empty()) return;
+            c = std::move(work_.front());
+            work_.pop_front();
+        }
+        serve(c);
+    }
+}
+
+void Server::serve(const ConnPtr& c) {
+    std::deque<Conn::Request> batch;
+    {
+        std::lock_guard<std::mutex> lk(c->mu);
+        batch.swap(c->pending);
+    }
+    std::string out;
+    bool quit = false;
+    for (const auto& req : batch) {
+        std::string_view line(req.line);
+        if (line.find_first_not_of(" \t") == std::string_view::npos) continue;
+        try {
+            quit = !handle(*c, line, out);
+        } catch (const std::exception& ex) {
+            // A Bank call that throws (a failed save, a full disk) answers this request only;
+            // the worker and the rest of the server keep going.
+            append_line(out, "ERR", std::string("Internal error: ") + ex.what());
+        }
+        latency_.record(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - req.received).count()));
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        if (quit) break;
+    }
+
+    // Requests that arrived meanwhile go to the back of the queue, so one busy pipeline
+    // cannot hold a worker while other connections wait.
+    bool again;
+    {
+        std::lock_guard<std::mutex> lk(c->mu);
+        c->done += out;
+        if (quit) {
+            c->quit = true;
+            c->pending.clear();
+        }
+        again = !c->pending.empty();
+        c->scheduled = again;
+    }
+    {
+        std::lock_guard<std::mutex> lk(ready_mu_);
+        ready_.push_back(c);
+    }
+    std::uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = ::write(event_fd_, &one, sizeof(one));
+    if (again) schedule(c);
+}
+
+void Server::on_ready() {
+    std::uint64_t count;
+    [[maybe_unused]] ssize_t n = ::read(event_fd_, &count, sizeof(count));
+    std::vector<ConnPtr> ready;
+    {
+        std::lock_guard<std::mutex> lk(ready_mu_);
+        ready.swap(ready_);
+    }
+    for (const auto& c : ready) {
+        if (c->fd >= 0) flush(c);
+    }
+}
+
+void Server::flush(const ConnPtr& c) {
+    std::size_t pending;
+    bool scheduled, quit;
+    {
+        std::lock_guard<std::mutex> lk(c->mu);
+        if (c->out.empty()) c->out.swap(c->done);
+        else c->out += c->done;
+        c->done.clear();
+        pending = c->pending.size();
+        scheduled = c->scheduled;
+        quit = c->quit;
+    }
+
+    std::size_t written = 0;
+    while (written < c->out.size()) {
+        ssize_t n = ::send(c->fd, c->out.data() + written, c->out.size() - written, MSG_NOSIGNAL);
+        if (n > 0) { written += static_cast<std::size_t>(n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        close_conn(c); // peer gone
+        return;
+    }
+    c->out.erase(0, written);
+
+    if (c->out.empty() && !scheduled && (quit || c->peer_closed)) {
+        close_conn(c);
+        return;
+    }
+    // Stop reading while enough requests or responses are backed up; the peer then blocks on
+    // its own send buffer instead of growing ours.
+    std::uint32_t want = 0;
+    if (!quit && !c->peer_closed && pending < opts_.max_pipeline && c->out.size() < opts_.max_pipeline * 256) {
+        want |= EPOLLIN;
+    }
+    if (!c->out.empty()) want |= EPOLLOUT;
+    if (want != c->events) {
+        epoll_event ev{};
+        ev.events = want;
+        ev.data.fd = c->fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = want;
+    }
+}
+
+void Server::close_conn(const ConnPtr& c) {
+    if (c->fd < 0) return;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c->fd, nullptr);
+    ::close(c->fd);
+    conns_.erase(c->fd);
+    c->fd = -1;
+    if (accept_paused_) {
+        if (spare_fd_ < 0) spare_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        pause_accept(false);
+    }
+}
+
+bool Server::handle(Conn& c, std::string_view line, std::string& out) {
+    std::string_view f[4];
+    std::size_t n = fields::split(line, f);
+    std::string err;
+    Money amount;
+
+    if (fields::iequals(f[0], "PING")) { append_line(out, "OK", "PONG"); return true; }
+    if (fields::iequals(f[0], "QUIT")) { append_line(out, "OK"); return false; }
+    if (fields::iequals(f[0], "CREATE")) {
+        if (n < 3 || n > 4) { append_line(out, "ERR", "Expected: CREATE <username> <password> [amount]"); return true; }
+        if (n == 4 && !Money::parse(f[3], amount)) { append_line(out, "ERR", "Invalid amount."); return true; }
+        if (bank_.create_account(std::string(f[1]), std::string(f[2]), amount, err)) append_line(out, "OK");
+        else append_line(out, "ERR", err);
+        return true;
+    }
+    if (fields::iequals(f[0], "LOGIN")) {
+        if (n != 3) { append_line(out, "ERR", "Expected: LOGIN <username> <password>"); return true; }
+        c.session = bank_.authenticate(std::string(f[1]), std::string(f[2]));
+        if (c.session) append_line(out, "OK");
+        else append_line(out, "ERR", "Invalid credentials.");
+        return true;
+    }
+    if (fields::iequals(f[0], "LOGOUT")) { c.session.reset(); append_line(out, "OK"); return true; }
+
+    bool is_balance = fields::iequals(f[0], "BALANCE"), is_deposit = fields::iequals(f[0], "DEPOSIT"),
+         is_withdraw = fields::iequals(f[0], "WITHDRAW"), is_transfer = fields::iequals(f[0], "TRANSFER"),
+         is_history = fields::iequals(f[0], "HISTORY");
+    if (!(is_balance || is_deposit || is_withdraw || is_transfer || is_history)) {
+        append_line(out, "ERR", "Unknown command '" + std::string(f[0]) + "'.");
+        return true;
+    }
+    if (!c.session) { append_line(out, "ERR", "Not logged in."); return true; }
+    const Session& s = *c.session;
+
+    if (is_balance) {
+        auto bal = bank_.balance_of(s);
+        if (bal) append_balance(out, *bal);
+        else append_line(out, "ERR", "Account not found.");
+        return true;
+    }
+    if (is_history) {
+        std::size_t count = 10;
+        if (n > 2) { append_line(out, "ERR", "Expected: HISTORY [n]"); return true; }
+        if (n == 2) {
+            count = 0;
+            for (char ch : f[1]) {
+                if (ch < '0' || ch > '9' || count > 1000) { append_line(out, "ERR", "Invalid count."); return true; }
+                count = count * 10 + static_cast<std::size_t>(ch - '0');
+            }
+            count = std::min<std::size_t>(count, 1000);
+        }
+        auto txs = bank_.recent_history(s.username, count);
+        out += "OK ";
+        out += std::to_string(txs.size());
+        out += '\n';
+        for (const auto& tx : txs) {
+            std::string counterparty;
+            if (tx.counterparty != kNoAccount) counterparty = bank_.username_of(tx.counterparty).value_or("?");
+            append_transaction_line(out, tx, counterparty);
+        }
+        return true;
+    }
+
+    // DEPOSIT / WITHDRAW <amount>, TRANSFER <to> <amount>
+    std::size_t want = is_transfer ? 3 : 2;
+    if (n != want) {
+        append_line(out, "ERR", is_transfer ? "Expected: TRANSFER <to> <amount>"
+                              : is_deposit ? "Expected: DEPOSIT <amount>" : "Expected: WITHDRAW <amount>");
+        return true;
+    }
+    if (!Money::parse(f[want - 1], amount)) { append_line(out, "ERR", "Invalid amount."); return true; }
+    Money after;
+    bool ok = is_deposit ? bank_.deposit(s.username, amount, err, &after)
+            : is_withdraw ? bank_.withdraw(s.username, amount, err, &after)
+            : bank_.transfer(s.username, std::string(f[1]), amount, err, &after);
+    if (!ok) { append_line(out, "ERR", err); return true; }
+    append_balance(out, after);
+    return true;
+}
+
+#endif // BANK_HAVE_SERVER
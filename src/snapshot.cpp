@@ -0,0 +1,177 @@
+#include "snapshot.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace snapshot {
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapped_) munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+bool MappedFile::open(const std::filesystem::path& path, std::string& err) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { err = "Cannot open " + path.string(); return false; }
+    struct stat st{};
+    if (fstat(fd, &st) != 0) { ::close(fd); err = "Cannot stat " + path.string(); return false; }
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ > 0) {
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { ::close(fd); err = "Cannot map " + path.string(); return false; }
+        data_ = static_cast<const char*>(p);
+        mapped_ = true;
+    }
+    ::close(fd); // the mapping stays valid
+    return true;
+#else
+    std::ifstream in(path, std::ios::binary);
+    if (!in) { err = "Cannot open " + path.string(); return false; }
+    copy_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data_ = copy_.data();
+    size_ = copy_.size();
+    return true;
+#endif
+}
+
+bool View::open(const std::filesystem::path& path, std::string& err) {
+    if (!file_.open(path, err)) return false;
+    if (file_.size() < sizeof(Header)) { err = "Snapshot too small."; return false; }
+    Header h;
+    std::memcpy(&h, file_.data(), sizeof(h));
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0) { err = "Not a binary snapshot."; return false; }
+    std::uint64_t body = file_.size() - sizeof(Header);
+    if (h.count > body / sizeof(Record) || h.pool_size != body - h.count * sizeof(Record)) {
+        err = "Snapshot size does not match its header.";
+        return false;
+    }
+    records_ = reinterpret_cast<const Record*>(file_.data() + sizeof(Header));
+    count_ = static_cast<std::size_t>(h.count);
+    pool_ = file_.data() + sizeof(Header) + count_ * sizeof(Record);
+    pool_size_ = h.pool_size;
+    return true;
+}
+
+std::optional<std::size_t> View::find(std::string_view username) const {
+    std::size_t lo = 0, hi = count_;
+    while (lo < hi) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        int c = this->username(mid).compare(username);
+        if (c == 0) return mid;
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return std::nullopt;
+}
+
+bool is_binary(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(kMagic)] = {};
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+static bool commit_tmp(const std::filesystem::path& tmp, const std::filesystem::path& path, std::string& err) {
+    // The caller drops the journal once this returns, so the new contents and the rename must
+    // both be on disk first: sync the file, rename it, then sync the directory entry.
+    if (!utils::fsync_path(tmp)) { err = "Cannot sync " + tmp.string(); return false; }
+    std::error_code ec;
+    // Atomic replace: readers see either the old snapshot or the new one, never a partial file.
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) { err = "Cannot replace " + path.string() + ": " + ec.message(); return false; }
+    std::filesystem::path dir = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+    if (!utils::fsync_path(dir)) { err = "Cannot sync " + dir.string(); return false; }
+    return true;
+}
+
+bool write_binary(const std::filesystem::path& path, std::vector<Row> rows, std::string& err) {
+    std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return std::get<0>(a) < std::get<0>(b); });
+
+    std::vector<Record> records;
+    records.reserve(rows.size());
+    std::uint64_t pool_size = 0;
+    for (const auto& r : rows) {
+        Record rec{};
+        rec.name_off = pool_size;
+        rec.name_len = static_cast<std::uint32_t>(std::get<0>(r).size());
+        pool_size += rec.name_len;
+        rec.hash_off = pool_size;
+        rec.hash_len = static_cast<std::uint32_t>(std::get<1>(r).size());
+        pool_size += rec.hash_len;
+        rec.balance_cents = std::get<2>(r).cents();
+        records.push_back(rec);
+    }
+
+    Header h{};
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.count = records.size();
+    h.pool_size = pool_size;
+
+    if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path());
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+        for (const auto& r : rows) {
+            out.write(std::get<0>(r).data(), static_cast<std::streamsize>(std::get<0>(r).size()));
+            out.write(std::get<1>(r).data(), static_cast<std::streamsize>(std::get<1>(r).size()));
+        }
+        out.flush();
+        if (!out) { err = "Failed to write " + tmp.string(); return false; }
+    }
+    return commit_tmp(tmp, path, err);
+}
+
+bool write_text(const std::filesystem::path& path, const std::vector<Row>& rows, std::string& err) {
+    if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path());
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        std::string buf;
+        for (const auto& r : rows) {
+            buf += std::get<0>(r); buf += '|'; buf += std::get<1>(r); buf += '|';
+            std::get<2>(r).append_to(buf);
+            buf += '\n';
+            if (buf.size() >= (1u << 16)) { out.write(buf.data(), static_cast<std::streamsize>(buf.size())); buf.clear(); }
+        }
+        out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        out.flush();
+        if (!out) { err = "Failed to write " + tmp.string(); return false; }
+    }
+    return commit_tmp(tmp, path, err);
+}
+
+bool text_to_binary(const std::filesystem::path& in, const std::filesystem::path& out, std::string& err) {
+    std::vector<Row> rows;
+    if (!read_text(in, [&](std::string u, std::string h, Money b) { rows.emplace_back(std::move(u), std::move(h), b); })) {
+        err = "Cannot open " + in.string();
+        return false;
+    }
+    return write_binary(out, std::move(rows), err);
+}
+
+bool binary_to_text(const std::filesystem::path& in, const std::filesystem::path& out, std::string& err) {
+    View view;
+    if (!view.open(in, err)) return false;
+    std::vector<Row> rows;
+    rows.reserve(view.size());
+    for (std::size_t i = 0; i < view.size(); ++i) {
+        rows.emplace_back(std::string(view.username(i)), std::string(view.password_hash(i)), view.balance(i));
+    }
+    return write_text(out, rows, err);
+}
+
+} // namespace snapshot
@@ -0,0 +1,120 @@
+#include "timestamp.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+
+namespace timestamp {
+
+namespace {
+
+constexpr Micros kPerSecond = 1000000;
+
+// Floor division, so times before 1970 still split into second + non-negative fraction.
+Micros seconds_of(Micros t) { return t >= 0 ? t / kPerSecond : -((-t + kPerSecond - 1) / kPerSecond); }
+
+// The last second this thread formatted.
+struct FormatCache {
+    Micros second = INT64_MIN;
+    char prefix[20];   // YYYY-MM-DDThh:mm:ss
+};
+
+FormatCache& format_cache(Micros t) {
+    thread_local FormatCache cache;
+    Micros sec = seconds_of(t);
+    if (cache.second == sec) return cache;
+    std::time_t tt = static_cast<std::time_t>(sec);
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &tt);
+#else
+    localtime_r(&tt, &tm);
+#endif
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    std::memcpy(cache.prefix, buf, sizeof(cache.prefix) - 1);
+    cache.second = sec;
+    return cache;
+}
+
+// The last hour this thread parsed: "YYYY-MM-DDThh" and its epoch second.
+struct ParseCache {
+    char hour[13] = {};
+    bool valid = false;
+    Micros epoch = 0;
+};
+
+bool digits(std::string_view s, std::size_t pos, std::size_t n, int& v) {
+    v = 0;
+    for (std::size_t i = pos; i < pos + n; ++i) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        v = v * 10 + (s[i] - '0');
+    }
+    return true;
+}
+
+} // namespace
+
+Micros next() {
+    static std::atomic<Micros> last{0};
+    Micros now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    Micros prev = last.load(std::memory_order_relaxed);
+    Micros t;
+    do {
+        t = now > prev ? now : prev + 1;
+    } while (!last.compare_exchange_weak(prev, t, std::memory_order_relaxed));
+    return t;
+}
+
+void append_iso(std::string& out, Micros t) {
+    const FormatCache& c = format_cache(t);
+    out.append(c.prefix, sizeof(c.prefix) - 1);
+    Micros frac = t - seconds_of(t) * kPerSecond;
+    char buf[8] = {'.'};
+    for (int i = 6; i >= 1; --i, frac /= 10) buf[i] = static_cast<char>('0' + frac % 10);
+    out.append(buf, 7);
+}
+
+std::string iso(Micros t) {
+    std::string out;
+    append_iso(out, t);
+    return out;
+}
+
+bool parse(std::string_view s, Micros& t) {
+    int year, mon, day, hour, min, sec;
+    if (s.size() < 19 || s[4] != '-' || s[7] != '-' || s[10] != 'T' || s[13] != ':' || s[16] != ':' ||
+        !digits(s, 0, 4, year) || !digits(s, 5, 2, mon) || !digits(s, 8, 2, day) || !digits(s, 11, 2, hour) ||
+        !digits(s, 14, 2, min) || !digits(s, 17, 2, sec) || min > 59 || sec > 60) return false;
+
+    Micros frac = 0;
+    if (s.size() > 19) {
+        if (s[19] != '.' || s.size() == 20 || s.size() > 26) return false;
+        int d;
+        for (std::size_t i = 20; i < 26; ++i) {
+            if (i < s.size() && !digits(s, i, 1, d)) return false;
+            frac = frac * 10 + (i < s.size() ? d : 0);
+        }
+    }
+
+    thread_local ParseCache cache;
+    if (!cache.valid || std::memcmp(cache.hour, s.data(), sizeof(cache.hour)) != 0) {
+        std::tm tm{};
+        tm.tm_year = year - 1900;
+        tm.tm_mon = mon - 1;
+        tm.tm_mday = day;
+        tm.tm_hour = hour;
+        tm.tm_isdst = -1;
+        std::time_t tt = std::mktime(&tm);
+        if (tt == static_cast<std::time_t>(-1)) return false;
+        std::memcpy(cache.hour, s.data(), sizeof(cache.hour));
+        cache.epoch = static_cast<Micros>(tt);
+        cache.valid = true;
+    }
+    t = (cache.epoch + min * 60 + sec) * kPerSecond + frac;
+    return true;
+}
+
+} // namespace timestamp
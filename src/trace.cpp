@@ -0,0 +1,364 @@
+#include "trace.hpp"
+#include "sha256.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace trace {
+
+namespace {
+
+constexpr char kMagic[8] = {'B', 'K', 'T', 'R', 'A', 'C', 'E', '1'};
+constexpr std::size_t kFlushBytes = 1 << 20;
+constexpr std::uint8_t kOkBit = 0x80;
+
+void put_varint(std::string& out, std::uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+std::uint64_t zigzag(std::int64_t v) { return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63); }
+std::int64_t unzigzag(std::uint64_t v) { return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1); }
+
+void put_money(std::string& out, Money m) { put_varint(out, zigzag(m.cents())); }
+
+// Calls that carry a password / a result value.
+bool has_password(Call c) { return c == Call::CreateAccount || c == Call::Authenticate; }
+// A failed login records the password length only.
+bool has_digest(Call c, bool ok, std::uint8_t len) { return len >= 4 && (ok || c != Call::Authenticate); }
+bool has_result(Call c) {
+    return c == Call::ApplyBatch || c == Call::BalanceOf || c == Call::HistorySize || c == Call::History ||
+           c == Call::RecentHistory || c == Call::HistoryRange || c == Call::End;
+}
+
+std::uint64_t mix(std::uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+} // namespace
+
+const char* name(Call call) {
+    switch (call) {
+        case Call::CreateAccount: return "create_account";
+        case Call::Authenticate: return "authenticate";
+        case Call::Deposit: return "deposit";
+        case Call::Withdraw: return "withdraw";
+        case Call::Transfer: return "transfer";
+        case Call::ApplyBatch: return "apply_batch";
+        case Call::BalanceOf: return "balance_of";
+        case Call::HistorySize: return "history_size";
+        case Call::History: return "history";
+        case Call::RecentHistory: return "recent_history";
+        case Call::HistoryRange: return "history_range";
+        case Call::SetDeferred: return "set_deferred";
+        case Call::Commit: return "commit";
+        case Call::End: return "end";
+    }
+    return "unknown";
+}
+
+std::string replay_password(const PasswordDigest& digest, std::uint8_t len) {
+    if (len < 4) return std::string(len, 'x'); // rejected for its length, as the original was
+    return digest_to_hex(digest);
+}
+
+PasswordDigest replay_digest(const PasswordDigest& digest) {
+    std::string hex = digest_to_hex(digest);
+    PasswordDigest d;
+    picosha2::hash256(hex.data(), hex.size(), d.data());
+    return d;
+}
+
+std::uint64_t state_add(std::uint64_t sum, std::string_view username, Money balance) {
+    return sum + mix(std::hash<std::string_view>{}(username) ^ mix(static_cast<std::uint64_t>(balance.cents())));
+}
+
+std::uint64_t fingerprint(const std::vector<Transaction>& records) {
+    std::uint64_t h = mix(records.size());
+    for (const Transaction& tx : records) {
+        h = mix(h ^ static_cast<std::uint64_t>(tx.type));
+        h = mix(h ^ static_cast<std::uint64_t>(tx.amount.cents()));
+        h = mix(h ^ static_cast<std::uint64_t>(tx.balance_after.cents()));
+    }
+    return h;
+}
+
+std::uint64_t fingerprint(const std::vector<std::pair<Money, Money>>& leg_balances) {
+    std::uint64_t h = mix(leg_balances.size());
+    for (const auto& [from, to] : leg_balances) {
+        h = mix(h ^ static_cast<std::uint64_t>(from.cents()));
+        h = mix(h ^ static_cast<std::uint64_t>(to.cents()));
+    }
+    return h;
+}
+
+Recorder::Recorder(const std::filesystem::path& path, const std::vector<Account>& initial)
+    : start_(std::chrono::steady_clock::now()) {
+    file_ = std::fopen(path.string().c_str(), "wb");
+    if (!file_) throw std::runtime_error("Cannot create trace " + path.string());
+    buf_.append(kMagic, sizeof(kMagic));
+    put_varint(buf_, initial.size());
+    for (const Account& a : initial) {
+        put_string(a.username);
+        buf_.append(reinterpret_cast<const char*>(a.digest.data()), a.digest.size());
+        put_money(buf_, a.balance);
+        put_varint(buf_, a.history);
+        if (buf_.size() >= kFlushBytes) flush_locked();
+    }
+    flush_locked();
+}
+
+Recorder::~Recorder() {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!file_) return;
+    try { flush_locked(); } catch (...) {}
+    std::fclose(file_);
+}
+
+void Recorder::record(Event& e) {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!file_) return;
+    e.at_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+    buf_.push_back(static_cast<char>(static_cast<std::uint8_t>(e.call) | (e.ok ? kOkBit : 0)));
+    put_varint(buf_, static_cast<std::uint64_t>(std::max<std::int64_t>(0, e.at_us - last_us_)));
+    last_us_ = std::max(last_us_, e.at_us);
+    put_varint(buf_, e.latency_ns);
+    switch (e.call) {
+        case Call::CreateAccount:
+        case Call::Authenticate:
+        case Call::Deposit:
+        case Call::Withdraw:
+        case Call::BalanceOf:
+        case Call::HistorySize:
+            put_string(e.user);
+            break;
+        case Call::Transfer:
+            put_string(e.user);
+            put_string(e.other);
+            break;
+        case Call::History:
+            put_string(e.user);
+            put_varint(buf_, e.offset);
+            put_varint(buf_, e.limit);
+            break;
+        case Call::RecentHistory:
+            put_string(e.user);
+            put_varint(buf_, e.limit);
+            break;
+        case Call::HistoryRange:
+            put_string(e.user);
+            put_string(e.from_ts);
+            put_string(e.to_ts);
+            put_varint(buf_, e.limit);
+            break;
+        case Call::ApplyBatch:
+            put_varint(buf_, e.legs.size());
+            for (const Leg& leg : e.legs) {
+                put_string(leg.from);
+                put_string(leg.to);
+                put_money(buf_, leg.amount);
+            }
+            break;
+        case Call::End:
+            put_varint(buf_, e.offset);
+            break;
+        case Call::SetDeferred:
+        case Call::Commit:
+            break;
+    }
+    if (has_password(e.call)) {
+        buf_.push_back(static_cast<char>(e.password_len));
+        if (has_digest(e.call, e.ok, e.password_len)) {
+            buf_.append(reinterpret_cast<const char*>(e.password.data()), e.password.size());
+        }
+    }
+    if (e.call == Call::CreateAccount || e.call == Call::Deposit || e.call == Call::Withdraw || e.call == Call::Transfer) {
+        put_money(buf_, e.amount);
+    }
+    if (!e.ok && e.call != Call::SetDeferred) put_string(e.err);
+    if (has_result(e.call) && (e.ok || e.call == Call::End)) put_varint(buf_, e.result);
+    ++events_;
+    if (buf_.size() >= kFlushBytes) flush_locked();
+}
+
+void Recorder::close(std::size_t accounts, std::uint64_t checksum) {
+    Event end;
+    end.call = Call::End;
+    end.ok = true;
+    end.offset = accounts;
+    end.result = checksum;
+    record(end);
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!file_) return;
+    flush_locked();
+    utils::fsync_file(file_);
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+std::uint64_t Recorder::events() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return events_;
+}
+
+void Recorder::put_string(std::string_view s) {
+    auto [it, added] = strings_.try_emplace(std::string(s), strings_.size());
+    if (!added) {
+        put_varint(buf_, it->second << 1);
+        return;
+    }
+    put_varint(buf_, static_cast<std::uint64_t>(s.size()) << 1 | 1);
+    buf_.append(s.data(), s.size());
+}
+
+void Recorder::flush_locked() {
+    if (buf_.empty()) return;
+    if (std::fwrite(buf_.data(), 1, buf_.size(), file_) != buf_.size() || std::fflush(file_) != 0) {
+        throw std::runtime_error("Failed to write trace");
+    }
+    buf_.clear();
+}
+
+bool Reader::open(const std::filesystem::path& path, std::string& err) {
+    if (!file_.open(path, err)) return false;
+    data_ = std::string_view(file_.data(), file_.size());
+    if (data_.size() < sizeof(kMagic) || std::memcmp(data_.data(), kMagic, sizeof(kMagic)) != 0) {
+        err = path.string() + " is not a trace file.";
+        return false;
+    }
+    pos_ = sizeof(kMagic);
+    std::uint64_t n;
+    if (!get_varint(n)) { err = "Trace header is cut short."; return false; }
+    initial_.clear();
+    initial_.reserve(std::min<std::uint64_t>(n, data_.size()));
+    for (std::uint64_t i = 0; i < n; ++i) {
+        Account a;
+        if (!get_string(a.username) || data_.size() - pos_ < a.digest.size()) { err = "Trace header is cut short."; return false; }
+        std::memcpy(a.digest.data(), data_.data() + pos_, a.digest.size());
+        pos_ += a.digest.size();
+        if (!get_money(a.balance) || !get_varint(a.history)) { err = "Trace header is cut short."; return false; }
+        initial_.push_back(std::move(a));
+    }
+    return true;
+}
+
+bool Reader::next(Event& e, std::string& err) {
+    if (pos_ >= data_.size()) return false;
+    std::size_t start = pos_;
+    auto fail = [&](const char* what) {
+        err = std::string(what) + " at byte " + std::to_string(start) + ".";
+        pos_ = data_.size();
+        return false;
+    };
+    std::uint8_t tag = static_cast<std::uint8_t>(data_[pos_++]);
+    e = Event{};
+    e.call = static_cast<Call>(tag & ~kOkBit);
+    e.ok = (tag & kOkBit) != 0;
+    if (e.call < Call::CreateAccount || e.call > Call::End) return fail("Unknown trace record");
+    std::uint64_t dt, v;
+    if (!get_varint(dt) || !get_varint(e.latency_ns)) return fail("Trace record cut short");
+    last_us_ += static_cast<std::int64_t>(dt);
+    e.at_us = last_us_;
+
+    bool ok = true;
+    switch (e.call) {
+        case Call::CreateAccount:
+        case Call::Authenticate:
+        case Call::Deposit:
+        case Call::Withdraw:
+        case Call::BalanceOf:
+        case Call::HistorySize:
+            ok = get_string(e.user);
+            break;
+        case Call::Transfer:
+            ok = get_string(e.user) && get_string(e.other);
+            break;
+        case Call::History:
+            ok = get_string(e.user) && get_varint(e.offset) && get_varint(e.limit);
+            break;
+        case Call::RecentHistory:
+            ok = get_string(e.user) && get_varint(e.limit);
+            break;
+        case Call::HistoryRange:
+            ok = get_string(e.user) && get_string(e.from_ts) && get_string(e.to_ts) && get_varint(e.limit);
+            break;
+        case Call::ApplyBatch:
+            ok = get_varint(v) && v <= data_.size();
+            for (std::uint64_t i = 0; ok && i < v; ++i) {
+                Leg leg;
+                ok = get_string(leg.from) && get_string(leg.to) && get_money(leg.amount);
+                e.legs.push_back(std::move(leg));
+            }
+            break;
+        case Call::End:
+            ok = get_varint(e.offset);
+            break;
+        case Call::SetDeferred:
+        case Call::Commit:
+            break;
+    }
+    if (ok && has_password(e.call)) {
+        ok = pos_ < data_.size();
+        if (ok) e.password_len = static_cast<std::uint8_t>(data_[pos_++]);
+        if (ok && has_digest(e.call, e.ok, e.password_len)) {
+            ok = data_.size() - pos_ >= e.password.size();
+            if (ok) {
+                std::memcpy(e.password.data(), data_.data() + pos_, e.password.size());
+                pos_ += e.password.size();
+            }
+        }
+    }
+    if (ok && (e.call == Call::CreateAccount || e.call == Call::Deposit || e.call == Call::Withdraw || e.call == Call::Transfer)) {
+        ok = get_money(e.amount);
+    }
+    if (ok && !e.ok && e.call != Call::SetDeferred) ok = get_string(e.err);
+    if (ok && has_result(e.call) && (e.ok || e.call == Call::End)) ok = get_varint(e.result);
+    if (!ok) return fail("Trace record cut short");
+    return true;
+}
+
+bool Reader::get_varint(std::uint64_t& v) {
+    v = 0;
+    for (unsigned shift = 0; shift < 64 && pos_ < data_.size(); shift += 7) {
+        std::uint8_t b = static_cast<std::uint8_t>(data_[pos_++]);
+        v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+bool Reader::get_money(Money& m) {
+    std::uint64_t v;
+    if (!get_varint(v)) return false;
+    m = Money::from_cents(unzigzag(v));
+    return true;
+}
+
+bool Reader::get_string(std::string& out) {
+    std::uint64_t v;
+    if (!get_varint(v)) return false;
+    if (!(v & 1)) {
+        if ((v >> 1) >= strings_.size()) return false;
+        out = strings_[v >> 1];
+        return true;
+    }
+    std::uint64_t len = v >> 1;
+    if (len > data_.size() - pos_) return false;
+    out.assign(data_.data() + pos_, len);
+    pos_ += len;
+    strings_.push_back(out);
+    return true;
+}
+
+} // namespace trace
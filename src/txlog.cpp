@@ -0,0 +1,285 @@
+#include "txlog.hpp"
+#include "utils.hpp"
+#include "history.hpp"
+
+#include <iterator>
+
+TxLogWriter::TxLogWriter(std::filesystem::path dir, TxLogOptions opts, metrics::Registry* metrics)
+    : dir_(std::move(dir)), opts_(opts), metrics_(metrics) {
+    if (opts_.max_batch == 0) opts_.max_batch = 1;
+    if (opts_.max_open_files == 0) opts_.max_open_files = 1;
+    std::filesystem::create_directories(dir_);
+    if (opts_.layout == LogLayout::Segmented) {
+        store_ = std::make_unique<SegmentStore>(dir_, opts_.segments);
+        store_->import_logs(dir_); // switching over from per-user logs
+    }
+    worker_ = std::thread([this]() { run(); });
+}
+
+TxLogWriter::~TxLogWriter() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    work_cv_.notify_one();
+    worker_.join();
+    std::lock_guard<std::mutex> io(io_mu_);
+    close_files();
+}
+
+TxLogWriter::Ticket TxLogWriter::append(const std::string& username, const Transaction& tx, std::string_view counterparty) {
+    Ticket t;
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (queue_.empty()) oldest_ = std::chrono::steady_clock::now();
+        queue_.push_back(Record{username, tx, std::string(counterparty)});
+        t = ++appended_;
+        wake = queue_.size() == 1 || queue_.size() >= opts_.max_batch;
+    }
+    if (wake) work_cv_.notify_one();
+    return t;
+}
+
+TxLogWriter::Ticket TxLogWriter::append_all(std::vector<Record>& records) {
+    Ticket t;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (queue_.empty()) oldest_ = std::chrono::steady_clock::now();
+        queue_.insert(queue_.end(), std::make_move_iterator(records.begin()), std::make_move_iterator(records.end()));
+        appended_ += records.size();
+        t = appended_;
+    }
+    records.clear();
+    work_cv_.notify_one();
+    return t;
+}
+
+bool TxLogWriter::wait_durable(Ticket t) {
+    std::unique_lock<std::mutex> lk(mu_);
+    done_cv_.wait(lk, [&]() { return durable_ >= t || stop_ || !error_.empty(); });
+    return durable_ >= t;
+}
+
+bool TxLogWriter::flush() {
+    std::unique_lock<std::mutex> lk(mu_);
+    Ticket t = appended_;
+    if (durable_ >= t) return true;
+    if (flush_to_ < t) flush_to_ = t;
+    work_cv_.notify_one();
+    done_cv_.wait(lk, [&]() { return durable_ >= t || !error_.empty(); });
+    return durable_ >= t;
+}
+
+TxLogWriter::Ticket TxLogWriter::last_ticket() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return appended_;
+}
+
+std::string TxLogWriter::error() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return error_;
+}
+
+void TxLogWriter::run() {
+    std::vector<Record> batch;
+    std::unique_lock<std::mutex> lk(mu_);
+    while (true) {
+        work_cv_.wait(lk, [&]() { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) break; // stop requested and nothing left
+
+        // Let the batch fill up until it is large enough, old enough, or someone needs it now.
+        work_cv_.wait_until(lk, oldest_ + opts_.max_delay, [&]() {
+            return stop_ || queue_.size() >= opts_.max_batch || flush_to_ > durable_;
+        });
+
+        batch.swap(queue_);
+        Ticket last = appended_;
+        lk.unlock();
+        std::string err;
+        bool ok = write_batch(batch, err);
+        batch.clear();
+        lk.lock();
+        if (!ok && error_.empty()) error_ = err;
+        // Later batches are still written, but never acknowledged past the lost records.
+        if (error_.empty()) durable_ = last;
+        done_cv_.notify_all();
+    }
+}
+
+std::unique_lock<std::mutex> TxLogWriter::read_lock(const std::string& username) {
+    flush();
+    std::unique_lock<std::mutex> io(io_mu_);
+    history::sync_index(log_path(username), index_path(username));
+    return io;
+}
+
+std::size_t TxLogWriter::count(const std::string& username) {
+    if (store_) {
+        flush();
+        return store_->count(username);
+    }
+    auto io = read_lock(username);
+    return history::count(index_path(username));
+}
+
+std::size_t TxLogWriter::lower_bound(const std::string& username, std::int64_t key, bool upper) {
+    if (store_) {
+        flush();
+        return store_->lower_bound(username, key, upper);
+    }
+    auto io = read_lock(username);
+    return history::lower_bound(index_path(username), key, upper);
+}
+
+std::vector<Transaction> TxLogWriter::read(const std::string& username, std::size_t first, std::size_t limit,
+                                           const std::function<AccountId(std::string_view)>& resolve) {
+    if (store_) {
+        flush();
+        return store_->read(username, first, limit, resolve);
+    }
+    auto io = read_lock(username);
+    return history::read(log_path(username), index_path(username), first, limit, resolve);
+}
+
+std::size_t TxLogWriter::for_each_account(unsigned threads,
+                                          const std::function<void(const std::string&, const history::AccountStream&)>& fn) {
+    flush();
+    if (store_) return store_->for_each_account(threads, fn);
+    return history::for_each_log(dir_, threads, [&](const std::string& username, const std::filesystem::path& log) {
+        fn(username, [&](const history::RecordVisitor& visit) { return history::stream_log(log, visit); });
+    });
+}
+
+bool TxLogWriter::compact(std::string& err) {
+    if (!store_) { err = "The transaction log is not segmented."; return false; }
+    flush();
+    std::lock_guard<std::mutex> io(io_mu_); // one maintain() at a time: the writer's or this one
+    return maintain(true, err);
+}
+
+bool TxLogWriter::maintain(bool force, std::string& err) {
+    // Runs after every batch and usually does nothing, so only failures are counted.
+    bool ok = store_->maintain(force, err);
+    if (!ok && metrics_) metrics_->failure(metrics::Op::Compact, err);
+    return ok;
+}
+
+bool TxLogWriter::write_batch(std::vector<Record>& batch, std::string& err) {
+    std::lock_guard<std::mutex> io(io_mu_);
+    if (store_) {
+        try {
+            auto lk = store_->write_lock();
+            bool each = opts_.fsync == FsyncPolicy::PerTransaction;
+            for (const auto& p : batch) {
+                if (!store_->append(p.username, p.tx, p.counterparty, each)) {
+                    err = "Cannot write the active log segment.";
+                    return false;
+                }
+            }
+            if (!store_->commit(opts_.fsync == FsyncPolicy::PerBatch)) {
+                err = "Cannot flush the active log segment to disk.";
+                return false;
+            }
+        } catch (const std::exception& e) {
+            err = e.what();
+            return false;
+        }
+        // A failed rollover or compaction leaves the segments as they are; the next batch retries,
+        // and the failure shows up in the metrics (op "compact").
+        std::string maintain_err;
+        maintain(false, maintain_err);
+        return true;
+    }
+    // Keep going after a failure so one bad file does not cost the other accounts their records;
+    // the batch as a whole still fails.
+    bool ok = true;
+    auto fail = [&](std::string reason) {
+        if (ok) err = std::move(reason);
+        ok = false;
+    };
+    for (const auto& p : batch) {
+        std::string open_err;
+        if (files_.size() >= opts_.max_open_files && !files_.count(p.username)) {
+            // file_for() is about to close the cached files; flush what this batch wrote first.
+            if (!sync_touched(open_err)) fail(open_err);
+        }
+        OpenLog* f = file_for(p.username, open_err);
+        if (!f) { fail(open_err); continue; }
+        const Transaction& tx = p.tx;
+        line_.clear();
+        append_transaction_line(line_, tx, p.counterparty);
+        history::IndexEntry entry{f->size, tx.timestamp};
+        if (std::fwrite(line_.data(), 1, line_.size(), f->log) != line_.size() ||
+            (opts_.fsync == FsyncPolicy::PerTransaction && !utils::fsync_file(f->log))) {
+            // The file may end in part of a line now; reopen it (and re-sync its index) next time.
+            fail("Cannot write " + log_path(p.username).string() + ".");
+            drop_file(p.username);
+            continue;
+        }
+        // The index is derived data: a lost entry is rebuilt from the log by history::sync_index.
+        if (std::fwrite(&entry, sizeof(entry), 1, f->idx) != 1) {
+            drop_file(p.username);
+            continue;
+        }
+        f->size += line_.size();
+        touched_.insert(f);
+    }
+    std::string sync_err;
+    if (!sync_touched(sync_err)) fail(sync_err);
+    return ok;
+}
+
+bool TxLogWriter::sync_touched(std::string& err) {
+    // Log before index, so an index entry never reaches the file ahead of its line.
+    // The index is derived data (history::sync_index rebuilds it), so it is never fsynced.
+    bool ok = true;
+    for (OpenLog* f : touched_) {
+        bool synced = opts_.fsync == FsyncPolicy::PerBatch ? utils::fsync_file(f->log) : std::fflush(f->log) == 0;
+        if (!synced && ok) {
+            err = "Cannot flush a transaction log to disk.";
+            ok = false;
+        }
+        std::fflush(f->idx);
+    }
+    touched_.clear();
+    return ok;
+}
+
+void TxLogWriter::drop_file(const std::string& username) {
+    auto it = files_.find(username);
+    if (it == files_.end()) return;
+    touched_.erase(&it->second);
+    std::fclose(it->second.log);
+    std::fclose(it->second.idx);
+    files_.erase(it);
+}
+
+TxLogWriter::OpenLog* TxLogWriter::file_for(const std::string& username, std::string& err) {
+    auto it = files_.find(username);
+    if (it != files_.end()) return &it->second;
+    if (files_.size() >= opts_.max_open_files) close_files();
+    std::filesystem::create_directories(dir_);
+    std::filesystem::path log = log_path(username);
+    std::filesystem::path idx = index_path(username);
+    history::sync_index(log, idx);
+
+    OpenLog f;
+    f.log = std::fopen(log.string().c_str(), "ab");
+    if (!f.log) { err = "Cannot open " + log.string() + "."; return nullptr; }
+    f.idx = std::fopen(idx.string().c_str(), "ab");
+    if (!f.idx) { std::fclose(f.log); err = "Cannot open " + idx.string() + "."; return nullptr; }
+    std::error_code ec;
+    f.size = std::filesystem::file_size(log, ec);
+    return &files_.emplace(username, f).first->second;
+}
+
+void TxLogWriter::close_files() {
+    std::string err;
+    sync_touched(err);
+    for (auto& kv : files_) {
+        std::fclose(kv.second.log);
+        std::fclose(kv.second.idx);
+    }
+    files_.clear();
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <filesystem>
+#include <system_error>
+
+// Minimal checks for the programs under tests/ (no framework): a failed CHECK prints the
+// expression and its location and the run continues; main returns test::result().
+namespace test {
+
+inline int& failures() {
+    static int n = 0;
+    return n;
+}
+
+inline int result() {
+    if (failures() > 0) std::cerr << failures() << " check(s) failed\n";
+    return failures() > 0 ? 1 : 0;
+}
+
+// An empty directory under the system temp directory, removed again on destruction.
+class TempDir {
+public:
+    explicit TempDir(const std::string& name) : path_(std::filesystem::temp_directory_path() / ("bank_test_" + name)) {
+        std::filesystem::remove_all(path_);
+        std::filesystem::create_directories(path_);
+    }
+    ~TempDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(path_, ec);
+    }
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    const std::filesystem::path& path() const { return path_; }
+
+private:
+    std::filesystem::path path_;
+};
+
+} // namespace test
+
+#define CHECK(cond)                                                                              \
+    do {                                                                                         \
+        if (!(cond)) {                                                                           \
+            ++test::failures();                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n";           \
+        }                                                                                        \
+    } while (0)
@@ -0,0 +1,107 @@
+// SegmentStore archives: records written to segments, compacted into LZ-compressed archives and
+// read back through the archive reader, before and after reopening the store.
+#include "segment_store.hpp"
+#include "check.hpp"
+
+#include <map>
+#include <vector>
+
+namespace {
+
+AccountId no_id(std::string_view) { return kNoAccount; }
+
+bool same(const Transaction& a, const Transaction& b) {
+    return a.timestamp == b.timestamp && a.type == b.type && a.amount == b.amount && a.balance_after == b.balance_after;
+}
+
+// Every record of every account, read back from the store.
+bool matches(const SegmentStore& store, const std::map<std::string, std::vector<Transaction>>& written) {
+    bool ok = true;
+    for (const auto& [user, txs] : written) {
+        ok &= store.count(user) == txs.size();
+        std::vector<Transaction> back = store.read(user, 0, SIZE_MAX, no_id);
+        ok &= back.size() == txs.size();
+        for (std::size_t i = 0; ok && i < txs.size(); ++i) ok &= same(back[i], txs[i]);
+        // A page from the middle, across archive and segment boundaries.
+        std::vector<Transaction> page = store.read(user, txs.size() / 3, 7, no_id);
+        ok &= page.size() == 7 && same(page[0], txs[txs.size() / 3]);
+    }
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    test::TempDir dir("archive");
+    SegmentOptions opts;
+    opts.max_segment_bytes = 4096; // many small segments
+    opts.hot_segments = 1;
+    opts.archive_batch = 2;
+    opts.block_bytes = 4096;       // several blocks per archive
+
+    std::map<std::string, std::vector<Transaction>> written;
+    const std::vector<std::string> users = {"alice", "bob", "carol"};
+    {
+        SegmentStore store(dir.path(), opts);
+        std::map<std::string, Money> balance;
+        for (int i = 0; i < 600; ++i) {
+            const std::string& user = users[static_cast<std::size_t>(i) % users.size()];
+            Money& bal = balance[user];
+            Money amount = Money::from_cents(100 + i);
+            Money::add(bal, amount, bal);
+            Transaction tx{timestamp::next(), TxType::Deposit, amount, bal}; // recent: no age rollover
+            {
+                auto lk = store.write_lock();
+                CHECK(store.append(user, tx, {}, false));
+                CHECK(store.commit(false));
+            }
+            std::string err;
+            CHECK(store.maintain(false, err));
+            written[user].push_back(tx);
+        }
+        std::string err;
+        CHECK(store.maintain(true, err));
+        SegmentStore::Stats st = store.stats();
+        CHECK(st.archives > 0);
+        CHECK(st.archive_bytes < st.archive_raw_bytes); // compressed
+        CHECK(matches(store, written));
+
+        // Summaries cover the archived runs: counts add up and balances chain.
+        std::vector<SegmentStore::Summary> sums = store.summaries("alice");
+        CHECK(!sums.empty());
+        std::size_t archived = 0;
+        for (std::size_t i = 0; i < sums.size(); ++i) {
+            archived += sums[i].count;
+            if (i > 0) CHECK(sums[i].opening == sums[i - 1].closing);
+            CHECK(sums[i].first_ts <= sums[i].last_ts);
+        }
+        CHECK(archived > 0 && archived <= written["alice"].size());
+        CHECK(sums.front().opening == Money());
+        CHECK(sums.front().first_ts == written["alice"].front().timestamp);
+
+        // Time lookups, inside archives and past them.
+        const auto& alice = written["alice"];
+        CHECK(store.lower_bound("alice", alice[10].timestamp) == 10);
+        CHECK(store.lower_bound("alice", alice[10].timestamp, true) == 11);
+        CHECK(store.lower_bound("alice", alice[10].timestamp + 1) == 11);
+        CHECK(store.lower_bound("alice", alice.back().timestamp) == alice.size() - 1);
+        CHECK(store.lower_bound("alice", 0) == 0);
+        CHECK(store.lower_bound("alice", INT64_MAX) == alice.size());
+    }
+    {
+        // Reopened from disk: the same records through the archive reader.
+        SegmentStore store(dir.path(), opts);
+        CHECK(matches(store, written));
+        std::size_t streamed = 0;
+        store.for_each_account(2, [&](const std::string& user, const history::AccountStream& stream) {
+            std::size_t i = 0;
+            bool ok = true;
+            stream([&](const Transaction& tx, std::string_view) { ok &= i < written[user].size() && same(tx, written[user][i++]); });
+            CHECK(ok && i == written[user].size());
+            streamed += i;
+        });
+        CHECK(streamed == 600);
+    }
+
+    return test::result();
+}
@@ -0,0 +1,103 @@
+// CSV import and export: quoted fields, every rejection message, and a round trip.
+#include "bank.hpp"
+#include "bulk.hpp"
+#include "check.hpp"
+
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+void write(const std::filesystem::path& file, const std::string& text) {
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+BankOptions options(const std::filesystem::path& dir) {
+    BankOptions opts;
+    opts.data_dir = dir;
+    return opts;
+}
+
+} // namespace
+
+int main() {
+    test::TempDir dir("bulk");
+    const std::filesystem::path csv = dir.path() / "accounts.csv";
+
+    {
+        Bank bank(options(dir.path() / "data"));
+        bank.load();
+        write(csv,
+              "username,password,initial_balance\n"
+              "alice,pass1,10.00\n"                 // 2: plain
+              "\"bob\",\"pa,ss\"\"word\",5.00\n"    // 3: quoted, with a comma and an escaped quote
+              "carol,\"pass3\"\n"                   // 4: quoted last field, no balance
+              "\n"                                  // 5: blank, skipped
+              "dave,\"pass4\r\n"                    // 6
+              "erin,\"pass5\"x,1.00\n"              // 7
+              "frank\n"                             // 8
+              "gina,pass7,1.00,extra\n"             // 9
+              "ab,pass8\n"                          // 10
+              "bad/name,pass9\n"                    // 11
+              "hank,abc\n"                          // 12
+              "ivan,pass10,12.3.4\n"                // 13
+              "jane,pass11,-1.00\n"                 // 14
+              "alice,pass12,1.00\n"                 // 15
+              "admin,pass13\n");                    // 16
+        std::ostringstream errors;
+        bulk::ImportStats st = bulk::import_csv(bank, csv, bulk::ImportOptions{}, errors);
+        CHECK(st.imported == 3);
+        CHECK(st.rejected == 11);
+        CHECK(errors.str() ==
+              "line 6: Unterminated quoted field.\n"
+              "line 7: Unexpected text after a quoted field.\n"
+              "line 8: Expected 2 or 3 fields, found 1.\n"
+              "line 9: Expected 2 or 3 fields, found 4.\n"
+              "line 10: Username must be at least 3 characters.\n"
+              "line 11: Username may not contain '/'.\n"
+              "line 12: Password must be at least 4 characters.\n"
+              "line 13: Invalid balance '12.3.4'.\n"
+              "line 14: Initial balance cannot be negative.\n"
+              "line 15: Duplicate username (first on line 2).\n"
+              "line 16: Username already exists.\n");
+
+        CHECK(bank.balance_of("alice") == Money::from_cents(1000));
+        CHECK(bank.balance_of("bob") == Money::from_cents(500));
+        CHECK(bank.balance_of("carol") == Money());
+        CHECK(bank.authenticate("bob", "pa,ss\"word").has_value());
+        CHECK(bank.authenticate("carol", "pass3").has_value());
+        CHECK(!bank.balance_of("dave").has_value());
+
+        // Export writes the hashed form, which imports into another bank unchanged.
+        std::ostringstream out;
+        bulk::ExportStats ex = bulk::export_csv(bank, out, 2);
+        CHECK(ex.rows == 4); // admin included
+        CHECK(out.str().compare(0, 33, "username,password_sha256,balance\n") == 0);
+        write(csv, out.str());
+    }
+    {
+        Bank copy(options(dir.path() / "copy"));
+        copy.load();
+        std::ostringstream errors;
+        bulk::ImportStats st = bulk::import_csv(copy, csv, bulk::ImportOptions{}, errors);
+        CHECK(st.imported == 3); // everyone but admin, who already exists
+        CHECK(errors.str().find("Username already exists.") != std::string::npos);
+        CHECK(copy.authenticate("bob", "pa,ss\"word").has_value());
+        CHECK(copy.balance_of("alice") == Money::from_cents(1000));
+    }
+
+    // A username from before the rules existed is quoted on export.
+    {
+        std::filesystem::path data = dir.path() / "legacy";
+        std::filesystem::create_directories(data);
+        write(data / "accounts.db", "old,\"name|" + std::string(64, '0') + "|1.00\n");
+        Bank bank(options(data));
+        bank.load();
+        std::ostringstream out;
+        bulk::export_csv(bank, out, 1);
+        CHECK(out.str().find("\"old,\"\"name\"," + std::string(64, '0') + ",1.00\n") != std::string::npos);
+    }
+
+    return test::result();
+}
@@ -0,0 +1,110 @@
+// Journal recovery: torn last lines, groups cut short, and appends after either.
+#include "journal.hpp"
+#include "check.hpp"
+
+#include <fstream>
+#include <vector>
+
+namespace {
+
+struct Seen {
+    std::vector<std::string> users;
+    std::vector<Money> balances;
+};
+
+Seen replay(const std::filesystem::path& file, std::uintmax_t* complete = nullptr) {
+    Seen seen;
+    Journal::replay(file, [&](std::string&& user, std::string&&, Money balance) {
+        seen.users.push_back(std::move(user));
+        seen.balances.push_back(balance);
+    }, complete);
+    return seen;
+}
+
+void write(const std::filesystem::path& file, const std::string& text) {
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+std::string read(const std::filesystem::path& file) {
+    std::ifstream in(file, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+int main() {
+    test::TempDir dir("journal");
+    const std::filesystem::path file = dir.path() / "accounts.journal";
+    const std::string complete = "A|alice|h1|10.00\nA|bob|h2|5.00\n";
+
+    // A clean file replays whole and has no tail.
+    write(file, complete);
+    std::uintmax_t bytes = 0;
+    Seen seen = replay(file, &bytes);
+    CHECK(seen.users == (std::vector<std::string>{"alice", "bob"}));
+    CHECK(bytes == complete.size());
+
+    // A torn last line is skipped and reported.
+    write(file, complete + "A|carol|h3|7");
+    seen = replay(file, &bytes);
+    CHECK(seen.users.size() == 2);
+    CHECK(bytes == complete.size());
+
+    // So is a group cut short, even though each of its lines is complete.
+    const std::string group = "B|2\nA|alice|h1|9.00\nA|bob|h2|6.00\n";
+    write(file, complete + group + "B|3\nA|alice|h1|1.00\nA|bob|h2|14.00\n");
+    seen = replay(file, &bytes);
+    CHECK(seen.users.size() == 4);
+    CHECK(seen.balances.size() == 4 && seen.balances[2] == Money::from_cents(900) && seen.balances[3] == Money::from_cents(600));
+    CHECK(bytes == complete.size() + group.size());
+
+    // A group header with nothing after it.
+    write(file, complete + "B|2\n");
+    seen = replay(file, &bytes);
+    CHECK(seen.users.size() == 2 && bytes == complete.size());
+
+    // Windows line endings replay the same, and the offsets count the '\r'.
+    write(file, "A|alice|h1|10.00\r\nA|bob|h2|5.00\r\n");
+    seen = replay(file, &bytes);
+    CHECK(seen.users.size() == 2 && seen.balances[1] == Money::from_cents(500));
+    CHECK(bytes == std::filesystem::file_size(file));
+
+    // truncate_torn_tail cuts exactly the tail; a clean file is left alone.
+    write(file, complete + "B|2\nA|alice|h1|9.00\nA|bo");
+    Journal::truncate_torn_tail(file);
+    CHECK(read(file) == complete);
+    Journal::truncate_torn_tail(file);
+    CHECK(read(file) == complete);
+
+    // Opening a journal with a torn tail drops it, so the next record gets its own line.
+    write(file, complete + "A|carol|h3|7");
+    {
+        Journal journal(file);
+        journal.open();
+        journal.append("dave", "h4", Money::from_cents(300));
+        CHECK(journal.flush());
+        journal.close();
+    }
+    CHECK(read(file) == complete + "A|dave|h4|3.00\n");
+    seen = replay(file);
+    CHECK(seen.users == (std::vector<std::string>{"alice", "bob", "dave"}));
+
+    // Rotating onto a leftover .old file with a torn tail keeps both files' complete records.
+    const std::filesystem::path old = file.string() + ".old";
+    write(old, "A|erin|h5|1.00\nB|2\nA|erin|h5|2.00\n");
+    {
+        Journal journal(file);
+        journal.open();
+        journal.rotate();
+        journal.append("frank", "h6", Money::from_cents(100));
+        CHECK(journal.flush());
+        journal.close();
+    }
+    seen = replay(old);
+    CHECK(seen.users == (std::vector<std::string>{"erin", "alice", "bob", "dave"}));
+    seen = replay(file);
+    CHECK(seen.users == (std::vector<std::string>{"frank"}));
+
+    return test::result();
+}
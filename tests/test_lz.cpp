@@ -0,0 +1,56 @@
+// lz::compress / lz::decompress round trips and malformed input.
+#include "lz.hpp"
+#include "check.hpp"
+
+#include <random>
+
+namespace {
+
+bool round_trip(const std::string& raw) {
+    std::string packed, back;
+    lz::compress(raw, packed);
+    return lz::decompress(packed, raw.size(), back) && back == raw;
+}
+
+} // namespace
+
+int main() {
+    CHECK(round_trip(""));
+    CHECK(round_trip("a"));
+    CHECK(round_trip("abc"));
+    CHECK(round_trip(std::string(100000, 'x'))); // long match, extended length bytes
+
+    // Log-like text: many repeats at short and long distances.
+    std::string log;
+    for (int i = 0; i < 5000; ++i) {
+        log += "2025-01-31T09:15:" + std::to_string(10 + i % 50) + ".000123|DEPOSIT|" + std::to_string(i) + ".00|";
+        log += std::to_string(i * 3) + ".50|Cash deposit\n";
+    }
+    CHECK(round_trip(log));
+    std::string packed;
+    lz::compress(log, packed);
+    CHECK(packed.size() < log.size() / 2);
+
+    // Incompressible bytes, including every byte value.
+    std::mt19937 rng(42);
+    std::string noise(70000, '\0');
+    for (char& c : noise) c = static_cast<char>(rng());
+    CHECK(round_trip(noise));
+
+    // compress appends; earlier output is kept.
+    std::string out = "prefix";
+    lz::compress("hello hello hello hello", out);
+    CHECK(out.compare(0, 6, "prefix") == 0);
+    std::string back;
+    CHECK(lz::decompress(std::string_view(out).substr(6), 23, back) && back == "hello hello hello hello");
+
+    // Malformed input: a wrong size, a truncated block, a match before the start.
+    packed.clear();
+    lz::compress(log, packed);
+    CHECK(!lz::decompress(packed, log.size() + 1, back));
+    CHECK(!lz::decompress(std::string_view(packed).substr(0, packed.size() / 2), log.size(), back));
+    const char bad_offset[] = {0x10, 'a', 0x10, 0x00}; // one literal, then a match 16 bytes back
+    CHECK(!lz::decompress(std::string_view(bad_offset, sizeof(bad_offset)), 5, back));
+
+    return test::result();
+}
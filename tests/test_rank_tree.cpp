@@ -0,0 +1,94 @@
+// RankTree: insert, erase, count_below (rank) and cursors against a sorted reference.
+#include "rank_tree.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Slots ordered by an external key, ties broken by slot, as Bank orders accounts by balance.
+struct Keys {
+    std::vector<int> key;
+    bool operator()(std::uint32_t a, std::uint32_t b) const { return key[a] != key[b] ? key[a] < key[b] : a < b; }
+};
+
+std::vector<std::uint32_t> in_order(const RankTree& tree) {
+    std::vector<std::uint32_t> out;
+    for (auto c = tree.first(); c.valid(); c.next()) out.push_back(c.slot());
+    return out;
+}
+
+} // namespace
+
+int main() {
+    RankTree tree;
+    CHECK(tree.size() == 0);
+    CHECK(!tree.first().valid());
+    CHECK(tree.count_below([](std::uint32_t) { return true; }) == 0);
+
+    constexpr std::uint32_t n = 2000;
+    Keys less;
+    std::mt19937 rng(7);
+    for (std::uint32_t i = 0; i < n; ++i) less.key.push_back(static_cast<int>(rng() % 500)); // many ties
+
+    std::vector<std::uint32_t> order(n);
+    for (std::uint32_t i = 0; i < n; ++i) order[i] = i;
+    std::shuffle(order.begin(), order.end(), rng);
+    for (std::uint32_t slot : order) tree.insert(slot, less);
+    CHECK(tree.size() == n);
+
+    std::vector<std::uint32_t> sorted(order);
+    std::sort(sorted.begin(), sorted.end(), less);
+    CHECK(in_order(tree) == sorted);
+
+    // Rank: slots with key < k, for every k.
+    bool ranks_ok = true;
+    for (int k = 0; k <= 500; k += 7) {
+        std::size_t expect = static_cast<std::size_t>(std::count_if(sorted.begin(), sorted.end(),
+                                                                    [&](std::uint32_t s) { return less.key[s] < k; }));
+        ranks_ok &= tree.count_below([&](std::uint32_t v) { return less.key[v] < k; }) == expect;
+    }
+    CHECK(ranks_ok);
+
+    // lower_bound / last_below land on the edges of a key range.
+    auto lo = tree.lower_bound([&](std::uint32_t v) { return less.key[v] < 250; });
+    auto it = std::find_if(sorted.begin(), sorted.end(), [&](std::uint32_t s) { return less.key[s] >= 250; });
+    CHECK(lo.valid() && it != sorted.end() && lo.slot() == *it);
+    auto hi = tree.last_below([&](std::uint32_t v) { return less.key[v] < 250; });
+    CHECK(hi.valid() && it != sorted.begin() && hi.slot() == *(it - 1));
+    hi.next();
+    CHECK(hi.valid() && hi.slot() == *it);
+    CHECK(tree.last().valid() && tree.last().slot() == sorted.back());
+    auto back = tree.last();
+    back.prev();
+    CHECK(back.valid() && back.slot() == sorted[n - 2]);
+
+    // Erase every other slot, then re-key some of them and insert them again.
+    for (std::uint32_t s = 0; s < n; s += 2) tree.erase(s, less);
+    CHECK(tree.size() == n / 2);
+    sorted.erase(std::remove_if(sorted.begin(), sorted.end(), [](std::uint32_t s) { return s % 2 == 0; }), sorted.end());
+    CHECK(in_order(tree) == sorted);
+
+    for (std::uint32_t s = 0; s < n; s += 4) {
+        less.key[s] = 1000 + static_cast<int>(s); // past every other key
+        tree.insert(s, less);
+        sorted.push_back(s);
+    }
+    std::sort(sorted.begin(), sorted.end(), less);
+    CHECK(tree.size() == sorted.size());
+    CHECK(in_order(tree) == sorted);
+    CHECK(tree.count_below([&](std::uint32_t v) { return less.key[v] < 1000; }) == n / 2);
+
+    // Erasing the last slot empties the tree.
+    RankTree one;
+    one.insert(5, less);
+    CHECK(one.size() == 1 && one.first().slot() == 5);
+    one.erase(5, less);
+    CHECK(one.size() == 0 && !one.first().valid());
+
+    tree.clear();
+    CHECK(tree.size() == 0);
+    return test::result();
+}
@@ -0,0 +1,88 @@
+// picosha2::hash256_batch: every kernel this CPU has must agree with the one-shot hash256,
+// for messages around the padding boundaries and batches that leave SIMD lanes idle.
+#include "sha256.hpp"
+#include "check.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using picosha2::batch_kernel;
+using picosha2::byte_t;
+
+// Lengths that put the 0x80 byte and the 64-bit length in the same or the next block.
+const std::size_t kLengths[] = {0, 1, 55, 56, 63, 64, 119, 120};
+
+std::vector<batch_kernel> available_kernels() {
+    std::vector<batch_kernel> kernels{batch_kernel::scalar};
+#ifdef PICOSHA2_X86
+    if (picosha2::detail::cpu_has_sse2()) kernels.push_back(batch_kernel::sse2);
+    if (picosha2::detail::cpu_has_avx2()) kernels.push_back(batch_kernel::avx2);
+#endif
+    return kernels;
+}
+
+const char* kernel_name(batch_kernel k) {
+    switch (k) {
+        case batch_kernel::scalar: return "scalar";
+        case batch_kernel::sse2: return "sse2";
+        case batch_kernel::avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+// n messages cycling through kLengths, each with its own content.
+std::vector<std::string> messages(std::size_t n, std::size_t shift) {
+    std::vector<std::string> out;
+    for (std::size_t i = 0; i < n; ++i) {
+        std::string m(kLengths[(i + shift) % (sizeof(kLengths) / sizeof(kLengths[0]))], '\0');
+        for (std::size_t j = 0; j < m.size(); ++j) m[j] = static_cast<char>('a' + (i * 7 + j) % 26);
+        out.push_back(std::move(m));
+    }
+    return out;
+}
+
+bool batch_matches(batch_kernel kernel, const std::vector<std::string>& msgs) {
+    std::vector<std::string_view> views(msgs.begin(), msgs.end());
+    std::vector<byte_t> got(32 * msgs.size());
+    picosha2::hash256_batch(views.data(), views.size(), got.data(), kernel);
+    for (std::size_t i = 0; i < msgs.size(); ++i) {
+        byte_t want[32];
+        picosha2::hash256(msgs[i].data(), msgs[i].size(), want);
+        if (std::memcmp(want, &got[32 * i], 32) != 0) {
+            std::cerr << kernel_name(kernel) << ": message " << i << " of " << msgs.size() << " (length "
+                      << msgs[i].size() << ") differs\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    // Known answers for the reference itself.
+    CHECK(picosha2::hash256_hex_string(std::string()) ==
+          "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    CHECK(picosha2::hash256_hex_string(std::string("abc")) ==
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    // Batch sizes around and between the 4- and 8-lane widths.
+    const std::size_t sizes[] = {1, 3, 5, 7, 9, 13, 17, 23};
+    for (batch_kernel kernel : available_kernels()) {
+        for (std::size_t n : sizes) {
+            for (std::size_t shift = 0; shift < sizeof(kLengths) / sizeof(kLengths[0]); ++shift) {
+                CHECK(batch_matches(kernel, messages(n, shift)));
+            }
+        }
+
+        // The hex wrapper splits long batches into groups of 8.
+        std::vector<std::string> msgs = messages(11, 0);
+        std::vector<std::string_view> views(msgs.begin(), msgs.end());
+        std::vector<std::string> hex(msgs.size());
+        picosha2::hash256_hex_batch(views.data(), views.size(), hex.data(), kernel);
+        for (std::size_t i = 0; i < msgs.size(); ++i) CHECK(hex[i] == picosha2::hash256_hex_string(msgs[i]));
+    }
+    return test::result();
+}
@@ -0,0 +1,259 @@
+// Hot-path benchmarks for Bank: ops/sec and latency percentiles per operation, as JSON.
+//
+// Usage: bank_bench [--accounts N] [--ops N] [--history N] [--history-accounts N]
+//                   [--storage journal|snapshot] [--snapshot-format text|binary] [--async]
+//                   [--dir path] [--label text] [--out file.json] [--keep]
+//
+// A synthetic dataset of N accounts (plus --history deposits on each of the first
+// --history-accounts accounts) is built in a temp data directory, then each operation
+// is timed one call at a time.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <cstdlib>
+
+#include "bank.hpp"
+
+namespace {
+
+struct Config {
+    std::size_t accounts = 10000;
+    std::size_t ops = 10000;
+    std::size_t history = 0;
+    std::size_t history_accounts = 100;
+    StorageMode storage = StorageMode::Journal;
+    SnapshotFormat format = SnapshotFormat::Text;
+    bool async = false;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "bank_bench";
+    std::string label;
+    std::string out;
+    bool keep = false;
+};
+
+struct Result {
+    std::string name;
+    std::size_t iterations = 0;
+    double seconds = 0;
+    std::vector<double> latency_us; // sorted
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Calls op(i) for i in [0, n), timing each call.
+Result measure(const std::string& name, std::size_t n, const std::function<void(std::size_t)>& op) {
+    Result r;
+    r.name = name;
+    r.iterations = n;
+    r.latency_us.reserve(n);
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < n; ++i) {
+        auto t0 = Clock::now();
+        op(i);
+        r.latency_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0).count());
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::sort(r.latency_us.begin(), r.latency_us.end());
+    return r;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    auto i = static_cast<std::size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if (static_cast<unsigned char>(c) < 0x20) out += ' ';
+        else out += c;
+    }
+    return out;
+}
+
+void write_json(std::ostream& os, const Config& cfg, std::size_t table_bytes, const std::vector<Result>& results) {
+    os << "{\n  \"config\": {"
+       << "\"label\": \"" << json_escape(cfg.label) << "\", "
+       << "\"accounts\": " << cfg.accounts << ", "
+       << "\"ops\": " << cfg.ops << ", "
+       << "\"history\": " << cfg.history << ", "
+       << "\"history_accounts\": " << cfg.history_accounts << ", "
+       << "\"storage\": \"" << (cfg.storage == StorageMode::Journal ? "journal" : "snapshot") << "\", "
+       << "\"snapshot_format\": \"" << (cfg.format == SnapshotFormat::Binary ? "binary" : "text") << "\", "
+       << "\"async\": " << (cfg.async ? "true" : "false") << "},\n"
+       << "  \"memory\": {\"table_bytes\": " << table_bytes << ", \"table_bytes_per_account\": "
+       << static_cast<double>(table_bytes) / static_cast<double>(cfg.accounts) << "},\n"
+       << "  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        double mean = 0;
+        for (double v : r.latency_us) mean += v;
+        if (!r.latency_us.empty()) mean /= static_cast<double>(r.latency_us.size());
+        os << "    {\"name\": \"" << r.name << "\", "
+           << "\"iterations\": " << r.iterations << ", "
+           << "\"seconds\": " << r.seconds << ", "
+           << "\"ops_per_sec\": " << (r.seconds > 0 ? static_cast<double>(r.iterations) / r.seconds : 0) << ", "
+           << "\"mean_us\": " << mean << ", "
+           << "\"p50_us\": " << percentile(r.latency_us, 50) << ", "
+           << "\"p90_us\": " << percentile(r.latency_us, 90) << ", "
+           << "\"p99_us\": " << percentile(r.latency_us, 99) << ", "
+           << "\"p999_us\": " << percentile(r.latency_us, 99.9) << ", "
+           << "\"max_us\": " << (r.latency_us.empty() ? 0 : r.latency_us.back()) << "}"
+           << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+void usage() {
+    std::cerr << "Usage: bank_bench [--accounts N] [--ops N] [--history N] [--history-accounts N]\n"
+                 "                  [--storage journal|snapshot] [--snapshot-format text|binary] [--async]\n"
+                 "                  [--dir path] [--label text] [--out file.json] [--keep]\n";
+}
+
+bool parse_args(int argc, char** argv, Config& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--accounts" && has_value) cfg.accounts = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--ops" && has_value) cfg.ops = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--history" && has_value) cfg.history = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--history-accounts" && has_value) cfg.history_accounts = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--dir" && has_value) cfg.dir = argv[++i];
+        else if (arg == "--label" && has_value) cfg.label = argv[++i];
+        else if (arg == "--out" && has_value) cfg.out = argv[++i];
+        else if (arg == "--keep") cfg.keep = true;
+        else if (arg == "--async") cfg.async = true;
+        else if (arg == "--storage" && has_value) {
+            std::string v = argv[++i];
+            if (v == "journal") cfg.storage = StorageMode::Journal;
+            else if (v == "snapshot") cfg.storage = StorageMode::Snapshot;
+            else return false;
+        } else if (arg == "--snapshot-format" && has_value) {
+            std::string v = argv[++i];
+            if (v == "text") cfg.format = SnapshotFormat::Text;
+            else if (v == "binary") cfg.format = SnapshotFormat::Binary;
+            else return false;
+        } else {
+            return false;
+        }
+    }
+    return cfg.accounts >= 2 && cfg.ops > 0;
+}
+
+std::string user(std::size_t i) { return "user" + std::to_string(i); }
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Config cfg;
+    if (!parse_args(argc, argv, cfg)) { usage(); return 1; }
+
+    std::filesystem::remove_all(cfg.dir);
+    BankOptions opts;
+    opts.data_dir = cfg.dir;
+    opts.storage = cfg.storage;
+    opts.snapshot_format = cfg.format;
+    opts.async_persistence = cfg.async;
+
+    std::vector<Result> results;
+    std::size_t table_bytes = 0;
+    std::string err;
+    auto check = [&](bool ok) {
+        if (!ok) { std::cerr << "bank_bench: " << err << "\n"; std::exit(1); }
+    };
+    const Money seed_balance = Money::from_cents(100000000);
+    const std::string password = "bench-password";
+
+    {
+        Bank bank(opts);
+        bank.load();
+
+        // Dataset: bulk-created with persistence deferred, so seeding stays out of the numbers.
+        std::cerr << "seeding " << cfg.accounts << " accounts...\n";
+        bank.set_deferred(true);
+        for (std::size_t i = 0; i < cfg.accounts; ++i) check(bank.create_account(user(i), password, seed_balance, err));
+        std::size_t hist_accounts = std::min(cfg.history_accounts, cfg.accounts);
+        for (std::size_t h = 0; h < cfg.history; ++h) {
+            for (std::size_t i = 0; i < hist_accounts; ++i) check(bank.deposit(user(i), Money::from_cents(1), err));
+        }
+        bank.commit();
+        bank.set_deferred(false);
+        table_bytes = bank.memory_bytes();
+
+        std::mt19937_64 rng(42);
+        std::vector<std::size_t> picks(cfg.ops * 2);
+        for (auto& p : picks) p = rng() % cfg.accounts;
+        const Money cent = Money::from_cents(1);
+
+        results.push_back(measure("create_account", cfg.ops, [&](std::size_t i) {
+            check(bank.create_account("new" + std::to_string(i), password, Money(), err));
+        }));
+        results.push_back(measure("deposit", cfg.ops, [&](std::size_t i) {
+            check(bank.deposit(user(picks[i]), cent, err));
+        }));
+        results.push_back(measure("withdraw", cfg.ops, [&](std::size_t i) {
+            check(bank.withdraw(user(picks[i]), cent, err));
+        }));
+        results.push_back(measure("transfer", cfg.ops, [&](std::size_t i) {
+            std::size_t a = picks[i], b = picks[cfg.ops + i];
+            if (a == b) b = (b + 1) % cfg.accounts;
+            check(bank.transfer(user(a), user(b), cent, err));
+        }));
+        // 100 transfer legs per call, committed as one unit; compare with 100 x "transfer".
+        std::vector<Posting> postings(100);
+        results.push_back(measure("apply_batch_100", std::max<std::size_t>(1, cfg.ops / 100), [&](std::size_t i) {
+            for (std::size_t k = 0; k < postings.size(); ++k) {
+                std::size_t a = picks[(i * 100 + k) % cfg.ops], b = picks[cfg.ops + (i * 100 + k) % cfg.ops];
+                if (a == b) b = (b + 1) % cfg.accounts;
+                postings[k] = Posting{user(a), user(b), cent};
+            }
+            std::vector<PostingResult> legs;
+            check(bank.apply_batch(postings, legs, err));
+        }));
+        results.push_back(measure("authenticate", cfg.ops, [&](std::size_t i) {
+            err = "authentication failed";
+            check(bank.authenticate(user(picks[i]), password).has_value());
+        }));
+        std::size_t scans = std::max<std::size_t>(3, std::min<std::size_t>(cfg.ops, 1000000 / cfg.accounts));
+        results.push_back(measure("all_accounts", scans, [&](std::size_t) {
+            if (bank.all_accounts().size() < cfg.accounts) { err = "all_accounts lost accounts"; check(false); }
+        }));
+        // One durability wait per call: the cost a caller pays when it needs the write confirmed.
+        results.push_back(measure("deposit_durable", std::max<std::size_t>(1, cfg.ops / 10), [&](std::size_t i) {
+            check(bank.deposit(user(picks[i]), cent, err));
+            bank.wait_persisted(bank.last_persist_ticket());
+        }));
+        results.push_back(measure("save", 3, [&](std::size_t) { bank.save(); }));
+        bank.flush_logs();
+    }
+
+    results.push_back(measure("load", 3, [&](std::size_t) {
+        Bank bank(opts);
+        bank.load();
+    }));
+
+    std::vector<std::string> secrets(cfg.ops * 10);
+    for (std::size_t i = 0; i < secrets.size(); ++i) secrets[i] = "password-" + std::to_string(i);
+    results.push_back(measure("hash256_hex_string", secrets.size(), [&](std::size_t i) {
+        volatile char sink = picosha2::hash256_hex_string(secrets[i])[0];
+        (void)sink;
+    }));
+
+    if (!cfg.keep) std::filesystem::remove_all(cfg.dir);
+
+    if (cfg.out.empty()) {
+        write_json(std::cout, cfg, table_bytes, results);
+    } else {
+        std::ofstream out(cfg.out);
+        write_json(out, cfg, table_bytes, results);
+        if (!out) { std::cerr << "Cannot write " << cfg.out << "\n"; return 1; }
+    }
+    return 0;
+}
@@ -0,0 +1,272 @@
+// Load generator for banking_app --serve: opens --connections connections, logs each one in as
+// one of --accounts accounts, and keeps --pipeline requests in flight per connection until
+// --requests have been answered on each. Reports throughput and latency percentiles as JSON.
+//
+// Usage: bank_loadgen [--connect unix:path|[host:]port] [--connections N] [--pipeline N]
+//                     [--requests N] [--accounts N] [--mix balance|deposit|transfer|mixed]
+//                     [--out file.json]
+//
+// Accounts are named loadgen<i> (password "loadgen") and created on the first run; latency is
+// measured per request from send to response, so it includes time queued behind the pipeline.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include "metrics.hpp"
+
+namespace {
+
+struct Config {
+    std::string connect = "127.0.0.1:7878";
+    std::size_t connections = 8;
+    std::size_t pipeline = 16;
+    std::size_t requests = 10000; // per connection
+    std::size_t accounts = 100;
+    std::string mix = "mixed";
+    std::string out;
+};
+
+using Clock = std::chrono::steady_clock;
+
+int dial(const std::string& spec) {
+    if (spec.compare(0, 5, "unix:") == 0) {
+        sockaddr_un sa{};
+        std::string path = spec.substr(5);
+        if (path.size() >= sizeof(sa.sun_path)) throw std::runtime_error("Socket path too long");
+        sa.sun_family = AF_UNIX;
+        std::memcpy(sa.sun_path, path.c_str(), path.size() + 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) < 0) {
+            throw std::runtime_error("Cannot connect to " + spec + ": " + std::strerror(errno));
+        }
+        return fd;
+    }
+    std::string host = "127.0.0.1", port = spec;
+    if (std::size_t colon = spec.rfind(':'); colon != std::string::npos) {
+        host = spec.substr(0, colon);
+        port = spec.substr(colon + 1);
+    }
+    addrinfo hints{};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) throw std::runtime_error("Cannot resolve " + spec);
+    int fd = -1;
+    for (addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) { ::close(fd); fd = -1; }
+    }
+    freeaddrinfo(res);
+    if (fd < 0) throw std::runtime_error("Cannot connect to " + spec + ": " + std::strerror(errno));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Blocking line-oriented client connection.
+class Client {
+public:
+    explicit Client(const std::string& spec) : fd_(dial(spec)) {}
+    ~Client() { ::close(fd_); }
+
+    void send(const std::string& data) {
+        for (std::size_t off = 0; off < data.size();) {
+            ssize_t n = ::send(fd_, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("send: ") + std::strerror(errno));
+            }
+            off += static_cast<std::size_t>(n);
+        }
+    }
+    std::string read_line() {
+        for (;;) {
+            std::size_t nl = buf_.find('\n', pos_);
+            if (nl != std::string::npos) {
+                std::string line = buf_.substr(pos_, nl - pos_);
+                pos_ = nl + 1;
+                return line;
+            }
+            buf_.erase(0, pos_);
+            pos_ = 0;
+            char tmp[16 * 1024];
+            ssize_t n = ::read(fd_, tmp, sizeof(tmp));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("Connection closed by server");
+            buf_.append(tmp, static_cast<std::size_t>(n));
+        }
+    }
+    // Reads one response; HISTORY answers span 1 + k lines.
+    bool read_response(bool history) {
+        std::string line = read_line();
+        bool ok = line.compare(0, 2, "OK") == 0;
+        if (ok && history) {
+            std::size_t k = std::strtoull(line.c_str() + 3, nullptr, 10);
+            for (std::size_t i = 0; i < k; ++i) read_line();
+        }
+        return ok;
+    }
+
+private:
+    int fd_;
+    std::string buf_;
+    std::size_t pos_ = 0;
+};
+
+std::string account(std::size_t i) { return "loadgen" + std::to_string(i); }
+
+// Next request for the chosen mix; sets history for multi-line answers.
+std::string next_request(const Config& cfg, std::mt19937_64& rng, std::size_t self, bool& history) {
+    history = false;
+    std::string kind = cfg.mix;
+    if (kind == "mixed") {
+        unsigned r = static_cast<unsigned>(rng() % 100);
+        kind = r < 40 ? "balance" : r < 65 ? "deposit" : r < 75 ? "withdraw" : r < 95 ? "transfer" : "history";
+    }
+    if (kind == "balance") return "BALANCE\n";
+    if (kind == "deposit") return "DEPOSIT 1.00\n";
+    if (kind == "withdraw") return "WITHDRAW 0.50\n";
+    if (kind == "history") { history = true; return "HISTORY 10\n"; }
+    std::size_t to = rng() % cfg.accounts;
+    if (to == self) to = (to + 1) % cfg.accounts;
+    return "TRANSFER " + account(to) + " 0.01\n";
+}
+
+struct Totals {
+    std::atomic<std::uint64_t> requests{0};
+    std::atomic<std::uint64_t> errors{0};
+    metrics::Histogram latency;
+};
+
+void drive(const Config& cfg, std::size_t conn, Totals& totals) {
+    Client client(cfg.connect);
+    std::size_t self = conn % cfg.accounts;
+    client.send("LOGIN " + account(self) + " loadgen\n");
+    if (!client.read_response(false)) throw std::runtime_error("Login failed for " + account(self));
+
+    std::mt19937_64 rng(conn * 7919 + 1);
+    std::deque<std::pair<Clock::time_point, bool>> in_flight; // send time, is HISTORY
+    std::size_t sent = 0, answered = 0;
+    std::string batch;
+    while (answered < cfg.requests) {
+        batch.clear();
+        auto now = Clock::now();
+        while (sent < cfg.requests && in_flight.size() < cfg.pipeline) {
+            bool history;
+            batch += next_request(cfg, rng, self, history);
+            in_flight.emplace_back(now, history);
+            ++sent;
+        }
+        if (!batch.empty()) client.send(batch);
+
+        auto [start, history] = in_flight.front();
+        in_flight.pop_front();
+        if (!client.read_response(history)) totals.errors.fetch_add(1, std::memory_order_relaxed);
+        totals.latency.record(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+        ++answered;
+    }
+    totals.requests.fetch_add(answered, std::memory_order_relaxed);
+    client.send("QUIT\n");
+    client.read_response(false);
+}
+
+void setup_accounts(const Config& cfg) {
+    Client client(cfg.connect);
+    std::string batch;
+    for (std::size_t i = 0; i < cfg.accounts; ++i) batch += "CREATE " + account(i) + " loadgen 1000000\n";
+    client.send(batch);
+    for (std::size_t i = 0; i < cfg.accounts; ++i) client.read_response(false); // existing ones answer ERR
+}
+
+void usage() {
+    std::cerr << "Usage: bank_loadgen [--connect unix:path|[host:]port] [--connections N] [--pipeline N]\n"
+                 "                    [--requests N] [--accounts N] [--mix balance|deposit|transfer|mixed]\n"
+                 "                    [--out file.json]\n";
+}
+
+bool parse_args(int argc, char** argv, Config& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--connect" && has_value) cfg.connect = argv[++i];
+        else if (arg == "--connections" && has_value) cfg.connections = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--pipeline" && has_value) cfg.pipeline = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--requests" && has_value) cfg.requests = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--accounts" && has_value) cfg.accounts = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--mix" && has_value) cfg.mix = argv[++i];
+        else if (arg == "--out" && has_value) cfg.out = argv[++i];
+        else return false;
+    }
+    bool mix_ok = cfg.mix == "balance" || cfg.mix == "deposit" || cfg.mix == "transfer" || cfg.mix == "mixed";
+    return mix_ok && cfg.connections > 0 && cfg.pipeline > 0 && cfg.requests > 0 && cfg.accounts > 1;
+}
+
+void write_json(std::ostream& os, const Config& cfg, const Totals& totals, double seconds) {
+    const metrics::Histogram& h = totals.latency;
+    auto us = [&](double p) { return static_cast<double>(h.percentile_ns(p)) / 1000.0; };
+    os << "{\n  \"config\": {\"connect\": \"" << cfg.connect << "\", \"connections\": " << cfg.connections
+       << ", \"pipeline\": " << cfg.pipeline << ", \"requests_per_connection\": " << cfg.requests
+       << ", \"accounts\": " << cfg.accounts << ", \"mix\": \"" << cfg.mix << "\"},\n"
+       << "  \"requests\": " << totals.requests.load() << ",\n"
+       << "  \"errors\": " << totals.errors.load() << ",\n"
+       << "  \"seconds\": " << seconds << ",\n"
+       << "  \"requests_per_sec\": " << static_cast<double>(totals.requests.load()) / seconds << ",\n"
+       << "  \"latency_us\": {\"mean\": " << (h.count() ? static_cast<double>(h.sum_ns()) / h.count() / 1000.0 : 0)
+       << ", \"p50\": " << us(50) << ", \"p90\": " << us(90) << ", \"p99\": " << us(99)
+       << ", \"p999\": " << us(99.9) << ", \"max\": " << us(100) << "}\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Config cfg;
+    if (!parse_args(argc, argv, cfg)) { usage(); return 1; }
+    try {
+        setup_accounts(cfg);
+        Totals totals;
+        std::vector<std::thread> threads;
+        std::atomic<bool> failed{false};
+        auto t0 = Clock::now();
+        for (std::size_t c = 0; c < cfg.connections; ++c) {
+            threads.emplace_back([&, c] {
+                try {
+                    drive(cfg, c, totals);
+                } catch (const std::exception& ex) {
+                    std::cerr << "connection " << c << ": " << ex.what() << "\n";
+                    failed = true;
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+        if (cfg.out.empty()) {
+            write_json(std::cout, cfg, totals, seconds);
+        } else {
+            std::ofstream out(cfg.out);
+            write_json(out, cfg, totals, seconds);
+            if (!out) { std::cerr << "Cannot write " << cfg.out << "\n"; return 1; }
+        }
+        return failed ? 1 : 0;
+    } catch (const std::exception& ex) {
+        std::cerr << "bank_loadgen: " << ex.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,403 @@
+// Workload replayer: runs a trace written by `banking_app --record` (Bank::start_recording)
+// against a fresh data directory and reports throughput, per-call latency next to the recorded
+// latency, every call whose outcome differs from the recording, and whether the final balances
+// match the trace's checksum. The output is JSON, so runs can be diffed or plotted over time.
+//
+// Usage: bank_replay <trace> [--speed original|max|<factor>] [--fanout N] [--dir path]
+//                    [--log-layout per-user|segmented] [--snapshot-format text|binary]
+//                    [--async] [--out file.json] [--keep]
+//
+// --speed original keeps the recorded gaps between calls, <factor> divides them (2 = twice as
+// fast), and max (the default) issues calls back to back. --fanout N replays N copies of the
+// workload at once, one thread each; copy k > 0 works on its own accounts, named "<user>~k".
+// Names shorter than three characters are left alone in every copy, so calls that failed on
+// them still fail the same way.
+//
+// History written before recording began is not in the trace: history_size is compared after
+// adding it back, and history pages of such accounts are replayed but not compared. Time-range
+// queries are replayed but never compared: the replayed records carry new timestamps.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+
+#include "bank.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+namespace {
+
+struct Config {
+    std::filesystem::path trace;
+    double speed = 0; // 0 = max, otherwise divides the recorded gaps
+    unsigned fanout = 1;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "bank_replay";
+    LogLayout layout = LogLayout::PerUser;
+    SnapshotFormat format = SnapshotFormat::Text;
+    bool async = false;
+    std::string out;
+    bool keep = false;
+};
+
+constexpr std::size_t kCalls = static_cast<std::size_t>(trace::Call::End);
+constexpr std::size_t kMaxDetails = 10;
+
+struct CallStats {
+    metrics::Histogram replayed;
+    metrics::Histogram recorded;
+};
+
+struct Divergence {
+    unsigned copy;
+    std::uint64_t index; // event number in the trace
+    std::string what;
+};
+
+struct Results {
+    std::vector<CallStats> calls = std::vector<CallStats>(kCalls);
+    std::unordered_map<std::string, std::uint64_t> prior_history; // trace name -> records before the trace
+    std::atomic<std::uint64_t> unchecked{0}; // history pages that could not be compared
+    std::mutex mu; // guards the fields below
+    std::uint64_t divergences = 0;
+    std::vector<Divergence> details;
+    std::uint64_t events = 0; // per copy
+    bool has_end = false;
+    std::size_t end_accounts = 0;
+    std::uint64_t end_checksum = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+void usage() {
+    std::cerr << "Usage: bank_replay <trace> [--speed original|max|<factor>] [--fanout N] [--dir path]\n"
+                 "                   [--log-layout per-user|segmented] [--snapshot-format text|binary]\n"
+                 "                   [--async] [--out file.json] [--keep]\n";
+}
+
+bool parse_args(int argc, char** argv, Config& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--speed" && has_value) {
+            std::string v = argv[++i];
+            if (v == "max") cfg.speed = 0;
+            else if (v == "original") cfg.speed = 1;
+            else if ((cfg.speed = std::strtod(v.c_str(), nullptr)) <= 0) return false;
+        } else if (arg == "--fanout" && has_value) {
+            cfg.fanout = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--dir" && has_value) {
+            cfg.dir = argv[++i];
+        } else if (arg == "--log-layout" && has_value) {
+            std::string v = argv[++i];
+            if (v == "per-user") cfg.layout = LogLayout::PerUser;
+            else if (v == "segmented") cfg.layout = LogLayout::Segmented;
+            else return false;
+        } else if (arg == "--snapshot-format" && has_value) {
+            std::string v = argv[++i];
+            if (v == "text") cfg.format = SnapshotFormat::Text;
+            else if (v == "binary") cfg.format = SnapshotFormat::Binary;
+            else return false;
+        } else if (arg == "--async") {
+            cfg.async = true;
+        } else if (arg == "--out" && has_value) {
+            cfg.out = argv[++i];
+        } else if (arg == "--keep") {
+            cfg.keep = true;
+        } else if (arg[0] != '-' && cfg.trace.empty()) {
+            cfg.trace = arg;
+        } else {
+            return false;
+        }
+    }
+    return !cfg.trace.empty() && cfg.fanout > 0;
+}
+
+std::string copy_name(const std::string& username, unsigned copy) {
+    if (copy == 0 || username.size() < 3) return username;
+    return username + "~" + std::to_string(copy);
+}
+
+// The copy an account belongs to and its name in the trace, undoing copy_name().
+std::pair<unsigned, std::string_view> owner(std::string_view username, unsigned fanout) {
+    std::size_t tilde = username.rfind('~');
+    if (tilde == std::string_view::npos || tilde < 3) return {0, username};
+    unsigned copy = 0;
+    for (char c : username.substr(tilde + 1)) {
+        if (c < '0' || c > '9' || copy >= fanout) return {0, username};
+        copy = copy * 10 + static_cast<unsigned>(c - '0');
+    }
+    if (copy == 0 || copy >= fanout) return {0, username};
+    return {copy, username.substr(0, tilde)};
+}
+
+// Writes the starting accounts of every copy as accounts.db, so the replay starts from the
+// recorded state (admin included) without a password hash per account.
+void seed(const Config& cfg, const std::vector<trace::Account>& initial) {
+    std::filesystem::remove_all(cfg.dir);
+    std::filesystem::create_directories(cfg.dir);
+    std::vector<snapshot::Row> rows;
+    for (unsigned copy = 0; copy < cfg.fanout; ++copy) {
+        for (const trace::Account& a : initial) {
+            if (copy > 0 && a.username.size() < 3) continue;
+            rows.emplace_back(copy_name(a.username, copy), digest_to_hex(trace::replay_digest(a.digest)), a.balance);
+        }
+    }
+    std::string err;
+    if (!snapshot::write_text(cfg.dir / "accounts.db", rows, err)) { std::cerr << "bank_replay: " << err << "\n"; std::exit(1); }
+}
+
+void diverged(Results& res, unsigned copy, std::uint64_t index, const trace::Event& e, std::string what) {
+    std::lock_guard<std::mutex> lk(res.mu);
+    ++res.divergences;
+    if (res.details.size() < kMaxDetails) {
+        res.details.push_back({copy, index, std::string(trace::name(e.call)) + " '" + e.user + "': " + what});
+    }
+}
+
+// Issues one recorded call against the bank and compares the outcome with the recording.
+void replay_one(Bank& bank, const trace::Event& e, unsigned copy, std::uint64_t index, Results& res) {
+    const std::string user = copy_name(e.user, copy);
+    std::string err;
+    bool ok = false;
+    bool compare = true;
+    std::uint64_t result = 0;
+    auto prior = res.prior_history.find(e.user);
+    std::uint64_t prior_records = prior == res.prior_history.end() ? 0 : prior->second;
+    auto t0 = Clock::now();
+    switch (e.call) {
+    case trace::Call::CreateAccount:
+        ok = bank.create_account(user, trace::replay_password(e.password, e.password_len), e.amount, err);
+        break;
+    case trace::Call::Authenticate:
+        ok = bank.authenticate(user, trace::replay_password(e.password, e.password_len)).has_value();
+        break;
+    case trace::Call::Deposit:
+        ok = bank.deposit(user, e.amount, err);
+        break;
+    case trace::Call::Withdraw:
+        ok = bank.withdraw(user, e.amount, err);
+        break;
+    case trace::Call::Transfer:
+        ok = bank.transfer(user, copy_name(e.other, copy), e.amount, err);
+        break;
+    case trace::Call::ApplyBatch: {
+        std::vector<Posting> postings;
+        postings.reserve(e.legs.size());
+        for (const trace::Leg& leg : e.legs) postings.push_back({copy_name(leg.from, copy), copy_name(leg.to, copy), leg.amount});
+        std::vector<PostingResult> results;
+        ok = bank.apply_batch(postings, results, err);
+        if (ok) {
+            std::vector<std::pair<Money, Money>> legs;
+            for (const PostingResult& r : results) legs.emplace_back(r.from_balance, r.to_balance);
+            result = trace::fingerprint(legs);
+        }
+        break;
+    }
+    case trace::Call::BalanceOf: {
+        std::optional<Money> balance = bank.balance_of(user);
+        ok = balance.has_value();
+        if (ok) result = static_cast<std::uint64_t>(balance->cents());
+        break;
+    }
+    case trace::Call::HistorySize:
+        ok = true;
+        result = bank.history_size(user) + prior_records;
+        break;
+    case trace::Call::History:
+        ok = true;
+        result = trace::fingerprint(bank.history(user, e.offset, e.limit));
+        compare = prior_records == 0;
+        break;
+    case trace::Call::RecentHistory:
+        ok = true;
+        result = trace::fingerprint(bank.recent_history(user, e.limit));
+        compare = prior_records == 0;
+        break;
+    case trace::Call::HistoryRange:
+        ok = true;
+        result = trace::fingerprint(bank.history_range(user, e.from_ts, e.to_ts, static_cast<std::size_t>(e.limit)));
+        compare = false; // the replay's records carry new timestamps, outside the recorded bounds
+        break;
+    case trace::Call::SetDeferred:
+        // Bank-wide mode: only the first copy switches it.
+        ok = e.ok;
+        if (copy == 0) bank.set_deferred(e.ok);
+        break;
+    case trace::Call::Commit:
+        ok = true;
+        bank.commit();
+        break;
+    case trace::Call::End:
+        return;
+    }
+    std::uint64_t ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+    CallStats& cs = res.calls[static_cast<std::size_t>(e.call) - 1];
+    cs.replayed.record(ns);
+    cs.recorded.record(e.latency_ns);
+
+    if (ok != e.ok) {
+        diverged(res, copy, index, e, ok ? "succeeded, recorded as failed (" + e.err + ")"
+                                         : "failed (" + err + "), recorded as succeeded");
+    } else if (!ok && err != e.err && e.call != trace::Call::Authenticate) {
+        diverged(res, copy, index, e, "failed with \"" + err + "\", recorded \"" + e.err + "\"");
+    } else if (ok && !compare) {
+        res.unchecked.fetch_add(1, std::memory_order_relaxed);
+    } else if (ok && result != e.result) {
+        diverged(res, copy, index, e, "result " + std::to_string(result) + ", recorded " + std::to_string(e.result));
+    }
+}
+
+// One copy of the workload, streamed from its own reader.
+void replay_copy(Bank& bank, const Config& cfg, unsigned copy, Clock::time_point start, Results& res) {
+    trace::Reader reader;
+    std::string err;
+    if (!reader.open(cfg.trace, err)) { std::cerr << "bank_replay: " << err << "\n"; std::exit(1); }
+    trace::Event e;
+    std::uint64_t index = 0;
+    while (reader.next(e, err)) {
+        if (e.call == trace::Call::End) {
+            if (copy == 0) {
+                std::lock_guard<std::mutex> lk(res.mu);
+                res.has_end = true;
+                res.end_accounts = e.offset;
+                res.end_checksum = e.result;
+            }
+            continue;
+        }
+        if (cfg.speed > 0) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<std::int64_t>(e.at_us / cfg.speed)));
+        }
+        replay_one(bank, e, copy, index++, res);
+    }
+    // A recording cut short by a crash still replays up to the damage, without a final check.
+    if (!err.empty() && copy == 0) std::cerr << "bank_replay: " << cfg.trace.string() << ": " << err << "\n";
+    if (copy == 0) {
+        std::lock_guard<std::mutex> lk(res.mu);
+        res.events = index;
+    }
+}
+
+// Per-copy account count and trace::state_add sum, with names mapped back to the trace's.
+// Accounts that every copy shares (short names) count towards each of them.
+std::vector<std::pair<std::size_t, std::uint64_t>> final_state(Bank& bank, unsigned fanout) {
+    std::vector<std::pair<std::size_t, std::uint64_t>> state(fanout);
+    BalanceSnapshot snap = bank.snapshot();
+    for (std::size_t p = 0; p < snap.parts(); ++p) {
+        snap.for_each_in(p, [&](std::string_view username, Money balance) {
+            auto [copy, name] = owner(username, fanout);
+            for (unsigned k = 0; k < fanout; ++k) {
+                if (k != copy && (copy != 0 || name.size() >= 3)) continue;
+                ++state[k].first;
+                state[k].second = trace::state_add(state[k].second, name, balance);
+            }
+        });
+    }
+    return state;
+}
+
+void write_json(std::ostream& os, const Config& cfg, const Results& res, double seconds,
+                const std::vector<std::pair<std::size_t, std::uint64_t>>& state) {
+    std::uint64_t calls = res.events * cfg.fanout;
+    os << "{\n  \"config\": {\"trace\": \"" << cfg.trace.string() << "\", \"speed\": ";
+    if (cfg.speed > 0) os << cfg.speed;
+    else os << "\"max\"";
+    os << ", \"fanout\": " << cfg.fanout
+       << ", \"log_layout\": \"" << (cfg.layout == LogLayout::Segmented ? "segmented" : "per-user") << "\""
+       << ", \"snapshot_format\": \"" << (cfg.format == SnapshotFormat::Binary ? "binary" : "text") << "\""
+       << ", \"async\": " << (cfg.async ? "true" : "false") << "},\n"
+       << "  \"events\": " << res.events << ", \"calls\": " << calls << ", \"seconds\": " << seconds
+       << ", \"calls_per_sec\": " << (seconds > 0 ? static_cast<double>(calls) / seconds : 0) << ",\n"
+       << "  \"latency_us\": {";
+    bool first = true;
+    for (std::size_t i = 0; i < kCalls; ++i) {
+        const CallStats& cs = res.calls[i];
+        if (cs.replayed.count() == 0) continue;
+        os << (first ? "\n" : ",\n") << "    \"" << trace::name(static_cast<trace::Call>(i + 1)) << "\": {"
+           << "\"count\": " << cs.replayed.count()
+           << ", \"p50\": " << cs.replayed.percentile_ns(50) / 1000.0
+           << ", \"p99\": " << cs.replayed.percentile_ns(99) / 1000.0
+           << ", \"recorded_p50\": " << cs.recorded.percentile_ns(50) / 1000.0
+           << ", \"recorded_p99\": " << cs.recorded.percentile_ns(99) / 1000.0 << "}";
+        first = false;
+    }
+    os << (first ? "},\n" : "\n  },\n") << "  \"divergences\": " << res.divergences
+       << ", \"unchecked_history\": " << res.unchecked.load() << ",\n  \"first_divergences\": [";
+    for (std::size_t i = 0; i < res.details.size(); ++i) {
+        const Divergence& d = res.details[i];
+        std::string what;
+        for (char c : d.what) {
+            if (c == '"' || c == '\\') what += '\\';
+            if (static_cast<unsigned char>(c) >= ' ') what += c;
+        }
+        os << (i ? ",\n" : "\n") << "    {\"copy\": " << d.copy << ", \"event\": " << d.index << ", \"what\": \"" << what << "\"}";
+    }
+    os << (res.details.empty() ? "],\n" : "\n  ],\n") << "  \"final_state\": [";
+    for (unsigned k = 0; k < cfg.fanout; ++k) {
+        os << (k ? ", " : "") << "{\"copy\": " << k << ", \"accounts\": " << state[k].first << ", \"matches\": ";
+        if (res.has_end) os << (state[k].first == res.end_accounts && state[k].second == res.end_checksum ? "true" : "false");
+        else os << "null"; // the recording process did not stop cleanly
+        os << "}";
+    }
+    os << "]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Config cfg;
+    if (!parse_args(argc, argv, cfg)) { usage(); return 1; }
+
+    trace::Reader reader;
+    std::string err;
+    if (!reader.open(cfg.trace, err)) { std::cerr << "bank_replay: " << err << "\n"; return 1; }
+    std::cerr << "seeding " << reader.initial().size() << " account(s) x " << cfg.fanout << "...\n";
+    seed(cfg, reader.initial());
+
+    Results res;
+    for (const trace::Account& a : reader.initial()) {
+        if (a.history > 0) res.prior_history.emplace(a.username, a.history);
+    }
+
+    BankOptions opts;
+    opts.data_dir = cfg.dir;
+    opts.snapshot_format = cfg.format;
+    opts.txlog.layout = cfg.layout;
+    opts.async_persistence = cfg.async;
+
+    double seconds = 0;
+    std::vector<std::pair<std::size_t, std::uint64_t>> state;
+    {
+        Bank bank(opts);
+        bank.load();
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned k = 0; k < cfg.fanout; ++k) {
+            threads.emplace_back([&, k] { replay_copy(bank, cfg, k, start, res); });
+        }
+        for (auto& t : threads) t.join();
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        state = final_state(bank, cfg.fanout);
+    }
+    std::cerr << res.events << " event(s) x " << cfg.fanout << " in " << seconds << " s, "
+              << res.divergences << " divergence(s)\n";
+
+    if (!cfg.keep) std::filesystem::remove_all(cfg.dir);
+
+    if (cfg.out.empty()) {
+        write_json(std::cout, cfg, res, seconds, state);
+    } else {
+        std::ofstream out(cfg.out);
+        write_json(out, cfg, res, seconds, state);
+        if (!out) { std::cerr << "Cannot write " << cfg.out << "\n"; return 1; }
+    }
+    return res.divergences == 0 ? 0 : 2;
+}
@@ -0,0 +1,182 @@
+// Cold-start scaling benchmark: times Bank::load() on a text snapshot and a scan of every
+// transaction log at several thread counts, and reports the speedup over one thread as JSON.
+//
+// Usage: load_bench [--accounts N] [--logs N] [--records N] [--threads 1,2,4,...]
+//                   [--repeat N] [--dir path] [--out file.json] [--keep]
+//
+// The dataset is written straight to disk (accounts.db plus --logs logs of --records records),
+// so generating a million accounts does not cost a million password hashes.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+
+#include "bank.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+struct Config {
+    std::size_t accounts = 1000000;
+    std::size_t logs = 20000;
+    std::size_t records = 20;
+    std::vector<unsigned> threads;
+    std::size_t repeat = 3;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "bank_load_bench";
+    std::string out;
+    bool keep = false;
+};
+
+struct Result {
+    unsigned threads = 0;
+    double load_seconds = 0; // best of --repeat
+    double scan_seconds = 0;
+    std::size_t loaded = 0;
+    std::size_t scanned = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+template <typename F>
+double best_of(std::size_t repeat, F&& run) {
+    double best = 0;
+    for (std::size_t i = 0; i < repeat; ++i) {
+        auto t0 = Clock::now();
+        run();
+        double s = std::chrono::duration<double>(Clock::now() - t0).count();
+        if (i == 0 || s < best) best = s;
+    }
+    return best;
+}
+
+std::string user(std::size_t i) { return "user" + std::to_string(i); }
+
+void write_dataset(const Config& cfg) {
+    std::filesystem::remove_all(cfg.dir);
+    std::filesystem::create_directories(cfg.dir / "transactions");
+    const std::string hash = Bank::hash_password("bench-password");
+    std::vector<snapshot::Row> rows;
+    rows.reserve(cfg.accounts + 1);
+    rows.emplace_back("admin", Bank::hash_password("admin"), Money());
+    for (std::size_t i = 0; i < cfg.accounts; ++i) rows.emplace_back(user(i), hash, Money::from_cents(100000));
+    std::string err;
+    if (!snapshot::write_text(cfg.dir / "accounts.db", rows, err)) { std::cerr << "load_bench: " << err << "\n"; std::exit(1); }
+
+    TxLogWriter writer(cfg.dir / "transactions", TxLogOptions{});
+    std::size_t logs = std::min(cfg.logs, cfg.accounts);
+    for (std::size_t r = 0; r < cfg.records; ++r) {
+        for (std::size_t i = 0; i < logs; ++i) {
+            Money bal = Money::from_cents(static_cast<std::int64_t>(100000 + r + 1));
+            Transaction tx{timestamp::next(), TxType::Deposit, Money::from_cents(1), bal};
+            writer.append(user(i), tx);
+        }
+    }
+    writer.flush();
+}
+
+void usage() {
+    std::cerr << "Usage: load_bench [--accounts N] [--logs N] [--records N] [--threads 1,2,4,...]\n"
+                 "                  [--repeat N] [--dir path] [--out file.json] [--keep]\n";
+}
+
+bool parse_args(int argc, char** argv, Config& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--accounts" && has_value) cfg.accounts = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--logs" && has_value) cfg.logs = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--records" && has_value) cfg.records = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--repeat" && has_value) cfg.repeat = std::max<std::size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        else if (arg == "--dir" && has_value) cfg.dir = argv[++i];
+        else if (arg == "--out" && has_value) cfg.out = argv[++i];
+        else if (arg == "--keep") cfg.keep = true;
+        else if (arg == "--threads" && has_value) {
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                unsigned n = static_cast<unsigned>(std::strtoul(item.c_str(), nullptr, 10));
+                if (n == 0) return false;
+                cfg.threads.push_back(n);
+            }
+        } else {
+            return false;
+        }
+    }
+    if (cfg.threads.empty()) {
+        unsigned hw = parallel::threads_for(0);
+        for (unsigned n = 1; n < hw; n *= 2) cfg.threads.push_back(n);
+        cfg.threads.push_back(hw);
+    }
+    return cfg.accounts > 0;
+}
+
+void write_json(std::ostream& os, const Config& cfg, const std::vector<Result>& results) {
+    os << "{\n  \"config\": {\"accounts\": " << cfg.accounts << ", \"logs\": " << cfg.logs
+       << ", \"records\": " << cfg.records << ", \"repeat\": " << cfg.repeat
+       << ", \"hardware_threads\": " << parallel::threads_for(0) << "},\n  \"results\": [\n";
+    const Result& base = results.front();
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        os << "    {\"threads\": " << r.threads << ", "
+           << "\"load_seconds\": " << r.load_seconds << ", "
+           << "\"load_speedup\": " << base.load_seconds / r.load_seconds << ", "
+           << "\"accounts_per_sec\": " << static_cast<double>(r.loaded) / r.load_seconds << ", "
+           << "\"scan_seconds\": " << r.scan_seconds << ", "
+           << "\"scan_speedup\": " << (r.scan_seconds > 0 ? base.scan_seconds / r.scan_seconds : 0) << ", "
+           << "\"records_scanned\": " << r.scanned << "}"
+           << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Config cfg;
+    if (!parse_args(argc, argv, cfg)) { usage(); return 1; }
+
+    std::cerr << "writing " << cfg.accounts << " accounts and " << std::min(cfg.logs, cfg.accounts) << " logs...\n";
+    write_dataset(cfg);
+
+    std::vector<Result> results;
+    for (unsigned threads : cfg.threads) {
+        BankOptions opts;
+        opts.data_dir = cfg.dir;
+        opts.load_threads = threads;
+        Result r;
+        r.threads = threads;
+        r.load_seconds = best_of(cfg.repeat, [&] {
+            Bank bank(opts);
+            bank.load();
+        });
+        Bank bank(opts);
+        bank.load();
+        r.loaded = bank.account_count();
+        r.scan_seconds = best_of(cfg.repeat, [&] {
+            std::atomic<std::size_t> records{0};
+            bank.scan_history([&](const std::string&, std::vector<history::LogRecord>& recs) {
+                records.fetch_add(recs.size(), std::memory_order_relaxed);
+            });
+            r.scanned = records.load();
+        });
+        std::cerr << threads << " thread(s): load " << r.load_seconds << " s, scan " << r.scan_seconds << " s\n";
+        results.push_back(r);
+    }
+
+    if (!cfg.keep) std::filesystem::remove_all(cfg.dir);
+
+    if (cfg.out.empty()) {
+        write_json(std::cout, cfg, results);
+    } else {
+        std::ofstream out(cfg.out);
+        write_json(out, cfg, results);
+        if (!out) { std::cerr << "Cannot write " << cfg.out << "\n"; return 1; }
+    }
+    return 0;
+}
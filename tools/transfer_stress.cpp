@@ -0,0 +1,92 @@
+// Concurrency stress check: N threads hammer random transfers (plus balance reads)
+// against one Bank and verify that the total amount of money is conserved,
+// both in memory and after reloading from the journal/snapshot on disk.
+//
+// Usage: transfer_stress [threads] [accounts] [transfers_per_thread] [data_dir] [async]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+#include "bank.hpp"
+
+static Money total_balance(const Bank& bank) {
+    Money total;
+    for (const auto& p : bank.all_accounts()) Money::add(total, p.second, total);
+    return total;
+}
+
+int main(int argc, char** argv) {
+    int threads = argc > 1 ? std::stoi(argv[1]) : 8;
+    int accounts = argc > 2 ? std::stoi(argv[2]) : 200;
+    int per_thread = argc > 3 ? std::stoi(argv[3]) : 20000;
+    std::filesystem::path dir = argc > 4 ? std::filesystem::path(argv[4])
+                                         : std::filesystem::temp_directory_path() / "bank_transfer_stress";
+    bool async = argc > 5 && std::string(argv[5]) == "async";
+    const Money initial = Money::from_cents(100000);
+
+    std::filesystem::remove_all(dir);
+    BankOptions opts;
+    opts.data_dir = dir;
+    opts.checkpoint_every = 5000; // exercise background checkpoints under load
+    opts.async_persistence = async;
+    opts.persist_queue_capacity = 64; // small, so producers also hit backpressure
+
+    Money expected;
+    {
+        Bank bank(opts);
+        bank.load();
+        std::string err;
+        for (int i = 0; i < accounts; ++i) {
+            if (!bank.create_account("user" + std::to_string(i), "secret", initial, err)) {
+                std::cerr << "create_account failed: " << err << "\n";
+                return 1;
+            }
+        }
+        expected = total_balance(bank);
+
+        std::atomic<long> ok{0}, rejected{0};
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; ++t) {
+            pool.emplace_back([&, t]() {
+                std::mt19937 rng(1234u + t);
+                std::uniform_int_distribution<int> pick(0, accounts - 1);
+                std::uniform_int_distribution<int> amt(1, 30000);
+                std::string e;
+                for (int i = 0; i < per_thread; ++i) {
+                    int a = pick(rng), b = pick(rng);
+                    if (i % 16 == 0) (void)bank.balance_of("user" + std::to_string(a));
+                    if (bank.transfer("user" + std::to_string(a), "user" + std::to_string(b), Money::from_cents(amt(rng)), e)) ++ok;
+                    else ++rejected;
+                }
+            });
+        }
+        for (auto& th : pool) th.join();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        Money total = total_balance(bank);
+        std::cout << threads << " threads, " << accounts << " accounts: " << ok << " transfers, "
+                  << rejected << " rejected, " << static_cast<long>((ok + rejected) / secs) << " ops/sec\n";
+        if (total != expected) {
+            std::cerr << "FAIL: in-memory total " << total << " != expected " << expected << "\n";
+            return 1;
+        }
+    }
+
+    // Reload from disk: snapshot + journal replay must land on the same total.
+    Bank reloaded(opts);
+    reloaded.load();
+    Money total = total_balance(reloaded);
+    if (total != expected) {
+        std::cerr << "FAIL: reloaded total " << total << " != expected " << expected << "\n";
+        return 1;
+    }
+    std::cout << "OK: total " << total << " conserved\n";
+    std::filesystem::remove_all(dir);
+    return 0;
+}